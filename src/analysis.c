@@ -1,164 +1,917 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <sqlite3.h>
-#include <time.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "debug.h"
 #include "particle.h"
+#include "grid.h"
+#include "force.h"
+#include "neighbor.h"
 #include "record.h"
+#include "recorder.h"
+#include "pipeline.h"
+#include "profile.h"
+#include "checkpoint.h"
+#include "subcycle.h"
+#include "sleep.h"
+#include "stats.h"
 #include "analysis.h"
+#ifdef ODEM_MPI
+#include "domain.h"
+#endif
 
-/* local data structure */
+/* analysis logic */
+
+/**
+ * Order of two particle ids, for bsearch
+ *
+ * @param a Pointer to the first id
+ * @param b Pointer to the second id
+ * @return Negative, zero or positive as a is before, equal to or after b
+ */
+static int odem_compare_ids(const void* a, const void* b)
+{
+    const int id_a = *(const int*)a, id_b = *(const int*)b;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+/**
+ * Copy the recorded particles and fields into a snapshot, mutator
+ *
+ * Accelerations are the net force of the last step over the particle mass.
+ * Sleeping particles are left out, see odem_msleep_record.
+ *
+ * @param snap Snapshot to fill
+ * @param parts Particle set
+ * @param record Trajectory output controls
+ * @param sleep Sleep state, NULL when particles do not sleep
+ * @param time Time of step
+ */
+static void odem_mfill_snapshot(struct odem_snapshot* snap,
+    const struct odem_particles* parts, const struct odem_record_opts* record,
+    struct odem_sleep* sleep, const double time)
+{
+    int i, j, id, row = 0;
+    const unsigned int fields = snap->fields;
+
+    snap->time = time;
+    snap->num_sleep_changes = 0;
+
+    /* every particle, copy whole columns */
+    if (record->particle_ids == NULL && sleep == NULL)
+    {
+        for (i = 0; i < parts->num_particles; i++)
+            snap->particle_id[i] = parts->id[i] + 1;
+        for (j = 0; j < parts->dof; j++)
+        {
+            if (fields & ODEM_FIELD_MASK(ODEM_FIELD_POSITION))
+                memcpy(snap->data[ODEM_FIELD_POSITION][j], parts->centroid[j],
+                    parts->num_particles * sizeof(double));
+            if (fields & ODEM_FIELD_MASK(ODEM_FIELD_VELOCITY))
+                memcpy(snap->data[ODEM_FIELD_VELOCITY][j], parts->velocity[j],
+                    parts->num_particles * sizeof(double));
+            if (fields & ODEM_FIELD_MASK(ODEM_FIELD_ACCELERATION))
+                for (i = 0; i < parts->num_particles; i++)
+                    snap->data[ODEM_FIELD_ACCELERATION][j][i] =
+                        parts->force[j][i] / parts->mass[i];
+            if (fields & ODEM_FIELD_MASK(ODEM_FIELD_FORCE))
+                memcpy(snap->data[ODEM_FIELD_FORCE][j], parts->force[j],
+                    parts->num_particles * sizeof(double));
+        }
+        snap->num_particles = parts->num_particles;
+        return;
+    }
+
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        id = parts->id[i] + 1;
+        if (record->particle_ids != NULL &&
+            bsearch(&id, record->particle_ids, record->num_particle_ids,
+            sizeof(int), odem_compare_ids) == NULL)
+            continue;
+        if (sleep != NULL && !odem_msleep_record(sleep, snap, parts->id[i]))
+            continue;
+
+        snap->particle_id[row] = id;
+        for (j = 0; j < parts->dof; j++)
+        {
+            if (fields & ODEM_FIELD_MASK(ODEM_FIELD_POSITION))
+                snap->data[ODEM_FIELD_POSITION][j][row] = parts->centroid[j][i];
+            if (fields & ODEM_FIELD_MASK(ODEM_FIELD_VELOCITY))
+                snap->data[ODEM_FIELD_VELOCITY][j][row] = parts->velocity[j][i];
+            if (fields & ODEM_FIELD_MASK(ODEM_FIELD_ACCELERATION))
+                snap->data[ODEM_FIELD_ACCELERATION][j][row] =
+                    parts->force[j][i] / parts->mass[i];
+            if (fields & ODEM_FIELD_MASK(ODEM_FIELD_FORCE))
+                snap->data[ODEM_FIELD_FORCE][j][row] = parts->force[j][i];
+        }
+        row++;
+    }
+    snap->num_particles = row;
+}
 
-struct double_node
+/**
+ * Broad phase state of a running analysis
+ *
+ * @member broad_phase Broad phase contact detection strategy
+ * @member grid Grid rebuilt every step for the grid broad phase
+ * @member pairs Candidate pairs of the grid broad phase
+ * @member neighbors Neighbour list for the Verlet broad phase
+ * @member pair_forces Pair force storage indexed for the current pairs
+ * @member contact_kernel Pair contact kernel
+ * @member kernels Solver kernels for the dof of the particle set
+ * @member model Contact model
+ * @member contacts Contact store, NULL for the spring law
+ * @member walls Walls of the domain and of the scene
+ * @member num_sorts Number of times particles were reordered
+ * @member sorted_spread Pair spread measured after the last reorder, 0 until
+ *                       measured
+ * @member sort_pending Whether or not a reorder is due at the next step
+ * @member domain Domain decomposition of a distributed run, NULL for a serial
+ *                run
+ * @member subcycle Time step classes of a sub-cycled run, NULL otherwise
+ * @member substep Substep of the time step being evaluated, from 1
+ * @member sleep Sleep state of a run that puts particles to sleep, NULL
+ *               otherwise
+ * @member stats Statistics of a run reducing them, NULL otherwise
+ * @member stats_due Whether or not the statistics are reduced at the time
+ *                   step being evaluated
+ */
+struct odem_broad_phase_state
 {
-    double data[ODEM_DOF];
-    struct double_node* next;
+    enum odem_broad_phase broad_phase;
+    struct odem_grid* grid;
+    struct odem_pair_list* pairs;
+    struct odem_neighbor_list* neighbors;
+    struct odem_pair_forces* pair_forces;
+    enum odem_contact_kernel contact_kernel;
+    const struct odem_kernels* kernels;
+    const struct odem_contact_model* model;
+    struct odem_contact_store* contacts;
+    struct odem_walls* walls;
+    int num_sorts;
+    double sorted_spread;
+    int sort_pending;
+    struct odem_domain* domain;
+    struct odem_subcycle* subcycle;
+    int substep;
+    struct odem_sleep* sleep;
+    struct odem_stats* stats;
+    int stats_due;
 };
 
-struct double_node* alloc_double_node(double data[])
+/**
+ * Accumulate the contact forces over a pair list with the contact law of the
+ * run, mutator
+ *
+ * @param parts Particle set
+ * @param state Broad phase state, its pair forces indexed for the pair list
+ * @param pairs Pair list
+ * @param delta_time Time since the previous evaluation
+ * @return Number of particle pairs in contact
+ */
+static int odem_mforce_pair_list(struct odem_particles* parts,
+    struct odem_broad_phase_state* state, const struct odem_pair_list* pairs,
+    const double delta_time)
 {
-    int i;
-
-    struct double_node* new_node = (struct double_node*)malloc(sizeof(
-        struct double_node));
-    if (new_node == NULL) die("Memory allocation error");
-    new_node->next = NULL;
-    for (i = 0; i < ODEM_DOF; i++)
-        new_node->data[i] = data[i];
-    return new_node;
+    if (state->contacts != NULL)
+        return state->kernels->force_pairs_history(parts, state->pair_forces,
+            pairs, state->model, state->contacts, delta_time);
+    return state->kernels->force_pairs(parts, state->pair_forces, pairs,
+        state->model->spring_constant, state->contact_kernel);
 }
 
-void double_push(struct double_node** double_list, double data[])
+/**
+ * Index the pair forces for a changed pair list, mutator
+ *
+ * A sub-cycled run first sorts the pairs by time step class, so the pairs
+ * due at a substep lead the list. When particles sleep the pair forces are
+ * indexed for the pairs with an awake particle instead, see odem_sleep.
+ *
+ * @param parts Particle set
+ * @param state Broad phase state
+ * @param pairs Pair list
+ */
+static void odem_mbroad_phase_index(const struct odem_particles* parts,
+    struct odem_broad_phase_state* state, struct odem_pair_list* pairs)
 {
-    struct double_node* new_node = alloc_double_node(data);
-    new_node->next = *double_list;
-    *double_list = new_node;
+    if (state->subcycle != NULL)
+    {
+        odem_msubcycle_sort_pairs(state->subcycle, pairs);
+        state->pair_forces->stride = state->subcycle->pair_stride;
+    }
+    if (state->sleep != NULL)
+    {
+        odem_msleep_filter_pairs(state->sleep, parts, pairs);
+        pairs = state->sleep->pairs;
+    }
+    odem_mpair_forces_index(state->pair_forces, pairs, parts->num_particles);
 }
 
-void set_double_data(struct double_node* curr_double_node, double data[])
+/**
+ * Rebuild the pair lists that refer to particle indices after particles
+ * moved to other indices, mutator
+ *
+ * The grid is binned every step anyway.
+ *
+ * @param parts Particle set
+ * @param state Broad phase state
+ */
+static void odem_mbroad_phase_reindex(struct odem_particles* parts,
+    struct odem_broad_phase_state* state)
 {
-    int i;
-    for (i = 0; i < ODEM_DOF; i++)
-        curr_double_node->data[i] = data[i];
+    if (state->subcycle != NULL)
+        odem_msubcycle_classify(state->subcycle, parts);
+
+    if (state->neighbors != NULL)
+    {
+        odem_mneighbor_list_build(state->neighbors, parts);
+        odem_mbroad_phase_index(parts, state, state->neighbors->pairs);
+    }
+    else if (state->broad_phase == ODEM_BROAD_PHASE_ALL_PAIRS &&
+        state->pairs != NULL)
+    {
+        odem_mall_pairs(state->pairs, parts->num_particles);
+        odem_mbroad_phase_index(parts, state, state->pairs);
+    }
 }
 
-/* analysis logic */
+/**
+ * Remove the particles that entered an outlet and reorder the particles
+ * along a space filling curve when due, mutator
+ *
+ * A reorder is due every sort_every iterations, or once the pairs have
+ * spread over memory by sort_spread times their spread after the last
+ * reorder, see odem_mmeasure_spread. The spread is only measured against a
+ * sorted order, so with it particles are also reordered on the first step.
+ *
+ * @param parts Particle set
+ * @param state Broad phase state
+ * @param opts Analysis options
+ * @param bounds Array containing boundaries
+ * @param iteration Current iteration
+ * @return Number of particles removed
+ */
+static int odem_mmaintain_particles(struct odem_particles* parts,
+    struct odem_broad_phase_state* state,
+    const struct odem_analysis_opts* opts, const double bounds[],
+    const int iteration)
+{
+    int i, removed = 0, moved;
+    int* order;
+
+    for (i = 0; i < opts->num_outlets; i++)
+        removed += odem_mparticles_remove_inside(parts,
+            opts->outlets + 2*ODEM_MAX_DOF*i);
+    moved = removed > 0;
+
+    if ((opts->sort_every > 0 && iteration % opts->sort_every == 0) ||
+        state->sort_pending)
+    {
+        order = (int*)malloc(parts->num_particles * sizeof(int));
+        if (order == NULL && parts->num_particles > 0)
+            die("Memory allocation error");
+        odem_spatial_order(order, parts, bounds);
+        odem_mparticles_permute(parts, order, parts->num_particles);
+        free(order);
+
+        state->num_sorts++;
+        state->sort_pending = 0;
+        state->sorted_spread = 0.0;
+        moved = 1;
+    }
+
+    if (moved) odem_mbroad_phase_reindex(parts, state);
+    return removed;
+}
+
+/**
+ * Compare the memory spread of the current pairs with their spread after
+ * the last reorder and flag a reorder once it has grown too much, mutator
+ *
+ * @param state Broad phase state
+ * @param sort_spread Growth of the spread that calls for a reorder
+ */
+static void odem_mmeasure_spread(struct odem_broad_phase_state* state,
+    const double sort_spread)
+{
+    double spread;
+    const struct odem_pair_list* pairs;
+
+    /* every pair is a neighbour when testing all pairs */
+    if (state->broad_phase == ODEM_BROAD_PHASE_GRID)
+        pairs = state->pairs;
+    else if (state->broad_phase == ODEM_BROAD_PHASE_VERLET)
+        pairs = state->neighbors->pairs;
+    else
+        return;
+
+    spread = odem_pair_spread(pairs);
+    if (state->sorted_spread <= 0)
+        state->sorted_spread = spread;
+    else if (spread > sort_spread * state->sorted_spread)
+        state->sort_pending = 1;
+}
+
+/**
+ * Accumulate the net force on every particle, mutator
+ *
+ * The broad phase runs first, the static walls are checked against the
+ * particles it bins near them. A distributed run first exchanges particles
+ * with the other ranks and drops the ghosts again at the end. A sub-cycled
+ * run evaluates the pairs of the classes due at the substep and adds to the
+ * forces gathered since the start of the time step. When statistics are
+ * due, the contacts of the time step are reduced at its last evaluation,
+ * over every candidate pair, see odem_mstats_contacts.
+ *
+ * @param parts Particle set
+ * @param state Broad phase state
+ * @param time Time of the evaluation
+ * @param delta_time Time since the previous evaluation, a substep when
+ *                   sub-cycling
+ * @param prof Profile to charge the force phases to
+ * @return Number of particle pairs in contact
+ */
+static int odem_mcompute_forces(struct odem_particles* parts,
+    struct odem_broad_phase_state* state, const double time,
+    const double delta_time, struct odem_profile* prof)
+{
+    int collisions, num_owned;
+    long pair_tests;
+    const struct odem_pair_list* pairs;
+    const struct odem_pair_list* candidates;
+    struct odem_pair_list due_pairs;
+    double lap = odem_wall_time();
+
+    #ifdef ODEM_MPI
+        if (state->domain != NULL)
+            odem_mdomain_exchange(state->domain, parts, state->contacts);
+    #endif
+
+    /* bin particles and find candidate pairs */
+    switch (state->broad_phase)
+    {
+        case ODEM_BROAD_PHASE_GRID:
+            odem_mgrid_reserve(state->grid, parts->num_particles);
+            odem_mgrid_bin(state->grid, parts);
+            odem_mgrid_pairs(state->pairs, state->grid);
+            odem_mbroad_phase_index(parts, state, state->pairs);
+            break;
+        case ODEM_BROAD_PHASE_VERLET:
+            if (odem_mneighbor_list_update(state->neighbors, parts) ||
+                (state->sleep != NULL && state->sleep->changed))
+                odem_mbroad_phase_index(parts, state,
+                    state->neighbors->pairs);
+            break;
+        default:
+            break;
+    }
+    lap = odem_mprofile_lap(prof, ODEM_PHASE_BROAD_PHASE, lap);
+
+    /* accumulate forces from scratch every step, over the whole time step
+     * when sub-cycling */
+    if (state->subcycle == NULL || state->substep == 1)
+        odem_mzero_forces(parts);
+
+    /* check particles for wall collisions */
+    odem_mwalls_at(state->walls, time);
+    state->kernels->force_walls(parts, state->walls, state->model);
+    lap = odem_mprofile_lap(prof, ODEM_PHASE_BOUNDARY, lap);
+
+    /* check particles for collisions; histories need every pair evaluated
+     * once, from a list */
+    switch (state->broad_phase)
+    {
+        case ODEM_BROAD_PHASE_GRID:
+            pairs = state->pairs;
+            break;
+        case ODEM_BROAD_PHASE_VERLET:
+            pairs = state->neighbors->pairs;
+            break;
+        default:
+            pairs = state->contacts != NULL ? state->pairs : NULL;
+    }
+    candidates = pairs;
+    /* pairs of two sleeping particles are left out */
+    if (state->sleep != NULL) pairs = state->sleep->pairs;
+    if (pairs != NULL)
+    {
+        /* only the pairs of the classes due, they lead the list */
+        if (state->subcycle != NULL)
+        {
+            due_pairs = *pairs;
+            due_pairs.num_pairs = state->subcycle->num_pairs_from[
+                odem_subcycle_due(state->subcycle, state->substep)];
+            pairs = &due_pairs;
+        }
+        collisions = odem_mforce_pair_list(parts, state, pairs, delta_time);
+        pair_tests = pairs->num_pairs;
+    }
+    else
+    {
+        collisions = state->kernels->force_all_pairs(parts,
+            state->model->spring_constant);
+        /* every pair is evaluated once from each side */
+        pair_tests = (long)parts->num_particles * (parts->num_particles - 1);
+    }
+    /* sleeping particles feel the pairs they dropped */
+    if (state->sleep != NULL) odem_msleep_hold_forces(state->sleep, parts);
+    lap = odem_mprofile_lap(prof, ODEM_PHASE_PAIR_CONTACT, lap);
+    odem_mprofile_count(prof, ODEM_COUNTER_PAIR_TESTS, pair_tests);
+    odem_mprofile_count(prof, ODEM_COUNTER_CONTACTS, collisions);
+
+    /* ghosts follow the owned particles of a distributed run */
+    num_owned = parts->num_particles;
+    #ifdef ODEM_MPI
+        if (state->domain != NULL) num_owned = state->domain->num_owned;
+    #endif
+    if (state->stats_due && (state->subcycle == NULL ||
+        state->substep == state->subcycle->num_substeps))
+    {
+        odem_mstats_contacts(state->stats, parts, candidates, state->walls,
+            num_owned);
+        odem_mprofile_lap(prof, ODEM_PHASE_RECORD, lap);
+    }
 
-void odem_run_analysis(sqlite3 *db, struct odem_particle_node* const ppart_list,
-    const double bounds[], const int iters, const double delta_time,
-    const int verbose)
+    #ifdef ODEM_MPI
+        /* only owned particles are integrated and recorded */
+        if (state->domain != NULL)
+            parts->num_particles = state->domain->num_owned;
+    #endif
+
+    return collisions;
+}
+
+/**
+ * Advance a sub-cycled run by one time step with the euler scheme, mutator
+ *
+ * Every substep moves every particle, checks the walls and the pairs of the
+ * classes due, see odem_subcycle, and accelerates the particles of the
+ * classes due. At the end of the step every class is due and each particle
+ * is left with the mean force over its last step.
+ *
+ * @param parts Particle set
+ * @param state Broad phase state
+ * @param opts Analysis options
+ * @param bounds Array containing boundaries
+ * @param iteration Current iteration
+ * @param time Time at the start of the step
+ * @param delta_time Time of step
+ * @param prof Profile to charge the phases to
+ * @param removed Number of particles removed through outlets, incremented
+ * @return Number of particle pairs in contact at the end of the step
+ */
+static int odem_msubcycle_step(struct odem_particles* parts,
+    struct odem_broad_phase_state* state,
+    const struct odem_analysis_opts* opts, const double bounds[],
+    const int iteration, const double time, const double delta_time,
+    struct odem_profile* prof, long* removed)
+{
+    int s, collisions = 0;
+    double lap;
+    const struct odem_subcycle* sub = state->subcycle;
+    const double substep_time = delta_time / sub->num_substeps;
+
+    for (s = 1; s <= sub->num_substeps; s++)
+    {
+        lap = odem_wall_time();
+        state->kernels->move(parts, substep_time);
+        lap = odem_mprofile_lap(prof, ODEM_PHASE_INTEGRATE, lap);
+        if (s == 1)
+        {
+            *removed += odem_mmaintain_particles(parts, state, opts, bounds,
+                iteration);
+            odem_mprofile_lap(prof, ODEM_PHASE_BROAD_PHASE, lap);
+        }
+
+        state->substep = s;
+        collisions = odem_mcompute_forces(parts, state,
+            time + s * substep_time, substep_time, prof);
+        lap = odem_wall_time();
+        state->kernels->kick(parts, sub->level, odem_subcycle_due(sub, s),
+            substep_time, s < sub->num_substeps ? NULL : sub->keep);
+        odem_mprofile_lap(prof, ODEM_PHASE_INTEGRATE, lap);
+    }
+
+    return collisions;
+}
+
+/**
+ * Take a snapshot of the recorded particles and fields, mutator
+ *
+ * In a distributed run every rank must call this, the snapshot is gathered
+ * on rank 0.
+ *
+ * @param pipeline Recording pipeline, NULL on ranks other than 0
+ * @param parts Particle set
+ * @param state Broad phase state
+ * @param record Trajectory output controls
+ * @param time Time of step
+ * @return Snapshot to publish, NULL without a pipeline
+ */
+static struct odem_snapshot* odem_mtake_snapshot(
+    struct odem_pipeline* pipeline, const struct odem_particles* parts,
+    struct odem_broad_phase_state* state,
+    const struct odem_record_opts* record, const double time)
+{
+    struct odem_snapshot* snap = pipeline != NULL ?
+        odem_pipeline_acquire(pipeline) : NULL;
+
+    #ifdef ODEM_MPI
+        struct odem_snapshot* local;
+
+        if (state->domain != NULL)
+        {
+            local = odem_mdomain_snapshot(state->domain, parts->dof,
+                parts->num_particles, record->fields);
+            odem_mfill_snapshot(local, parts, record, NULL, time);
+            odem_mdomain_gather(state->domain, local, snap);
+            return snap;
+        }
+    #else
+        (void)state;
+    #endif
+
+    odem_mfill_snapshot(snap, parts, record, state->sleep, time);
+    return snap;
+}
+
+/**
+ * Reduce the motion of a time step into the statistics and finish its row,
+ * mutator
+ *
+ * In a distributed run every rank must call this, the rows of the ranks are
+ * combined on every rank.
+ *
+ * @param stats Statistics, the contacts of the time step reduced
+ * @param parts Particle set
+ * @param state Broad phase state
+ * @return Whether or not the rows are full, see odem_mstats_end
+ */
+static int odem_mfinish_stats(struct odem_stats* stats,
+    const struct odem_particles* parts, struct odem_broad_phase_state* state)
+{
+    double max_speed = odem_max_speed(parts);
+
+    #ifdef ODEM_MPI
+        double max_overlap;
+        double* row = odem_stats_row(stats, stats->num_rows);
+
+        /* the speed histogram spans the speeds of every rank */
+        if (state->domain != NULL)
+            max_speed = odem_domain_max(state->domain, max_speed);
+    #else
+        (void)state;
+    #endif
+
+    odem_mstats_motion(stats, parts, max_speed);
+
+    #ifdef ODEM_MPI
+        if (state->domain != NULL)
+        {
+            /* everything else is a sum */
+            max_overlap = odem_domain_max(state->domain,
+                row[ODEM_STAT_MAX_OVERLAP]);
+            odem_domain_sum_values(state->domain, row, stats->row_size);
+            row[ODEM_STAT_MAX_OVERLAP] = max_overlap;
+            row[ODEM_STAT_MAX_SPEED] = max_speed;
+        }
+    #endif
+
+    return odem_mstats_end(stats);
+}
+
+/**
+ * Record the finished rows of the statistics and clear them, mutator
+ *
+ * Snapshots still queued are written first, so the stats never run ahead
+ * of the motion.
+ *
+ * @param recorder Recorder of the results, NULL on ranks other than 0
+ * @param pipeline Recording pipeline, NULL if there is none
+ * @param stats Statistics
+ */
+static void odem_mflush_stats(struct odem_recorder* recorder,
+    struct odem_pipeline* pipeline, struct odem_stats* stats)
+{
+    if (recorder != NULL && stats->num_rows > 0)
+    {
+        if (pipeline != NULL) odem_pipeline_sync(pipeline);
+        odem_recorder_stats(recorder, stats);
+    }
+    stats->num_rows = 0;
+}
+
+/**
+ * Run an analysis and record the motion of every particle
+ *
+ * In a distributed run, see odem_analysis_opts, every rank runs the analysis
+ * on the particles it owns and rank 0 records them all.
+ *
+ * @param recorder Recorder of the results, NULL on ranks other than 0
+ * @param parts Particle set
+ * @param bounds Array containing boundaries
+ * @param iters Number of iterations
+ * @param delta_time Time of step
+ * @param opts Analysis options
+ */
+void odem_run_analysis(struct odem_recorder* recorder,
+    struct odem_particles* const parts, const double bounds[], const int iters,
+    const double delta_time, const struct odem_analysis_opts* opts)
 {
     printf("Starting analysis...\n");
 
     /* set up profile */
-    clock_t begin, end;
-    double time_spent;
-    begin = clock();
-
-    /* set up data structures */
-    /* TODO: fix this heuristic */
-    const double k = 10.0;
-
-    int i, j, particle_id, collisions;
-    double time = 0.0;
-    struct odem_particle_node *node_i, *node_j;
-    struct double_node* double_list;
-    double_list = alloc_double_node(ppart_list->ppart->velocity);
-    for (node_i = ppart_list->next; node_i != NULL; node_i = node_i->next)
-        double_push(&double_list, node_i->ppart->velocity);
-    struct double_node* curr_double_node;
-
-    #if ODEM_DOF == 2
-        double force_vec[ODEM_DOF] = {0.0, 0.0};
-        double accel_vec[ODEM_DOF] = {0.0, 0.0};
-    #elif ODEM_DOF == 3
-        double force_vec[ODEM_DOF] = {0.0, 0.0, 0.0};
-        double accel_vec[ODEM_DOF] = {0.0, 0.0, 0.0};
+    struct odem_profile* prof = odem_alloc_profile(opts->profile_steps);
+    double lap;
+
+    int i, collisions = 0;
+    long removed = 0;
+    const int num_particles = parts->num_particles;
+    int num_recorded = num_particles;
+    double time = opts->start.time;
+    struct odem_checkpoint_state checkpoint;
+    double max_radius;
+    struct odem_broad_phase_state state = { opts->broad_phase, NULL, NULL,
+        NULL, NULL, opts->contact_kernel, odem_select_kernels(parts->dof),
+        &opts->contact, opts->contacts, NULL, 0, 0.0, opts->sort_spread > 0,
+        opts->domain, NULL, 0, opts->sleep, NULL, 0 };
+    const struct odem_kernels* kernels = state.kernels;
+    struct odem_pipeline* pipeline;
+    struct odem_snapshot* snap;
+    const size_t row_bytes = odem_motion_row_bytes(parts->dof,
+        opts->record.fields);
+
+    /* set up broad phase, cells span the largest possible contact distance */
+    max_radius = odem_max_radius(parts);
+    #ifdef ODEM_MPI
+        if (state.domain != NULL)
+        {
+            max_radius = state.domain->max_radius;
+            num_recorded = state.domain->num_global;
+        }
     #endif
+    if (opts->broad_phase == ODEM_BROAD_PHASE_GRID)
+    {
+        #ifdef ODEM_MPI
+            /* each rank bins its slab into a range of the serial cells */
+            if (state.domain != NULL)
+                state.grid = odem_alloc_domain_grid(state.domain,
+                    num_particles);
+        #endif
+        if (state.grid == NULL)
+            state.grid = odem_alloc_grid(parts->dof, bounds,
+                2.0 * max_radius, num_particles);
+        state.pairs = odem_alloc_pair_list(num_particles);
+    }
+    else if (opts->broad_phase == ODEM_BROAD_PHASE_VERLET)
+        state.neighbors = odem_alloc_neighbor_list(parts->dof, bounds,
+            max_radius, opts->skin > 0 ? opts->skin : 0.5 * max_radius,
+            num_particles);
+
+    /* walls of the domain, then those of the scene; static walls are only
+     * checked near where the broad phase bins them */
+    state.walls = odem_alloc_walls(parts->dof, 2 * parts->dof +
+        (opts->walls != NULL ? opts->walls->num_walls : 0));
+    odem_mwalls_push_bounds(state.walls, bounds);
+    if (opts->walls != NULL) odem_mwalls_append(state.walls, opts->walls);
+    if (opts->broad_phase == ODEM_BROAD_PHASE_GRID)
+        odem_mwalls_cull(state.walls, state.grid, max_radius);
+    else if (opts->broad_phase == ODEM_BROAD_PHASE_VERLET)
+        /* binned at the last build, since then no particle moved more than
+         * half the skin */
+        odem_mwalls_cull(state.walls, state.neighbors->grid,
+            max_radius + 0.5 * state.neighbors->skin);
+
+    /* contact histories live for the whole run */
+    if (opts->contact.law != ODEM_CONTACT_SPRING && state.contacts == NULL)
+        state.contacts = odem_alloc_contact_store(parts->dof, num_particles);
+    if (opts->broad_phase == ODEM_BROAD_PHASE_ALL_PAIRS &&
+        state.contacts != NULL)
+    {
+        state.pairs = odem_alloc_pair_list(num_particles);
+        odem_mall_pairs(state.pairs, num_particles);
+    }
+    if (opts->broad_phase != ODEM_BROAD_PHASE_ALL_PAIRS ||
+        state.contacts != NULL)
+        state.pair_forces = odem_alloc_pair_forces(parts->dof,
+            num_particles);
+    if (opts->broad_phase == ODEM_BROAD_PHASE_ALL_PAIRS &&
+        state.contacts != NULL)
+        odem_mpair_forces_index(state.pair_forces, state.pairs,
+            num_particles);
+
+    /* sub-cycle only when the masses call for more than one class */
+    if (opts->step_classes > 1)
+    {
+        state.subcycle = odem_alloc_subcycle(parts, opts->step_classes);
+        if (state.subcycle->num_classes > 1)
+        {
+            if (state.contacts != NULL)
+                odem_msubcycle_renew_contacts(state.subcycle, parts,
+                    state.contacts);
+            printf("Sub-cycling %d time step classes, %d substeps per step."
+                "\n", state.subcycle->num_classes,
+                state.subcycle->num_substeps);
+        }
+        else
+        {
+            odem_dealloc_subcycle(state.subcycle);
+            state.subcycle = NULL;
+        }
+    }
+
+    if (state.sleep != NULL)
+    {
+        if (state.sleep->speed <= 0)
+            state.sleep->speed = 1e-4 * max_radius / delta_time;
+        printf("Particles sleep after %d steps below speed %g.\n",
+            state.sleep->steps, state.sleep->speed);
+    }
+
+    #ifdef _OPENMP
+        if (opts->num_threads > 0) omp_set_num_threads(opts->num_threads);
+    #endif
+
+    if (opts->stats_every > 0)
+        state.stats = odem_alloc_stats(parts->dof, opts->stats_every,
+            opts->stats_cells, bounds, opts->contact.spring_constant);
+
+    /* nothing to queue without motion output */
+    pipeline = recorder == NULL || opts->record.stride == 0 ? NULL :
+        odem_alloc_pipeline(recorder, parts->dof,
+        opts->record.particle_ids != NULL ? opts->record.num_particle_ids :
+        num_recorded, opts->record.fields, opts->queue_depth);
+
+    /* velocity verlet starts from the forces of the initial state, no time
+     * has passed for the contact histories */
+    if (opts->integrator == ODEM_INTEGRATOR_VELOCITY_VERLET)
+        odem_mcompute_forces(parts, &state, time, 0.0, prof);
 
     /* main analysis */
-    for (i = 0; i < iters; i++)
+    for (i = opts->start.iteration; i < iters; i++)
     {
-        /* move each particle for time step */
-        for (node_i = ppart_list; node_i != NULL; node_i = node_i->next)
-            odem_mmove_particle(node_i->ppart, delta_time);
+        state.stats_due = state.stats != NULL &&
+            (i + 1) % state.stats->stride == 0;
+        if (state.stats_due)
+            odem_mstats_begin(state.stats, time + delta_time);
 
-        /* check particles for boundary collisions */
-        for (node_i = ppart_list; node_i != NULL; node_i = node_i->next)
+        lap = odem_wall_time();
+        if (opts->integrator == ODEM_INTEGRATOR_VELOCITY_VERLET)
         {
-            if (odem_mforce_boundary_collision_spring(force_vec, node_i->ppart,
-                bounds, k))
-            {
-                collisions++;
-                /* accelerate particle */
-                for (j = 0; j < ODEM_DOF; j++)
-                    accel_vec[j] = force_vec[j]/node_i->ppart->mass;
-                odem_maccel_particle(node_i->ppart, delta_time, accel_vec);
-            }
+            /* half step velocity with the forces of the previous step */
+            kernels->accel(parts, 0.5 * delta_time);
+            kernels->move(parts, delta_time);
+            lap = odem_mprofile_lap(prof, ODEM_PHASE_INTEGRATE, lap);
+            removed += odem_mmaintain_particles(parts, &state, opts, bounds,
+                i);
+            odem_mprofile_lap(prof, ODEM_PHASE_BROAD_PHASE, lap);
+            collisions = odem_mcompute_forces(parts, &state,
+                time + delta_time, delta_time, prof);
+            lap = odem_wall_time();
+            kernels->accel(parts, 0.5 * delta_time);
+        }
+        else if (state.subcycle != NULL)
+        {
+            collisions = odem_msubcycle_step(parts, &state, opts, bounds, i,
+                time, delta_time, prof, &removed);
+            lap = odem_wall_time();
         }
+        else
+        {
+            /* move each particle for time step */
+            kernels->move(parts, delta_time);
+            lap = odem_mprofile_lap(prof, ODEM_PHASE_INTEGRATE, lap);
+            removed += odem_mmaintain_particles(parts, &state, opts, bounds,
+                i);
+            odem_mprofile_lap(prof, ODEM_PHASE_BROAD_PHASE, lap);
+            collisions = odem_mcompute_forces(parts, &state,
+                time + delta_time, delta_time, prof);
+            lap = odem_wall_time();
+            /* accelerate each particle by its net force */
+            kernels->accel(parts, delta_time);
+            if (state.sleep != NULL)
+                odem_msleep_settle(state.sleep, parts, state.pair_forces,
+                    state.broad_phase == ODEM_BROAD_PHASE_VERLET ?
+                    state.neighbors->pairs : state.pairs, delta_time);
+        }
+        lap = odem_mprofile_lap(prof, ODEM_PHASE_INTEGRATE, lap);
 
-        /* check particles for collisions */
-        collisions = 0;
-        for (node_i = ppart_list; node_i != NULL; node_i = node_i->next)
+        /* watch how far the pairs spread since particles were reordered */
+        if (opts->sort_spread > 0)
         {
-            for (node_j = node_i->next; node_j != NULL; node_j = node_j->next)
-            {
-                if (odem_mforce_collision_spring(force_vec, node_i->ppart,
-                    node_j->ppart, k))
-                    collisions++;
-
-                /* accelerate first particle */
-                for (j = 0; j < ODEM_DOF; j++)
-                    accel_vec[j] = force_vec[j]/node_i->ppart->mass;
-                odem_maccel_particle(node_i->ppart, delta_time, accel_vec);
-
-                /* accelerate second particle in opposite direction */
-                for (j = 0; j < ODEM_DOF; j++)
-                    accel_vec[j] = -force_vec[j]/node_j->ppart->mass;
-                odem_maccel_particle(node_j->ppart, delta_time, accel_vec);
-            }
+            odem_mmeasure_spread(&state, opts->sort_spread);
+            odem_mprofile_lap(prof, ODEM_PHASE_BROAD_PHASE, lap);
         }
 
         /* display info */
-        if(verbose) printf("\titer: %d, collisions: %d\n", i, collisions);
+        #ifdef ODEM_MPI
+            /* pairs near the edge of a slab are seen by two ranks */
+            if (state.domain != NULL && opts->verbose)
+                collisions = (int)odem_domain_sum(state.domain, collisions);
+        #endif
+        if(opts->verbose) printf("\titer: %d, collisions: %d\n", i, collisions);
 
         /* increment time */
         time += delta_time;
 
-        /* write data */
-        double acceleration[ODEM_DOF];
-        double force[ODEM_DOF];
-        for (particle_id = 1, node_i = ppart_list,
-                curr_double_node = double_list;
-            node_i != NULL && curr_double_node != NULL;
-            particle_id++, node_i = node_i->next,
-                curr_double_node = curr_double_node->next)
+        /* reduce statistics every stride steps, recorded once they fill up
+         */
+        if (state.stats_due)
         {
-            for (j = 0; j < ODEM_DOF; j++)
+            lap = odem_wall_time();
+            if (odem_mfinish_stats(state.stats, parts, &state))
+                odem_mflush_stats(recorder, pipeline, state.stats);
+            odem_mprofile_lap(prof, ODEM_PHASE_RECORD, lap);
+        }
+
+        /* write data every stride steps, blocks while the writer is behind */
+        if (opts->record.stride > 0 && (i + 1) % opts->record.stride == 0)
+        {
+            lap = odem_wall_time();
+            snap = odem_mtake_snapshot(pipeline, parts, &state, &opts->record,
+                time);
+            if (snap != NULL)
             {
-                acceleration[j] = curr_double_node->data[j] -
-                    node_i->ppart->velocity[j];
-                force[j] = node_i->ppart->mass * acceleration[j];
+                odem_mprofile_count(prof, ODEM_COUNTER_ROWS,
+                    snap->num_particles);
+                odem_mprofile_count(prof, ODEM_COUNTER_BYTES,
+                    (long)(snap->num_particles * row_bytes));
+                odem_mpipeline_publish(pipeline);
             }
-            odem_record_motion(db, time, particle_id, node_i->ppart,
-                acceleration, force);
+            odem_mprofile_lap(prof, ODEM_PHASE_RECORD, lap);
+        }
+
+        /* motion and stats up to the checkpoint are committed before it is
+         * saved, so the database never lags behind the last good
+         * checkpoint */
+        if (opts->checkpoint_every > 0 &&
+            (i + 1) % opts->checkpoint_every == 0)
+        {
+            lap = odem_wall_time();
+            if (pipeline != NULL) odem_pipeline_sync(pipeline);
+            if (state.stats != NULL)
+                odem_mflush_stats(recorder, NULL, state.stats);
+            checkpoint.iteration = i + 1;
+            checkpoint.time = time;
+            checkpoint.delta_time = delta_time;
+            odem_save_checkpoint(opts->checkpoint_file, parts, state.contacts,
+                state.sleep, &checkpoint);
+            odem_mprofile_lap(prof, ODEM_PHASE_CHECKPOINT, lap);
         }
+
+        odem_mprofile_end_step(prof);
     }
 
-    /* clean up data structures */
-    struct double_node* node_to_clean;
-    curr_double_node = double_list;
-    while (curr_double_node != NULL)
+    /* clean up data structures, flushing snapshots still queued */
+    lap = odem_wall_time();
+    if (pipeline != NULL)
     {
-        node_to_clean = curr_double_node;
-        curr_double_node = curr_double_node->next;
-        free(node_to_clean);
+        odem_dealloc_pipeline(pipeline);
+        odem_recorder_commit(recorder);
     }
+    if (state.stats != NULL)
+    {
+        odem_mflush_stats(recorder, NULL, state.stats);
+        odem_dealloc_stats(state.stats);
+    }
+    odem_mprofile_lap(prof, ODEM_PHASE_RECORD, lap);
+    odem_mprofile_finish(prof);
+    if (state.grid != NULL) odem_dealloc_grid(state.grid);
+    if (state.pairs != NULL) odem_dealloc_pair_list(state.pairs);
+    if (state.neighbors != NULL)
+    {
+        if (opts->verbose)
+            printf("Neighbour list built %d times.\n",
+                state.neighbors->num_builds);
+        odem_dealloc_neighbor_list(state.neighbors);
+    }
+    if (state.pair_forces != NULL) odem_dealloc_pair_forces(state.pair_forces);
+    if (state.subcycle != NULL) odem_dealloc_subcycle(state.subcycle);
+    if (state.sleep != NULL)
+        printf("%d of %d particles asleep at the end.\n",
+            state.sleep->num_asleep, parts->num_particles);
+    odem_dealloc_walls(state.walls);
+    if (state.contacts != NULL && state.contacts != opts->contacts)
+        odem_dealloc_contact_store(state.contacts);
+
+    #ifdef ODEM_MPI
+        if (state.domain != NULL)
+            removed = odem_domain_sum(state.domain, removed);
+    #endif
 
     /* display profile result */
-    end = clock();
-    time_spent = ((double)(end - begin)) / CLOCKS_PER_SEC;
-    printf("Analysis completed in %g seconds.\n", time_spent);
+    printf("Analysis completed in %g seconds.\n", prof->elapsed);
+    if (removed > 0)
+        printf("Removed %ld particles through outlets.\n", removed);
+    if (state.num_sorts > 0 && opts->verbose)
+        printf("Particles reordered %d times.\n", state.num_sorts);
+    odem_print_profile(prof);
+    if (opts->profile_steps && recorder != NULL)
+        odem_recorder_profile(recorder, prof, opts->start.iteration,
+            delta_time);
+    odem_dealloc_profile(prof);
 }
-
@@ -2,8 +2,124 @@
 
 #define __ANALYSIS_H 1
 
-void odem_run_analysis(sqlite3 *, struct odem_particle_node* const,
-    const double[], const int, const double, const int);
+#include "record.h"
+#include "recorder.h"
+#include "force.h"
+#include "contact.h"
+#include "wall.h"
+#include "checkpoint.h"
+#include "sleep.h"
 
-#endif  /* __ANALYSIS_H */
+/* domain decomposition of a distributed run, see domain.h */
+struct odem_domain;
+
+/**
+ * Broad phase contact detection strategy
+ *
+ * ODEM_BROAD_PHASE_ALL_PAIRS tests every pair of particles, O(N^2).
+ * ODEM_BROAD_PHASE_GRID only tests pairs in the same or neighbouring cells of
+ * a uniform grid.
+ * ODEM_BROAD_PHASE_VERLET tests pairs from a neighbour list built on the grid
+ * with a skin distance, rebuilt once a particle has moved half the skin.
+ */
+enum odem_broad_phase
+{
+    ODEM_BROAD_PHASE_ALL_PAIRS,
+    ODEM_BROAD_PHASE_GRID,
+    ODEM_BROAD_PHASE_VERLET
+};
+
+/**
+ * Time integration scheme
+ *
+ * ODEM_INTEGRATOR_EULER moves particles with the old velocity and then
+ * accelerates them by the new forces, first order accurate.
+ * ODEM_INTEGRATOR_VELOCITY_VERLET splits the velocity update into two half
+ * steps around the move, second order accurate.
+ */
+enum odem_integrator
+{
+    ODEM_INTEGRATOR_EULER,
+    ODEM_INTEGRATOR_VELOCITY_VERLET
+};
 
+/**
+ * Analysis options
+ *
+ * @member broad_phase Broad phase contact detection strategy
+ * @member contact_kernel Pair contact kernel
+ * @member skin Neighbour list skin distance, 0 for half the largest radius
+ * @member integrator Time integration scheme
+ * @member step_classes Largest number of time step classes particles are
+ *                      sub-cycled in by their mass, see odem_subcycle, 1
+ *                      for none; needs the grid or Verlet broad phase and
+ *                      the euler integrator
+ * @member sleep Sleep state of the particles, see odem_sleep, e.g. restored
+ *              from a checkpoint, NULL for particles that never sleep; a
+ *              sleep speed of 0 is set to a ten thousandth of the largest
+ *              radius per time step; needs the grid or Verlet broad phase
+ *              and the euler integrator
+ * @member contact Contact model, derived
+ * @member contacts Contact store of the laws with history, e.g. restored from
+ *                  a checkpoint, NULL to start without contacts
+ * @member walls Walls besides those of the boundaries, NULL for none
+ * @member outlets Boxes removing the particles that enter them, laid out like
+ *                 the boundaries, 2*ODEM_MAX_DOF values per box
+ * @member num_outlets Number of outlets
+ * @member sort_every Reorder particles along a space filling curve every this
+ *                    many iterations, 0 for never
+ * @member sort_spread Reorder particles once the mean index distance of the
+ *                     candidate pairs grows by this factor since the last
+ *                     reorder, 0 for never
+ * @member record Trajectory output controls, a stride of 0 records no
+ *               motion
+ * @member queue_depth Number of snapshots that may wait for the writer thread,
+ *                     0 to record on the solver thread
+ * @member num_threads Number of threads used for force computation and
+ *                     integration, 0 for the OpenMP default
+ * @member checkpoint_every Save a checkpoint every this many iterations, 0
+ *                          for none
+ * @member checkpoint_file Path of the checkpoint
+ * @member start Position in time to start the run from, e.g. a checkpoint
+ * @member profile_steps Whether or not to record the profile of every step
+ *                       in a profile table
+ * @member stats_every Reduce statistics every this many iterations into
+ *                     the stats tables, see odem_stats, 0 for none
+ * @member stats_cells Number of density cells along each dof
+ * @member verbose Whether or not to display info every iteration
+ * @member domain Domain decomposition of a distributed run, NULL for a serial
+ *                run; needs the grid broad phase and a build with ODEM_MPI
+ */
+struct odem_analysis_opts
+{
+    enum odem_broad_phase broad_phase;
+    enum odem_contact_kernel contact_kernel;
+    double skin;
+    enum odem_integrator integrator;
+    int step_classes;
+    struct odem_sleep* sleep;
+    struct odem_contact_model contact;
+    struct odem_contact_store* contacts;
+    const struct odem_walls* walls;
+    const double* outlets;
+    int num_outlets;
+    int sort_every;
+    double sort_spread;
+    struct odem_record_opts record;
+    int queue_depth;
+    int num_threads;
+    int checkpoint_every;
+    const char* checkpoint_file;
+    struct odem_checkpoint_state start;
+    int profile_steps;
+    int stats_every;
+    int stats_cells;
+    int verbose;
+    struct odem_domain* domain;
+};
+
+void odem_run_analysis(struct odem_recorder*, struct odem_particles* const,
+    const double[], const int, const double,
+    const struct odem_analysis_opts*);
+
+#endif  /* __ANALYSIS_H */
@@ -0,0 +1,558 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "debug.h"
+#include "particle.h"
+#include "grid.h"
+#include "force.h"
+#include "contact.h"
+#include "neighbor.h"
+#include "wall.h"
+#include "record.h"
+#include "recorder.h"
+#include "profile.h"
+
+/* benchmark constants */
+#define BENCH_PI 3.14159265358979323846
+#define BENCH_RADIUS 0.5
+#define BENCH_DENSITY 1.0
+#define BENCH_SPRING_CONSTANT 1000.0
+#define BENCH_SAFETY 0.1
+#define BENCH_MAX_SIZES 16
+
+/**
+ * Synthetic packings
+ *
+ * BENCH_GAS scatters particles over the domain at a low packing fraction
+ * with random velocities, few contacts.
+ * BENCH_BED stacks particles on a slightly compressed lattice at rest in the
+ * lower half of the domain, every particle touching its neighbours.
+ * BENCH_COLLAPSE packs particles in a disk, or a ball in 3D, in the middle of
+ * the domain moving towards its centre, contacts build up as it collapses.
+ */
+enum bench_scene
+{
+    BENCH_GAS,
+    BENCH_BED,
+    BENCH_COLLAPSE,
+    BENCH_NUM_SCENES
+};
+
+static const char* const bench_scene_name[BENCH_NUM_SCENES] =
+    { "gas", "bed", "collapse" };
+
+/**
+ * Benchmark options
+ *
+ * @member sizes Particle counts to run every scene at
+ * @member num_sizes Number of particle counts
+ * @member dof Degrees of freedom of the packings, 2 or 3
+ * @member scenes Bit mask of scenes to run
+ * @member steps Number of timed solver steps
+ * @member record_steps Number of timed recorded time steps
+ * @member broad_phase Broad phase used, "grid" or "verlet"
+ * @member contact_kernel Pair contact kernel
+ * @member law Contact law
+ * @member num_threads Number of solver threads, 0 for the OpenMP default
+ * @member db_file Results file recorded to, replaced on every run
+ * @member format Results format
+ * @member preset Database journal/sync preset
+ * @member bulk Whether or not the motion index is deferred to the end
+ */
+struct bench_opts
+{
+    int sizes[BENCH_MAX_SIZES];
+    int num_sizes;
+    int dof;
+    unsigned int scenes;
+    int steps;
+    int record_steps;
+    const char* broad_phase;
+    enum odem_contact_kernel contact_kernel;
+    enum odem_contact_law law;
+    int num_threads;
+    const char* db_file;
+    enum odem_recorder_format format;
+    enum odem_db_preset preset;
+    int bulk;
+};
+
+/*
+ * Print usage and exit
+ */
+static void usage(const char* prog)
+{
+    printf("Usage: %s [-n sizes] [-d 2|3] [-g gas|bed|collapse|all]"
+        " [-t steps] [-r steps] [-b grid|verlet] [-c scalar|batch]"
+        " [-l spring|dashpot|friction] [-j threads] [-D file]"
+        " [-o sqlite|frames] [-p safe|fast|scratch] [-B]\n"
+        "\t-n Comma separated particle counts, default 1e3,1e4,1e5\n"
+        "\t-d Degrees of freedom, default 2\n"
+        "\t-g Synthetic packing, default all\n"
+        "\t-t Timed solver steps, default 20\n"
+        "\t-r Timed recorded steps, default 5\n"
+        "\t-b Broad phase contact detection, default grid\n"
+        "\t-c Pair contact kernel, default batch\n"
+        "\t-l Contact law, default spring\n"
+        "\t-j Threads used by the solver, default all cores\n"
+        "\t-D Results file recorded to, default odem-bench.db\n"
+        "\t-o Results format, default sqlite\n"
+        "\t-p Database journal/sync preset, default safe\n"
+        "\t-B Bulk load, index motion once after the recorded steps\n"
+        "Results are written to stdout as csv, one row per phase.\n", prog);
+    exit(1);
+}
+
+/*
+ * Deterministic random number in [0, 1), xorshift64
+ */
+static double bench_random(unsigned long long* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (*state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Generate a synthetic packing
+ *
+ * @param scene Packing to generate
+ * @param dof Degrees of freedom, 2 or 3
+ * @param n Number of particles
+ * @param bounds Array to store the domain boundaries in
+ * @return Pointer to a new particle set
+ */
+static struct odem_particles* bench_alloc_scene(const enum bench_scene scene,
+    const int dof, const int n, double bounds[])
+{
+    int i, j, per_row;
+    double length, spacing, radius, mass, r;
+    double centroid[ODEM_MAX_DOF], velocity[ODEM_MAX_DOF];
+    unsigned long long state = 0x9e3779b97f4a7c15ULL + (unsigned)scene;
+    struct odem_particles* parts = odem_alloc_particles(dof, n);
+    /* volume of the unit ball in dof dimensions */
+    const double unit_ball = dof == 3 ? 4.0 / 3.0 * BENCH_PI : BENCH_PI;
+
+    switch (scene)
+    {
+        case BENCH_BED:
+            /* lattice compressed by 2% so neighbours overlap */
+            spacing = 2.0 * BENCH_RADIUS * 0.98;
+            per_row = (int)ceil(pow(n, 1.0 / dof));
+            length = per_row * spacing;
+            break;
+        case BENCH_COLLAPSE:
+            /* ball at half packing fraction, a quarter of the domain wide */
+            length = 8.0 * BENCH_RADIUS * pow(n / 0.5, 1.0 / dof);
+            break;
+        default:
+            /* gas at a tenth packing fraction */
+            length = BENCH_RADIUS * pow(n * unit_ball / 0.1, 1.0 / dof);
+    }
+    for (j = 0; j < dof; j++)
+    {
+        bounds[2*j] = 0.0;
+        bounds[2*j+1] = length;
+    }
+    /* the bed only fills the lower half of the domain */
+    if (scene == BENCH_BED) bounds[2*(dof-1)+1] = 2.0 * length;
+
+    for (i = 0; i < n; i++)
+    {
+        radius = BENCH_RADIUS * (0.9 + 0.2 * bench_random(&state));
+        mass = BENCH_DENSITY * unit_ball * pow(radius, dof);
+        switch (scene)
+        {
+            case BENCH_BED:
+                r = i;
+                for (j = 0; j < dof; j++)
+                {
+                    centroid[j] = spacing * (fmod(r, per_row) + 0.5);
+                    velocity[j] = 0.0;
+                    r = floor(r / per_row);
+                }
+                radius = BENCH_RADIUS;
+                mass = BENCH_DENSITY * unit_ball * pow(radius, dof);
+                break;
+            case BENCH_COLLAPSE:
+                /* uniform in a ball of diameter length/4, moving inwards,
+                 * drawn by rejection from the enclosing cube */
+                do
+                {
+                    r = 0.0;
+                    for (j = 0; j < dof; j++)
+                    {
+                        velocity[j] = 2.0 * bench_random(&state) - 1.0;
+                        r += velocity[j] * velocity[j];
+                    }
+                } while (r > 1.0);
+                for (j = 0; j < dof; j++)
+                {
+                    centroid[j] = 0.5 * length + 0.125 * length * velocity[j];
+                    velocity[j] = -(centroid[j] - 0.5 * length);
+                }
+                break;
+            default:
+                for (j = 0; j < dof; j++)
+                {
+                    centroid[j] = radius + (length - 2.0 * radius) *
+                        bench_random(&state);
+                    velocity[j] = 2.0 * bench_random(&state) - 1.0;
+                }
+        }
+        odem_mparticles_push(parts, mass, radius, centroid, velocity);
+    }
+
+    return parts;
+}
+
+/**
+ * Print one csv result row
+ */
+static void bench_report(const enum bench_scene scene, const int n,
+    const struct bench_opts* opts, const char* phase, const int steps,
+    const double seconds, const long pair_tests, const long rows)
+{
+    int threads = 1;
+    const double s = seconds > 0 ? seconds : 1e-12;
+
+    #ifdef _OPENMP
+        threads = omp_get_max_threads();
+    #endif
+
+    printf("%s,%d,%d,%d,%s,%s,%s,%s,%s,%d,%.6f,%.6g,%.6g,%.6g\n",
+        bench_scene_name[scene], opts->dof, n, threads, opts->broad_phase,
+        opts->contact_kernel == ODEM_CONTACT_KERNEL_BATCH ? "batch" : "scalar",
+        odem_contact_law_name(opts->law),
+        opts->format == ODEM_RECORDER_FRAMES ? "frames" : "sqlite", phase,
+        steps, seconds, steps / s, pair_tests / s, rows / s);
+    fflush(stdout);
+}
+
+/**
+ * Time the solver phases and the recording path on one packing
+ *
+ * @param scene Packing to run
+ * @param n Number of particles
+ * @param opts Benchmark options
+ */
+static void bench_run(const enum bench_scene scene, const int n,
+    const struct bench_opts* opts)
+{
+    int i, j, step, use_verlet, rebuilt;
+    double bounds[2*ODEM_MAX_DOF], max_radius, dt, lap, seconds;
+    struct odem_grid* grid = NULL;
+    struct odem_pair_list* pairs = NULL;
+    struct odem_neighbor_list* neighbors = NULL;
+    const struct odem_pair_list* contact_pairs;
+    struct odem_pair_forces* pair_forces;
+    struct odem_profile* prof;
+    struct odem_recorder* recorder;
+    struct odem_snapshot* snap;
+    struct odem_contact_model model;
+    struct odem_contact_store* contacts = NULL;
+    struct odem_walls* walls;
+
+    const struct odem_kernels* kernels = odem_select_kernels(opts->dof);
+
+    struct odem_particles* parts = bench_alloc_scene(scene, opts->dof, n,
+        bounds);
+
+    use_verlet = strcmp(opts->broad_phase, "verlet") == 0;
+    max_radius = odem_max_radius(parts);
+    dt = BENCH_SAFETY * odem_critical_time_step(parts, BENCH_SPRING_CONSTANT);
+    if (use_verlet)
+        neighbors = odem_alloc_neighbor_list(opts->dof, bounds, max_radius,
+            0.5 * max_radius, n);
+    else
+    {
+        grid = odem_alloc_grid(opts->dof, bounds, 2.0 * max_radius, n);
+        pairs = odem_alloc_pair_list(n);
+    }
+    pair_forces = odem_alloc_pair_forces(opts->dof, n);
+
+    walls = odem_alloc_walls(opts->dof, 2 * opts->dof);
+    odem_mwalls_push_bounds(walls, bounds);
+    if (use_verlet)
+        odem_mwalls_cull(walls, neighbors->grid,
+            max_radius + 0.5 * neighbors->skin);
+    else
+        odem_mwalls_cull(walls, grid, max_radius);
+
+    odem_init_contact_model(&model);
+    model.law = opts->law;
+    model.spring_constant = BENCH_SPRING_CONSTANT;
+    odem_mcontact_model_derive(&model);
+    if (model.law != ODEM_CONTACT_SPRING)
+        contacts = odem_alloc_contact_store(opts->dof, n);
+
+    /* solver, one untimed step to warm up caches and grow the pair lists */
+    prof = odem_alloc_profile(0);
+    for (step = -1; step < opts->steps; step++)
+    {
+        lap = odem_wall_time();
+        kernels->move(parts, dt);
+        lap = odem_mprofile_lap(prof, ODEM_PHASE_INTEGRATE, lap);
+
+        if (use_verlet)
+        {
+            rebuilt = odem_mneighbor_list_update(neighbors, parts);
+            contact_pairs = neighbors->pairs;
+        }
+        else
+        {
+            odem_mgrid_bin(grid, parts);
+            odem_mgrid_pairs(pairs, grid);
+            rebuilt = 1;
+            contact_pairs = pairs;
+        }
+        if (rebuilt) odem_mpair_forces_index(pair_forces, contact_pairs, n);
+        lap = odem_mprofile_lap(prof, ODEM_PHASE_BROAD_PHASE, lap);
+
+        odem_mzero_forces(parts);
+        kernels->force_walls(parts, walls, &model);
+        lap = odem_mprofile_lap(prof, ODEM_PHASE_BOUNDARY, lap);
+
+        odem_mprofile_count(prof, ODEM_COUNTER_CONTACTS, contacts != NULL ?
+            kernels->force_pairs_history(parts, pair_forces, contact_pairs,
+            &model, contacts, dt) :
+            kernels->force_pairs(parts, pair_forces, contact_pairs,
+            BENCH_SPRING_CONSTANT, opts->contact_kernel));
+        odem_mprofile_count(prof, ODEM_COUNTER_PAIR_TESTS,
+            contact_pairs->num_pairs);
+        lap = odem_mprofile_lap(prof, ODEM_PHASE_PAIR_CONTACT, lap);
+
+        kernels->accel(parts, dt);
+        odem_mprofile_lap(prof, ODEM_PHASE_INTEGRATE, lap);
+
+        /* throw the warm up step away */
+        if (step < 0)
+        {
+            odem_dealloc_profile(prof);
+            prof = odem_alloc_profile(0);
+            continue;
+        }
+        odem_mprofile_end_step(prof);
+    }
+    odem_mprofile_finish(prof);
+
+    seconds = 0.0;
+    for (i = 0; i < ODEM_NUM_PHASES; i++)
+        seconds += prof->total.phase_time[i];
+    bench_report(scene, n, opts, "step", opts->steps, seconds,
+        prof->total.counters[ODEM_COUNTER_PAIR_TESTS], 0);
+    bench_report(scene, n, opts, "integrate", opts->steps,
+        prof->total.phase_time[ODEM_PHASE_INTEGRATE], 0, 0);
+    bench_report(scene, n, opts, "boundary", opts->steps,
+        prof->total.phase_time[ODEM_PHASE_BOUNDARY], 0, 0);
+    bench_report(scene, n, opts, "broad_phase", opts->steps,
+        prof->total.phase_time[ODEM_PHASE_BROAD_PHASE],
+        prof->total.counters[ODEM_COUNTER_PAIR_TESTS], 0);
+    bench_report(scene, n, opts, "contact", opts->steps,
+        prof->total.phase_time[ODEM_PHASE_PAIR_CONTACT],
+        prof->total.counters[ODEM_COUNTER_PAIR_TESTS], 0);
+    odem_dealloc_profile(prof);
+
+    /* recording path, every field of every particle on the solver thread */
+    if (opts->record_steps > 0)
+    {
+        unlink(opts->db_file);
+        if (opts->format == ODEM_RECORDER_FRAMES)
+            recorder = odem_alloc_frame_recorder(opts->db_file, opts->dof,
+                ODEM_ALL_FIELDS, 0);
+        else
+            recorder = odem_alloc_db_recorder(opts->db_file, opts->preset,
+                opts->dof, ODEM_ALL_FIELDS, 1, opts->bulk);
+        odem_recorder_init(recorder);
+        odem_recorder_particle_data(recorder, parts);
+
+        snap = odem_alloc_snapshot(opts->dof, n, ODEM_ALL_FIELDS);
+        lap = odem_wall_time();
+        for (step = 0; step < opts->record_steps; step++)
+        {
+            snap->time = (step + 1) * dt;
+            snap->num_particles = n;
+            for (i = 0; i < n; i++)
+            {
+                snap->particle_id[i] = i + 1;
+                for (j = 0; j < opts->dof; j++)
+                {
+                    snap->data[ODEM_FIELD_POSITION][j][i] =
+                        parts->centroid[j][i];
+                    snap->data[ODEM_FIELD_VELOCITY][j][i] =
+                        parts->velocity[j][i];
+                    snap->data[ODEM_FIELD_ACCELERATION][j][i] =
+                        parts->force[j][i] / parts->mass[i];
+                    snap->data[ODEM_FIELD_FORCE][j][i] = parts->force[j][i];
+                }
+            }
+            odem_recorder_motion(recorder, snap);
+        }
+        odem_dealloc_recorder(recorder);
+        seconds = odem_wall_time() - lap;
+        bench_report(scene, n, opts, "record", opts->record_steps, seconds, 0,
+            (long)n * opts->record_steps);
+
+        odem_dealloc_snapshot(snap);
+        unlink(opts->db_file);
+    }
+
+    if (grid != NULL) odem_dealloc_grid(grid);
+    if (pairs != NULL) odem_dealloc_pair_list(pairs);
+    if (neighbors != NULL) odem_dealloc_neighbor_list(neighbors);
+    if (contacts != NULL) odem_dealloc_contact_store(contacts);
+    odem_dealloc_pair_forces(pair_forces);
+    odem_dealloc_walls(walls);
+    odem_dealloc_particles(parts);
+}
+
+/*
+ * Parse a comma separated list of particle counts such as "1e3,1e4"
+ */
+static void parse_sizes(struct bench_opts* opts, const char* list,
+    const char* prog)
+{
+    char* end;
+    double n;
+
+    opts->num_sizes = 0;
+    while (*list != '\0')
+    {
+        n = strtod(list, &end);
+        if (end == list || n < 1 || n > 1e9 ||
+            opts->num_sizes == BENCH_MAX_SIZES)
+            usage(prog);
+        opts->sizes[opts->num_sizes++] = (int)n;
+        if (*end != ',' && *end != '\0') usage(prog);
+        list = *end == ',' ? end + 1 : end;
+    }
+    if (opts->num_sizes == 0) usage(prog);
+}
+
+/*
+ * Main function
+ */
+int main(int argc, char* argv[])
+{
+    struct bench_opts opts;
+    int opt, i, s;
+
+    opts.sizes[0] = 1000;
+    opts.sizes[1] = 10000;
+    opts.sizes[2] = 100000;
+    opts.num_sizes = 3;
+    opts.dof = 2;
+    opts.scenes = (1u << BENCH_NUM_SCENES) - 1;
+    opts.steps = 20;
+    opts.record_steps = 5;
+    opts.broad_phase = "grid";
+    opts.contact_kernel = ODEM_CONTACT_KERNEL_BATCH;
+    opts.law = ODEM_CONTACT_SPRING;
+    opts.num_threads = 0;
+    opts.db_file = "odem-bench.db";
+    opts.format = ODEM_RECORDER_SQLITE;
+    opts.preset = ODEM_DB_SAFE;
+    opts.bulk = 0;
+
+    while ((opt = getopt(argc, argv, "n:d:g:t:r:b:c:l:j:D:o:p:B")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+                parse_sizes(&opts, optarg, argv[0]);
+                break;
+            case 'd':
+                opts.dof = atoi(optarg);
+                if (opts.dof != 2 && opts.dof != 3) usage(argv[0]);
+                break;
+            case 'g':
+                if (strcmp(optarg, "all") == 0)
+                    opts.scenes = (1u << BENCH_NUM_SCENES) - 1;
+                else
+                {
+                    for (s = 0; s < BENCH_NUM_SCENES; s++)
+                        if (strcmp(optarg, bench_scene_name[s]) == 0) break;
+                    if (s == BENCH_NUM_SCENES) usage(argv[0]);
+                    opts.scenes = 1u << s;
+                }
+                break;
+            case 't':
+                opts.steps = atoi(optarg);
+                if (opts.steps < 1) usage(argv[0]);
+                break;
+            case 'r':
+                opts.record_steps = atoi(optarg);
+                if (opts.record_steps < 0) usage(argv[0]);
+                break;
+            case 'b':
+                if (strcmp(optarg, "grid") != 0 && strcmp(optarg, "verlet") != 0)
+                    usage(argv[0]);
+                opts.broad_phase = optarg;
+                break;
+            case 'c':
+                if (strcmp(optarg, "scalar") == 0)
+                    opts.contact_kernel = ODEM_CONTACT_KERNEL_SCALAR;
+                else if (strcmp(optarg, "batch") == 0)
+                    opts.contact_kernel = ODEM_CONTACT_KERNEL_BATCH;
+                else
+                    usage(argv[0]);
+                break;
+            case 'l':
+                if (!odem_parse_contact_law(optarg, &opts.law))
+                    usage(argv[0]);
+                break;
+            case 'j':
+                opts.num_threads = atoi(optarg);
+                if (opts.num_threads < 1) usage(argv[0]);
+                break;
+            case 'D':
+                opts.db_file = optarg;
+                break;
+            case 'o':
+                if (strcmp(optarg, "sqlite") == 0)
+                    opts.format = ODEM_RECORDER_SQLITE;
+                else if (strcmp(optarg, "frames") == 0)
+                    opts.format = ODEM_RECORDER_FRAMES;
+                else
+                    usage(argv[0]);
+                break;
+            case 'B':
+                opts.bulk = 1;
+                break;
+            case 'p':
+                if (strcmp(optarg, "safe") == 0)
+                    opts.preset = ODEM_DB_SAFE;
+                else if (strcmp(optarg, "fast") == 0)
+                    opts.preset = ODEM_DB_FAST;
+                else if (strcmp(optarg, "scratch") == 0)
+                    opts.preset = ODEM_DB_SCRATCH;
+                else
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    #ifdef _OPENMP
+        if (opts.num_threads > 0) omp_set_num_threads(opts.num_threads);
+    #endif
+
+    printf("scene,dof,n,threads,broad_phase,kernel,law,format,phase,steps,"
+        "seconds,steps_per_s,pair_tests_per_s,rows_per_s\n");
+    for (s = 0; s < BENCH_NUM_SCENES; s++)
+    {
+        if (!(opts.scenes & (1u << s))) continue;
+        for (i = 0; i < opts.num_sizes; i++)
+            bench_run((enum bench_scene)s, opts.sizes[i], &opts);
+    }
+
+    return 0;
+}
@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "debug.h"
+#include "checkpoint.h"
+
+/* first bytes of a checkpoint */
+static const char odem_checkpoint_magic[8] = { 'O', 'D', 'E', 'M', 'C', 'K',
+    'P', '\0' };
+
+#define ODEM_CHECKPOINT_BYTE_ORDER 0x01020304u
+#define ODEM_CHECKPOINT_VERSION 1u
+
+/* number of particle columns in a checkpoint, besides the id column */
+#define ODEM_CHECKPOINT_COLUMNS(dof) (2 + 4*(dof))
+
+/* number of sleep columns, quiet steps and asleep plus twice recorded as
+ * 32 bit integers, then the held and rest forces */
+#define ODEM_CHECKPOINT_SLEEP_COLUMNS(dof) (2 + 2*(dof))
+
+/* number of contact columns, key, gamma and tangential spring */
+#define ODEM_CHECKPOINT_CONTACT_COLUMNS(dof) (2 + (dof))
+
+/**
+ * Header of a checkpoint
+ *
+ * The header is one alignment unit long and every column starts on an
+ * alignment boundary, so the columns of a mapped checkpoint are as aligned
+ * as the particle storage they are copied into. The particle ids follow
+ * the other particle columns in a column of the same length, and the sleep
+ * state of the particles may follow in sleep_columns columns, see
+ * ODEM_CHECKPOINT_SLEEP_COLUMNS. The contacts of the last step come last.
+ */
+struct odem_checkpoint_header
+{
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    int32_t dof;
+    int32_t num_particles;
+    int32_t iteration;
+    int32_t num_contacts;
+    double time;
+    double delta_time;
+    uint64_t column_bytes;
+    int32_t next_id;
+    int32_t sleep_columns;
+};
+
+/**
+ * Collect the particle columns saved in a checkpoint
+ *
+ * @param parts Particle set
+ * @param columns Array to store the column pointers in
+ */
+static void odem_checkpoint_columns(const struct odem_particles* parts,
+    double* columns[])
+{
+    int i, c = 0;
+
+    columns[c++] = parts->mass;
+    columns[c++] = parts->radius;
+    for (i = 0; i < parts->dof; i++)
+        columns[c++] = parts->centroid[i];
+    for (i = 0; i < parts->dof; i++)
+        columns[c++] = parts->velocity[i];
+    for (i = 0; i < parts->dof; i++)
+        columns[c++] = parts->force[i];
+    for (i = 0; i < parts->dof; i++)
+        columns[c++] = parts->ref_centroid[i];
+}
+
+/**
+ * Length of a checkpoint column padded to the alignment
+ *
+ * @param count Number of values in the column
+ * @return Padded column length in bytes
+ */
+static uint64_t odem_checkpoint_column_bytes(const int count)
+{
+    const uint64_t data_bytes = (uint64_t)count * sizeof(double);
+    return (data_bytes + ODEM_ALIGNMENT - 1) / ODEM_ALIGNMENT * ODEM_ALIGNMENT;
+}
+
+/**
+ * Write a whole buffer to a file descriptor
+ *
+ * @param fd File descriptor
+ * @param data Buffer
+ * @param size Number of bytes to write
+ * @return Whether or not every byte was written
+ */
+static int odem_write_all(const int fd, const void* data, size_t size)
+{
+    ssize_t written;
+    const char* bytes = (const char*)data;
+
+    while (size > 0)
+    {
+        written = write(fd, bytes, size);
+        if (written < 0) return 0;
+        bytes += written;
+        size -= (size_t)written;
+    }
+
+    return 1;
+}
+
+/**
+ * Write a run of zero bytes to a file descriptor, e.g. column padding
+ *
+ * @param fd File descriptor
+ * @param size Number of bytes to write
+ * @return Whether or not every byte was written
+ */
+static int odem_write_zeros(const int fd, size_t size)
+{
+    static const char zeros[ODEM_ALIGNMENT] = { 0 };
+    const size_t chunk = sizeof(zeros);
+
+    for (; size > chunk; size -= chunk)
+        if (!odem_write_all(fd, zeros, chunk)) return 0;
+
+    return odem_write_all(fd, zeros, size);
+}
+
+/**
+ * Save the solver state to a checkpoint
+ *
+ * The checkpoint is written and synced under a temporary name and renamed
+ * over the previous one, so a crash while saving leaves the last good
+ * checkpoint in place.
+ *
+ * @param path Path of the checkpoint
+ * @param parts Particle set
+ * @param contacts Contact store, NULL for none
+ * @param sleep Sleep state, NULL for none
+ * @param state Position of the run in time
+ */
+void odem_save_checkpoint(const char* path, const struct odem_particles* parts,
+    const struct odem_contact_store* contacts, const struct odem_sleep* sleep,
+    const struct odem_checkpoint_state* state)
+{
+    int i, j, c, id, fd, ok, num_contacts;
+    char* tmp_path;
+    double* columns[ODEM_CHECKPOINT_COLUMNS(ODEM_MAX_DOF)];
+    void* contact_columns[ODEM_CHECKPOINT_CONTACT_COLUMNS(ODEM_MAX_DOF)];
+    struct odem_checkpoint_header header;
+    const size_t data_bytes = (size_t)parts->num_particles * sizeof(double);
+    size_t contact_bytes, id_bytes;
+    uint64_t* keys = NULL;
+    double* values = NULL;
+    int32_t* sleep_values = NULL;
+    double* sleep_forces = NULL;
+
+    /* contacts of the last step, as columns */
+    num_contacts = contacts != NULL ? odem_contact_store_live(contacts) : 0;
+    contact_bytes = (size_t)num_contacts * sizeof(double);
+    if (num_contacts > 0)
+    {
+        keys = (uint64_t*)malloc(num_contacts * sizeof(uint64_t));
+        values = (double*)malloc(num_contacts * (1 + parts->dof) *
+            sizeof(double));
+        if (keys == NULL || values == NULL) die("Memory allocation error");
+        for (i = 0, c = 0; i < contacts->capacity; i++)
+        {
+            const struct odem_contact* contact = contacts->slots + i;
+            if (contact->key == ODEM_CONTACT_EMPTY ||
+                contact->step < contacts->step)
+                continue;
+            keys[c] = contact->key;
+            values[c] = contact->gamma;
+            for (j = 0; j < parts->dof; j++)
+                values[(1 + j) * num_contacts + c] = contact->spring[j];
+            c++;
+        }
+        contact_columns[0] = keys;
+        for (j = 0; j <= parts->dof; j++)
+            contact_columns[1 + j] = values + j * num_contacts;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, odem_checkpoint_magic, sizeof(odem_checkpoint_magic));
+    header.byte_order = ODEM_CHECKPOINT_BYTE_ORDER;
+    header.version = ODEM_CHECKPOINT_VERSION;
+    header.dof = parts->dof;
+    header.num_particles = parts->num_particles;
+    header.iteration = state->iteration;
+    header.num_contacts = num_contacts;
+    header.time = state->time;
+    header.delta_time = state->delta_time;
+    header.column_bytes = odem_checkpoint_column_bytes(parts->num_particles);
+    header.next_id = parts->next_id;
+    header.sleep_columns = sleep != NULL ?
+        ODEM_CHECKPOINT_SLEEP_COLUMNS(parts->dof) : 0;
+
+    /* sleep state in index order, as columns */
+    if (sleep != NULL)
+    {
+        sleep_values = (int32_t*)malloc((parts->num_particles + 1) * 2 *
+            sizeof(int32_t));
+        sleep_forces = (double*)malloc((parts->num_particles + 1) * 2 *
+            parts->dof * sizeof(double));
+        if (sleep_values == NULL || sleep_forces == NULL)
+            die("Memory allocation error");
+        for (i = 0; i < parts->num_particles; i++)
+        {
+            id = parts->id[i];
+            sleep_values[i] = sleep->quiet[id];
+            sleep_values[parts->num_particles + i] = sleep->asleep[id] +
+                2 * sleep->recorded[id];
+            for (j = 0; j < parts->dof; j++)
+            {
+                sleep_forces[j * parts->num_particles + i] =
+                    sleep->hold[j][id];
+                sleep_forces[(parts->dof + j) * parts->num_particles + i] =
+                    sleep->rest[j][id];
+            }
+        }
+    }
+
+    tmp_path = (char*)malloc(strlen(path) + 5);
+    if (tmp_path == NULL) die("Memory allocation error");
+    sprintf(tmp_path, "%s.tmp", path);
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) die("Could not open checkpoint file");
+
+    odem_checkpoint_columns(parts, columns);
+    ok = odem_write_all(fd, &header, sizeof(header));
+    for (i = 0; i < ODEM_CHECKPOINT_COLUMNS(parts->dof) && ok; i++)
+        ok = odem_write_all(fd, columns[i], data_bytes) &&
+            odem_write_zeros(fd, header.column_bytes - data_bytes);
+    id_bytes = (size_t)parts->num_particles * sizeof(int32_t);
+    ok = ok && odem_write_all(fd, parts->id, id_bytes) &&
+        odem_write_zeros(fd, header.column_bytes - id_bytes);
+    for (i = 0; i < 2 && sleep != NULL && ok; i++)
+        ok = odem_write_all(fd, sleep_values + i * parts->num_particles,
+            id_bytes) && odem_write_zeros(fd, header.column_bytes - id_bytes);
+    for (i = 0; i < 2 * parts->dof && sleep != NULL && ok; i++)
+        ok = odem_write_all(fd, sleep_forces + i * parts->num_particles,
+            data_bytes) && odem_write_zeros(fd,
+            header.column_bytes - data_bytes);
+    for (i = 0; i < ODEM_CHECKPOINT_CONTACT_COLUMNS(parts->dof) &&
+        num_contacts > 0 && ok; i++)
+        ok = odem_write_all(fd, contact_columns[i], contact_bytes) &&
+            odem_write_zeros(fd, odem_checkpoint_column_bytes(
+            num_contacts) - contact_bytes);
+    ok = ok && fsync(fd) == 0;
+    if (close(fd) != 0 || !ok) die("Could not write checkpoint file");
+    free(keys);
+    free(values);
+    free(sleep_values);
+    free(sleep_forces);
+
+    if (rename(tmp_path, path) != 0) die("Could not replace checkpoint file");
+    free(tmp_path);
+}
+
+/**
+ * Restore the solver state from a checkpoint, mutator
+ *
+ * The checkpoint is mapped and its columns copied straight into the particle
+ * storage. Its contacts are inserted into the contact store as contacts of
+ * the current step, so they carry on at the next step. Particles of a
+ * checkpoint without a sleep state are awake.
+ *
+ * @param path Path of the checkpoint
+ * @param parts Particle set to overwrite, grown to fit the checkpoint
+ * @param contacts Empty contact store to fill, NULL to drop the contacts
+ * @param sleep Sleep state of every particle awake to fill, NULL to drop
+ *              the sleep state
+ * @param state Position of the run in time to fill
+ */
+void odem_load_checkpoint(const char* path, struct odem_particles* parts,
+    struct odem_contact_store* contacts, struct odem_sleep* sleep,
+    struct odem_checkpoint_state* state)
+{
+    int i, j, c, id, fd, num_contacts, sleep_columns;
+    void* map;
+    struct stat st;
+    const struct odem_checkpoint_header* header;
+    double* columns[ODEM_CHECKPOINT_COLUMNS(ODEM_MAX_DOF)];
+    const char* contact_data;
+    const uint64_t* keys;
+    const double* values;
+    const int32_t *sleep_values, *sleep_flags;
+    const double* sleep_forces;
+    size_t data_bytes, contact_column_bytes;
+    int num_columns;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) die("Could not open checkpoint file");
+    if (fstat(fd, &st) != 0) die("Could not read checkpoint file");
+    errno = 0;
+    if ((size_t)st.st_size < sizeof(struct odem_checkpoint_header))
+        die("Truncated checkpoint file.");
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) die("Could not map checkpoint file");
+    close(fd);
+
+    header = (const struct odem_checkpoint_header*)map;
+    errno = 0;
+    if (memcmp(header->magic, odem_checkpoint_magic,
+        sizeof(odem_checkpoint_magic)) != 0)
+        die("Not a checkpoint file.");
+    if (header->byte_order != ODEM_CHECKPOINT_BYTE_ORDER)
+        die("Checkpoint was written with another byte order.");
+    if (header->version != ODEM_CHECKPOINT_VERSION)
+        die("Unsupported checkpoint version.");
+    if (header->dof != parts->dof)
+        die("Checkpoint dof does not match the scene.");
+    if (header->num_particles < 0)
+        die("Invalid checkpoint particle count.");
+    num_contacts = header->num_contacts;
+    if (num_contacts < 0) die("Invalid checkpoint contact count.");
+    data_bytes = (size_t)header->num_particles * sizeof(double);
+    sleep_columns = header->sleep_columns;
+    if (sleep_columns != 0 &&
+        sleep_columns != ODEM_CHECKPOINT_SLEEP_COLUMNS(parts->dof))
+        die("Invalid checkpoint sleep column count.");
+    num_columns = ODEM_CHECKPOINT_COLUMNS(parts->dof) + 1 + sleep_columns;
+    contact_column_bytes = num_contacts > 0 ?
+        odem_checkpoint_column_bytes(num_contacts) : 0;
+    if (header->column_bytes < data_bytes || (size_t)st.st_size <
+        sizeof(*header) + num_columns * header->column_bytes +
+        ODEM_CHECKPOINT_CONTACT_COLUMNS(parts->dof) * contact_column_bytes)
+        die("Truncated checkpoint file.");
+
+    odem_mparticles_reserve(parts, header->num_particles);
+    odem_checkpoint_columns(parts, columns);
+    for (i = 0; i < ODEM_CHECKPOINT_COLUMNS(parts->dof); i++)
+        memcpy(columns[i], (const char*)map + sizeof(*header) +
+            i * header->column_bytes, data_bytes);
+    parts->num_particles = header->num_particles;
+    memcpy(parts->id, (const char*)map + sizeof(*header) +
+        ODEM_CHECKPOINT_COLUMNS(parts->dof) * header->column_bytes,
+        (size_t)header->num_particles * sizeof(int32_t));
+    parts->next_id = header->next_id;
+
+    if (sleep != NULL && sleep_columns > 0)
+    {
+        if (parts->next_id > sleep->capacity)
+            die("Checkpoint does not match the scene.");
+        sleep_values = (const int32_t*)((const char*)map + sizeof(*header) +
+            (ODEM_CHECKPOINT_COLUMNS(parts->dof) + 1) * header->column_bytes);
+        sleep_flags = sleep_values + header->column_bytes / sizeof(int32_t);
+        sleep_forces = (const double*)(sleep_flags + header->column_bytes /
+            sizeof(int32_t));
+        for (i = 0; i < parts->num_particles; i++)
+        {
+            id = parts->id[i];
+            sleep->quiet[id] = sleep_values[i];
+            sleep->asleep[id] = (char)(sleep_flags[i] & 1);
+            sleep->recorded[id] = (char)(sleep_flags[i] >> 1);
+            sleep->num_asleep += sleep->asleep[id];
+            for (j = 0; j < parts->dof; j++)
+            {
+                sleep->hold[j][id] = sleep_forces[j *
+                    header->column_bytes / sizeof(double) + i];
+                sleep->rest[j][id] = sleep_forces[(parts->dof + j) *
+                    header->column_bytes / sizeof(double) + i];
+            }
+        }
+        sleep->changed = 1;
+    }
+
+    if (contacts != NULL && num_contacts > 0)
+    {
+        contact_data = (const char*)map + sizeof(*header) +
+            num_columns * header->column_bytes;
+        keys = (const uint64_t*)contact_data;
+        values = (const double*)(contact_data + contact_column_bytes);
+        odem_mcontact_store_reserve(contacts, num_contacts);
+        for (c = 0; c < num_contacts; c++)
+        {
+            i = odem_mcontact_insert(contacts, keys[c], values[c]);
+            for (j = 0; j < parts->dof; j++)
+                contacts->slots[i].spring[j] = values[(1 + j) *
+                    contact_column_bytes / sizeof(double) + c];
+        }
+    }
+
+    state->iteration = header->iteration;
+    state->time = header->time;
+    state->delta_time = header->delta_time;
+
+    munmap(map, (size_t)st.st_size);
+}
@@ -0,0 +1,34 @@
+#ifndef __CHECKPOINT_H
+
+#define __CHECKPOINT_H 1
+
+#include "particle.h"
+#include "contact.h"
+#include "sleep.h"
+
+// data structures
+
+/**
+ * Position of a run in time, saved alongside the particles
+ *
+ * @member iteration Number of completed iterations
+ * @member time Simulated time after the completed iterations
+ * @member delta_time Size of time step
+ */
+struct odem_checkpoint_state
+{
+    int iteration;
+    double time;
+    double delta_time;
+};
+
+
+// function interfaces
+void odem_save_checkpoint(const char*, const struct odem_particles*,
+    const struct odem_contact_store*, const struct odem_sleep*,
+    const struct odem_checkpoint_state*);
+void odem_load_checkpoint(const char*, struct odem_particles*,
+    struct odem_contact_store*, struct odem_sleep*,
+    struct odem_checkpoint_state*);
+
+#endif  /* __CHECKPOINT_H */
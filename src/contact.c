@@ -0,0 +1,337 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "debug.h"
+#include "contact.h"
+
+#define ODEM_PI 3.14159265358979323846
+
+/* smallest number of slots of a contact store */
+#define ODEM_CONTACT_MIN_SLOTS 64
+
+static const char* const odem_contact_law_names[] =
+    { "spring", "dashpot", "friction" };
+
+/**
+ * Set contact model parameters to their defaults, a spring
+ *
+ * odem_mcontact_model_derive must be called once the parameters are final.
+ *
+ * @param model Contact model to initialize
+ */
+void odem_init_contact_model(struct odem_contact_model* model)
+{
+    model->law = ODEM_CONTACT_SPRING;
+    /* TODO: fix this heuristic */
+    model->spring_constant = 10.0;
+    model->restitution = 0.5;
+    model->tangential_constant = 0.0;
+    model->mu_stick = 0.5;
+    model->mu_glide = 0.4;
+    model->mu_limit = 0.3;
+    model->v_glide = 0.1;
+    model->v_limit = 1.0;
+    model->slope_limit = 1.0;
+}
+
+/**
+ * Compute the derived members of a contact model from its parameters,
+ * mutator
+ *
+ * The dashpot coefficient of a pair is gamma = -2*m_12*ln(eta) / t_coll with
+ * t_coll = sqrt(pi^2 + ln(eta)^2) * sqrt(m_12/k), which is the pair
+ * independent damping times sqrt(m_12).
+ *
+ * @param model Contact model
+ */
+void odem_mcontact_model_derive(struct odem_contact_model* model)
+{
+    const double ln_eta = log(model->restitution);
+
+    model->damping = -2.0 * ln_eta * sqrt(model->spring_constant) /
+        sqrt(ODEM_PI * ODEM_PI + ln_eta * ln_eta);
+    if (model->tangential_constant <= 0)
+        model->tangential_constant = 2.0 / 7.0 * model->spring_constant;
+    model->inv_v_glide = 1.0 / model->v_glide;
+    model->mu_ratio = model->mu_glide / model->mu_limit;
+    model->inv_slope_limit = 1.0 / model->slope_limit;
+}
+
+/**
+ * Dashpot coefficient of a pair of particles
+ *
+ * @param model Contact model
+ * @param m1 Mass of particle 1
+ * @param m2 Mass of particle 2
+ * @return Dashpot coefficient, gamma
+ */
+double odem_pair_damping(const struct odem_contact_model* model,
+    const double m1, const double m2)
+{
+    return model->damping * sqrt(m1 * m2 / (m1 + m2));
+}
+
+/**
+ * Coefficient of friction at a relative tangential velocity
+ *
+ * Falls from mu_stick to mu_glide up to v_glide, stays at mu_glide up to
+ * v_limit and tends towards mu_limit past it.
+ *
+ * @param model Contact model
+ * @param v_r Relative tangential velocity
+ * @return Coefficient of friction, mu
+ */
+double odem_friction_coefficient(const struct odem_contact_model* model,
+    const double v_r)
+{
+    double ratio;
+
+    if (v_r <= model->v_glide)
+    {
+        ratio = v_r * model->inv_v_glide;
+        return model->mu_stick + (model->mu_stick - model->mu_glide) *
+            (ratio - 2.0) * ratio;
+    }
+    if (v_r <= model->v_limit) return model->mu_glide;
+
+    ratio = (v_r - model->v_limit) * model->inv_slope_limit;
+    return model->mu_glide * (1.0 + ratio) / (1.0 + model->mu_ratio * ratio);
+}
+
+/**
+ * Name of a contact law
+ *
+ * @param law Contact law
+ * @return Name of the law, as accepted by odem_parse_contact_law
+ */
+const char* odem_contact_law_name(const enum odem_contact_law law)
+{
+    return odem_contact_law_names[law];
+}
+
+/**
+ * Parse the name of a contact law
+ *
+ * @param name Name of the law
+ * @param law Contact law to fill
+ * @return Whether or not the name is a contact law
+ */
+int odem_parse_contact_law(const char* name, enum odem_contact_law* law)
+{
+    int i;
+
+    for (i = ODEM_CONTACT_SPRING; i <= ODEM_CONTACT_FRICTION; i++)
+    {
+        if (strcmp(name, odem_contact_law_names[i]) == 0)
+        {
+            *law = (enum odem_contact_law)i;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Allocate a table of unused contact slots
+ *
+ * @param capacity Number of slots
+ * @return Pointer to the slots
+ */
+static struct odem_contact* odem_alloc_contact_slots(const int capacity)
+{
+    int i;
+
+    struct odem_contact* slots = (struct odem_contact*)malloc(capacity *
+        sizeof(struct odem_contact));
+    if (slots == NULL) die("Memory allocation error");
+    for (i = 0; i < capacity; i++)
+        slots[i].key = ODEM_CONTACT_EMPTY;
+
+    return slots;
+}
+
+/**
+ * Allocate an empty contact store on the heap
+ *
+ * @param dof Number of dofs
+ * @param capacity Number of contacts to make room for
+ * @return Pointer to a new contact store
+ */
+struct odem_contact_store* odem_alloc_contact_store(const int dof,
+    const int capacity)
+{
+    struct odem_contact_store* new_store = (struct odem_contact_store*)malloc(
+        sizeof(struct odem_contact_store));
+    if (new_store == NULL) die("Memory allocation error");
+
+    /* at most half full */
+    new_store->capacity = ODEM_CONTACT_MIN_SLOTS;
+    while (new_store->capacity < 2 * capacity)
+        new_store->capacity *= 2;
+    new_store->dof = dof;
+    new_store->count = 0;
+    new_store->step = 0;
+    new_store->slots = odem_alloc_contact_slots(new_store->capacity);
+
+    return new_store;
+}
+
+/**
+ * Free memory from a contact store
+ *
+ * @param store Pointer to contact store
+ */
+void odem_dealloc_contact_store(struct odem_contact_store* store)
+{
+    free(store->slots);
+    free(store);
+}
+
+/**
+ * Key of a particle pair, the same whichever particle comes first
+ *
+ * @param p1 Id of particle 1
+ * @param p2 Id of particle 2
+ * @return Pair key
+ */
+uint64_t odem_contact_key(const int p1, const int p2)
+{
+    const uint32_t lo = (uint32_t)(p1 < p2 ? p1 : p2);
+    const uint32_t hi = (uint32_t)(p1 < p2 ? p2 : p1);
+
+    return (uint64_t)lo << 32 | hi;
+}
+
+/**
+ * Home slot of a key, the bits of the key are mixed so that pairs of
+ * neighbouring particles spread over the table
+ *
+ * @param store Contact store
+ * @param key Pair key
+ * @return Slot index
+ */
+static int odem_contact_home(const struct odem_contact_store* store,
+    uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+
+    return (int)(key & (uint64_t)(store->capacity - 1));
+}
+
+/**
+ * Slot of a pair, safe to call from several threads at once
+ *
+ * @param store Contact store
+ * @param key Pair key
+ * @return Slot index, -1 if the pair has no entry
+ */
+int odem_contact_find(const struct odem_contact_store* store,
+    const uint64_t key)
+{
+    int slot = odem_contact_home(store, key);
+    const int mask = store->capacity - 1;
+
+    while (store->slots[slot].key != key)
+    {
+        if (store->slots[slot].key == ODEM_CONTACT_EMPTY) return -1;
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+/**
+ * Make room for a number of new contacts, mutator
+ *
+ * Once the table would be more than half full it is rehashed, keeping only
+ * the live contacts, those whose step is not before the current step, and
+ * growing as needed. Every contact of the step must have been touched
+ * before, and slot indices are invalid after a rehash.
+ *
+ * @param store Contact store
+ * @param extra Number of contacts about to be inserted
+ * @return Whether or not the table was rehashed
+ */
+int odem_mcontact_store_reserve(struct odem_contact_store* store,
+    const int extra)
+{
+    int i, slot, live, capacity;
+    struct odem_contact* old_slots = store->slots;
+    const int old_capacity = store->capacity;
+
+    if (2 * ((long)store->count + extra) <= store->capacity) return 0;
+
+    live = odem_contact_store_live(store);
+    capacity = store->capacity;
+    while (2 * ((long)live + extra) > capacity)
+        capacity *= 2;
+
+    store->capacity = capacity;
+    store->slots = odem_alloc_contact_slots(capacity);
+    store->count = live;
+    for (i = 0; i < old_capacity; i++)
+    {
+        if (old_slots[i].key == ODEM_CONTACT_EMPTY ||
+            old_slots[i].step < store->step)
+            continue;
+        slot = odem_contact_home(store, old_slots[i].key);
+        while (store->slots[slot].key != ODEM_CONTACT_EMPTY)
+            slot = (slot + 1) & (capacity - 1);
+        store->slots[slot] = old_slots[i];
+    }
+    free(old_slots);
+
+    return 1;
+}
+
+/**
+ * Start the history of a pair in contact on the current step, mutator
+ *
+ * Room must have been made with odem_mcontact_store_reserve.
+ *
+ * @param store Contact store
+ * @param key Pair key, without an entry
+ * @param gamma Dashpot coefficient of the pair
+ * @return Slot of the new contact
+ */
+int odem_mcontact_insert(struct odem_contact_store* store, const uint64_t key,
+    const double gamma)
+{
+    int i;
+    int slot = odem_contact_home(store, key);
+
+    while (store->slots[slot].key != ODEM_CONTACT_EMPTY)
+        slot = (slot + 1) & (store->capacity - 1);
+
+    store->slots[slot].key = key;
+    store->slots[slot].step = store->step;
+    store->slots[slot].gamma = gamma;
+    for (i = 0; i < ODEM_MAX_DOF; i++)
+        store->slots[slot].spring[i] = 0.0;
+    store->count++;
+
+    return slot;
+}
+
+/**
+ * Number of contacts touched on the current step, or in a sub-cycled run
+ * still alive until their pair is evaluated again
+ *
+ * @param store Contact store
+ * @return Number of live contacts
+ */
+int odem_contact_store_live(const struct odem_contact_store* store)
+{
+    int i, live = 0;
+
+    for (i = 0; i < store->capacity; i++)
+        if (store->slots[i].key != ODEM_CONTACT_EMPTY &&
+            store->slots[i].step >= store->step)
+            live++;
+
+    return live;
+}
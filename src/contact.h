@@ -0,0 +1,140 @@
+#ifndef __CONTACT_H
+
+#define __CONTACT_H 1
+
+#include <stdint.h>
+
+#include "particle.h"
+
+/**
+ * Particle-particle contact law
+ *
+ * ODEM_CONTACT_SPRING is a linear spring along the contact normal, it stores
+ * no energy loss and no contact state.
+ * ODEM_CONTACT_DASHPOT adds a dashpot along the normal whose damping is set
+ * from the coefficient of restitution.
+ * ODEM_CONTACT_FRICTION adds a tangential spring capped by velocity dependent
+ * Coulomb friction to the spring-dashpot. The tangential spring is carried
+ * from step to step in a contact store.
+ */
+enum odem_contact_law
+{
+    ODEM_CONTACT_SPRING,
+    ODEM_CONTACT_DASHPOT,
+    ODEM_CONTACT_FRICTION
+};
+
+// data structures
+
+/**
+ * Contact model parameters
+ *
+ * The derived members are filled by odem_mcontact_model_derive, once per run,
+ * so that contact evaluations only multiply.
+ *
+ * @member law Contact law
+ * @member spring_constant Normal spring constant, k
+ * @member restitution Coefficient of restitution, eta, 0 < eta <= 1
+ * @member tangential_constant Tangential spring constant, 0 for 2/7 of k
+ * @member mu_stick Static coefficient of friction
+ * @member mu_glide Kinematic coefficient of friction
+ * @member mu_limit High velocity coefficient of friction
+ * @member v_glide Sliding velocity to overcome static friction
+ * @member v_limit Sliding velocity threshold to high velocity friction
+ * @member slope_limit Sliding velocity over which friction moves from mu_glide
+ *                     towards mu_limit
+ * @member damping Dashpot coefficient of a contact over sqrt(m_12)
+ * @member inv_v_glide 1/v_glide
+ * @member mu_ratio mu_glide/mu_limit
+ * @member inv_slope_limit 1/slope_limit
+ */
+struct odem_contact_model
+{
+    enum odem_contact_law law;
+    double spring_constant;
+    double restitution;
+    double tangential_constant;
+    double mu_stick;
+    double mu_glide;
+    double mu_limit;
+    double v_glide;
+    double v_limit;
+    double slope_limit;
+    double damping;
+    double inv_v_glide;
+    double mu_ratio;
+    double inv_slope_limit;
+};
+
+/**
+ * History of one particle pair in contact
+ *
+ * Entries are looked up at random, so they are stored together rather than
+ * as columns.
+ *
+ * @member key Pair key, see odem_contact_key, ODEM_CONTACT_EMPTY if unused
+ * @member step Contact store step the pair was last in contact on, in a
+ *              sub-cycled run plus the steps until the pair is evaluated
+ *              again
+ * @member gamma Dashpot coefficient of the pair
+ * @member spring Tangential spring elongation, seen from the particle of lower
+ *                id, one component per dof
+ */
+struct odem_contact
+{
+    uint64_t key;
+    long step;
+    double gamma;
+    double spring[ODEM_MAX_DOF];
+};
+
+/**
+ * Contact store, an open addressing hash table of contact histories keyed by
+ * particle pair
+ *
+ * Pairs are keyed by particle id, so histories survive particles moving to
+ * other indices.
+ *
+ * A contact lives as long as its pair is in contact on consecutive steps.
+ * Entries whose step is before the previous step are stale: they are reset
+ * when their pair touches again and dropped whenever the table is rehashed.
+ *
+ * @member dof Number of dofs
+ * @member capacity Number of slots, a power of two
+ * @member count Number of used slots, live and stale
+ * @member step Number of contact evaluations so far
+ * @member slots Hash table
+ */
+struct odem_contact_store
+{
+    int dof;
+    int capacity;
+    int count;
+    long step;
+    struct odem_contact* slots;
+};
+
+/* key of an unused slot */
+#define ODEM_CONTACT_EMPTY UINT64_MAX
+
+
+// function interfaces
+void odem_init_contact_model(struct odem_contact_model*);
+void odem_mcontact_model_derive(struct odem_contact_model*);
+double odem_pair_damping(const struct odem_contact_model*, const double,
+    const double);
+double odem_friction_coefficient(const struct odem_contact_model*,
+    const double);
+const char* odem_contact_law_name(const enum odem_contact_law);
+int odem_parse_contact_law(const char*, enum odem_contact_law*);
+
+struct odem_contact_store* odem_alloc_contact_store(const int, const int);
+void odem_dealloc_contact_store(struct odem_contact_store*);
+uint64_t odem_contact_key(const int, const int);
+int odem_contact_find(const struct odem_contact_store*, const uint64_t);
+int odem_mcontact_store_reserve(struct odem_contact_store*, const int);
+int odem_mcontact_insert(struct odem_contact_store*, const uint64_t,
+    const double);
+int odem_contact_store_live(const struct odem_contact_store*);
+
+#endif  /* __CONTACT_H */
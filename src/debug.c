@@ -3,7 +3,7 @@
 #include "debug.h"
 
 /**
- * Exit the program and print error message
+ * Exit the program and print error message to stderr
  *
  * @param message Error message
  */
@@ -15,7 +15,7 @@ void die(const char *message)
     }
     else
     {
-        printf("ERROR: %s\n", message);
+        fprintf(stderr, "ERROR: %s\n", message);
     }
 
     exit(1);
@@ -0,0 +1,725 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "debug.h"
+#include "domain.h"
+
+/* values sent per particle: mass, radius, id, centroid and velocity */
+#define ODEM_DOMAIN_RECORD(dof) (3 + 2 * (dof))
+
+/**
+ * Particle received from another rank
+ *
+ * @member id Id of the particle
+ * @member index Index of the particle in the particle set
+ */
+struct odem_domain_arrival
+{
+    int id;
+    int index;
+};
+
+/**
+ * Order of two arrivals by id, for qsort
+ *
+ * @param a Pointer to the first arrival
+ * @param b Pointer to the second arrival
+ * @return Negative, zero or positive as a is before, equal to or after b
+ */
+static int odem_compare_arrivals(const void* a, const void* b)
+{
+    const int id_a = ((const struct odem_domain_arrival*)a)->id;
+    const int id_b = ((const struct odem_domain_arrival*)b)->id;
+    return (id_a > id_b) - (id_a < id_b);
+}
+
+/**
+ * Layer of cells a particle is binned into, as odem_mgrid_bin bins it
+ *
+ * @param domain Domain decomposition
+ * @param parts Particle set
+ * @param index Index of the particle
+ * @return Layer along the last dof
+ */
+static int odem_domain_layer(const struct odem_domain* domain,
+    const struct odem_particles* parts, const int index)
+{
+    const int last = parts->dof - 1;
+    int layer = (int)floor((parts->centroid[last][index] -
+        domain->lattice.origin[last]) / domain->lattice.cell_size[last]);
+
+    if (layer < 0) layer = 0;
+    if (layer >= domain->num_layers) layer = domain->num_layers - 1;
+    return layer;
+}
+
+/**
+ * Grow a buffer to a number of bytes, doubling it
+ *
+ * @param buffer Buffer, NULL for none yet
+ * @param capacity Number of bytes in the buffer, updated
+ * @param bytes Number of bytes to make room for
+ * @return Pointer to the buffer
+ */
+static void* odem_grow_buffer(void* buffer, size_t* capacity,
+    const size_t bytes)
+{
+    if (bytes <= *capacity) return buffer;
+
+    if (*capacity == 0) *capacity = bytes;
+    while (*capacity < bytes)
+        *capacity *= 2;
+    buffer = realloc(buffer, *capacity);
+    if (buffer == NULL) die("Memory allocation error");
+
+    return buffer;
+}
+
+/**
+ * Allocate the slab decomposition of a particle set on the heap
+ *
+ * Every rank passes the whole set, slabs are balanced by its particles.
+ *
+ * @param comm Communicator
+ * @param parts Particle set of the whole run
+ * @param bounds Array containing boundaries
+ * @return Pointer to a new domain decomposition
+ */
+struct odem_domain* odem_alloc_domain(MPI_Comm comm,
+    const struct odem_particles* parts, const double bounds[])
+{
+    int i, r, layer;
+    long count = 0;
+    int* histogram;
+    struct odem_grid* grid;
+
+    struct odem_domain* new_domain = (struct odem_domain*)malloc(
+        sizeof(struct odem_domain));
+    if (new_domain == NULL) die("Memory allocation error");
+
+    new_domain->comm = comm;
+    MPI_Comm_rank(comm, &new_domain->rank);
+    MPI_Comm_size(comm, &new_domain->num_ranks);
+    new_domain->num_global = parts->num_particles;
+    new_domain->max_radius = odem_max_radius(parts);
+
+    /* the grid of a serial run, see odem_run_analysis */
+    grid = odem_alloc_grid(parts->dof, bounds, 2.0 * new_domain->max_radius,
+        parts->num_particles);
+    new_domain->lattice = *grid;
+    new_domain->lattice.cell_start = NULL;
+    new_domain->lattice.cell_particles = NULL;
+    new_domain->lattice.particle_cell = NULL;
+    new_domain->lattice.num_particles = 0;
+    new_domain->lattice.capacity = 0;
+    odem_dealloc_grid(grid);
+
+    new_domain->num_layers = new_domain->lattice.dims[parts->dof - 1];
+    if (new_domain->num_layers < new_domain->num_ranks)
+        die("More ranks than layers of grid cells.");
+
+    new_domain->layer_start = (int*)malloc((new_domain->num_ranks + 1) *
+        sizeof(int));
+    new_domain->layer_rank = (int*)malloc(new_domain->num_layers *
+        sizeof(int));
+    histogram = (int*)calloc(new_domain->num_layers, sizeof(int));
+    if (new_domain->layer_start == NULL || new_domain->layer_rank == NULL ||
+        histogram == NULL)
+        die("Memory allocation error");
+
+    for (i = 0; i < parts->num_particles; i++)
+        histogram[odem_domain_layer(new_domain, parts, i)]++;
+
+    /* a slab ends once it holds its share of the particles, or when each
+     * rank after it needs one of the layers left */
+    new_domain->layer_start[0] = 0;
+    r = 1;
+    for (layer = 0; layer < new_domain->num_layers &&
+        r < new_domain->num_ranks; layer++)
+    {
+        count += histogram[layer];
+        if (count * new_domain->num_ranks >= (long)r * parts->num_particles ||
+            new_domain->num_layers - layer - 1 == new_domain->num_ranks - r)
+            new_domain->layer_start[r++] = layer + 1;
+    }
+    new_domain->layer_start[new_domain->num_ranks] = new_domain->num_layers;
+    for (r = 0; r < new_domain->num_ranks; r++)
+        for (layer = new_domain->layer_start[r];
+            layer < new_domain->layer_start[r+1]; layer++)
+            new_domain->layer_rank[layer] = r;
+    free(histogram);
+
+    new_domain->num_owned = parts->num_particles;
+    new_domain->num_ghosts = 0;
+    new_domain->destination = (int*)malloc((parts->next_id > 0 ?
+        parts->next_id : 1) * sizeof(int));
+    new_domain->send_counts = (int*)malloc(new_domain->num_ranks *
+        sizeof(int));
+    new_domain->send_displs = (int*)malloc(new_domain->num_ranks *
+        sizeof(int));
+    new_domain->recv_counts = (int*)malloc(new_domain->num_ranks *
+        sizeof(int));
+    new_domain->recv_displs = (int*)malloc(new_domain->num_ranks *
+        sizeof(int));
+    if (new_domain->destination == NULL || new_domain->send_counts == NULL ||
+        new_domain->send_displs == NULL || new_domain->recv_counts == NULL ||
+        new_domain->recv_displs == NULL)
+        die("Memory allocation error");
+    for (i = 0; i < parts->next_id; i++)
+        new_domain->destination[i] = -1;
+
+    new_domain->item_index = NULL;
+    new_domain->item_rank = NULL;
+    new_domain->item_capacity = 0;
+    new_domain->send = NULL;
+    new_domain->send_capacity = 0;
+    new_domain->recv = NULL;
+    new_domain->recv_capacity = 0;
+    new_domain->snapshot = NULL;
+
+    return new_domain;
+}
+
+/**
+ * Free memory from a domain decomposition
+ *
+ * @param domain Pointer to domain decomposition
+ */
+void odem_dealloc_domain(struct odem_domain* domain)
+{
+    free(domain->layer_start);
+    free(domain->layer_rank);
+    free(domain->destination);
+    free(domain->item_index);
+    free(domain->item_rank);
+    free(domain->send_counts);
+    free(domain->send_displs);
+    free(domain->recv_counts);
+    free(domain->recv_displs);
+    free(domain->send);
+    free(domain->recv);
+    if (domain->snapshot != NULL) odem_dealloc_snapshot(domain->snapshot);
+    free(domain);
+}
+
+/**
+ * Allocate the grid of the slab of this rank and of its ghosts
+ *
+ * @param domain Domain decomposition
+ * @param capacity Number of particles to make room for
+ * @return Pointer to a new grid
+ */
+struct odem_grid* odem_alloc_domain_grid(const struct odem_domain* domain,
+    const int capacity)
+{
+    const int* start = domain->layer_start;
+    const int first = start[domain->rank] > 0 ? start[domain->rank] - 1 : 0;
+    const int end = start[domain->rank+1] < domain->num_layers ?
+        start[domain->rank+1] + 1 : domain->num_layers;
+
+    return odem_alloc_grid_range(&domain->lattice, first, end - first,
+        capacity);
+}
+
+/**
+ * Keep only the particles owned by this rank, in their order; mutator
+ *
+ * @param domain Domain decomposition
+ * @param parts Particle set of the whole run
+ */
+void odem_mdomain_scatter(struct odem_domain* domain,
+    struct odem_particles* parts)
+{
+    int i, count = 0;
+
+    int* order = (int*)malloc((parts->num_particles > 0 ?
+        parts->num_particles : 1) * sizeof(int));
+    if (order == NULL) die("Memory allocation error");
+
+    for (i = 0; i < parts->num_particles; i++)
+        if (domain->layer_rank[odem_domain_layer(domain, parts, i)] ==
+            domain->rank)
+            order[count++] = i;
+    odem_mparticles_permute(parts, order, count);
+    free(order);
+
+    domain->num_owned = count;
+    domain->num_ghosts = 0;
+}
+
+/**
+ * List a particle to send to a rank, mutator
+ *
+ * @param domain Domain decomposition
+ * @param item Number of particles listed so far
+ * @param index Index of the particle
+ * @param rank Rank to send the particle to
+ */
+static void odem_mdomain_push_item(struct odem_domain* domain,
+    const int item, const int index, const int rank)
+{
+    if (item == domain->item_capacity)
+    {
+        domain->item_capacity = domain->item_capacity > 0 ?
+            2 * domain->item_capacity : 64;
+        domain->item_index = (int*)realloc(domain->item_index,
+            domain->item_capacity * sizeof(int));
+        domain->item_rank = (int*)realloc(domain->item_rank,
+            domain->item_capacity * sizeof(int));
+        if (domain->item_index == NULL || domain->item_rank == NULL)
+            die("Memory allocation error");
+    }
+
+    domain->item_index[item] = index;
+    domain->item_rank[item] = rank;
+}
+
+/**
+ * Exchange the counts of the values sent to each rank and set the offsets
+ * of the values sent and received, mutator
+ *
+ * @param domain Domain decomposition, its send counts set
+ * @return Number of values received
+ */
+static int odem_mdomain_exchange_counts(struct odem_domain* domain)
+{
+    int r, sent = 0, received = 0;
+
+    MPI_Alltoall(domain->send_counts, 1, MPI_INT, domain->recv_counts, 1,
+        MPI_INT, domain->comm);
+    for (r = 0; r < domain->num_ranks; r++)
+    {
+        domain->send_displs[r] = sent;
+        sent += domain->send_counts[r];
+        domain->recv_displs[r] = received;
+        received += domain->recv_counts[r];
+    }
+
+    return received;
+}
+
+/**
+ * Send the listed particles to their ranks and receive those sent to this
+ * rank into the receive buffer, mutator
+ *
+ * Particles arrive grouped by the rank they come from, in the order that
+ * rank listed them.
+ *
+ * @param domain Domain decomposition
+ * @param parts Particle set
+ * @param num_items Number of particles listed
+ * @return Number of particles received
+ */
+static int odem_mdomain_transfer(struct odem_domain* domain,
+    const struct odem_particles* parts, const int num_items)
+{
+    int i, j, r, received;
+    double* record;
+    const int dof = parts->dof, size = ODEM_DOMAIN_RECORD(parts->dof);
+
+    for (r = 0; r < domain->num_ranks; r++)
+        domain->send_counts[r] = 0;
+    for (i = 0; i < num_items; i++)
+        domain->send_counts[domain->item_rank[i]] += size;
+    received = odem_mdomain_exchange_counts(domain);
+
+    domain->send = odem_grow_buffer(domain->send, &domain->send_capacity,
+        (size_t)num_items * size * sizeof(double));
+    domain->recv = odem_grow_buffer(domain->recv, &domain->recv_capacity,
+        (size_t)received * sizeof(double));
+
+    /* pack by rank, each offset is advanced past its records and reset */
+    for (i = 0; i < num_items; i++)
+    {
+        r = domain->item_rank[i];
+        record = (double*)domain->send + domain->send_displs[r];
+        domain->send_displs[r] += size;
+
+        record[0] = parts->mass[domain->item_index[i]];
+        record[1] = parts->radius[domain->item_index[i]];
+        record[2] = (double)parts->id[domain->item_index[i]];
+        for (j = 0; j < dof; j++)
+        {
+            record[3+j] = parts->centroid[j][domain->item_index[i]];
+            record[3+dof+j] = parts->velocity[j][domain->item_index[i]];
+        }
+    }
+    for (r = 0; r < domain->num_ranks; r++)
+        domain->send_displs[r] -= domain->send_counts[r];
+
+    MPI_Alltoallv(domain->send, domain->send_counts, domain->send_displs,
+        MPI_DOUBLE, domain->recv, domain->recv_counts, domain->recv_displs,
+        MPI_DOUBLE, domain->comm);
+
+    return received / size;
+}
+
+/**
+ * Copy received particles into a particle set, mutator
+ *
+ * @param domain Domain decomposition
+ * @param parts Particle set with room for the particles
+ * @param first Index of the first received particle
+ * @param count Number of received particles
+ */
+static void odem_domain_unpack(const struct odem_domain* domain,
+    struct odem_particles* parts, const int first, const int count)
+{
+    int i, j, k;
+    const double* record;
+    const int dof = parts->dof, size = ODEM_DOMAIN_RECORD(parts->dof);
+
+    for (k = 0; k < count; k++)
+    {
+        record = (const double*)domain->recv + (size_t)k * size;
+        i = first + k;
+
+        parts->mass[i] = record[0];
+        parts->radius[i] = record[1];
+        parts->id[i] = (int)record[2];
+        for (j = 0; j < dof; j++)
+        {
+            parts->centroid[j][i] = record[3+j];
+            parts->velocity[j][i] = record[3+dof+j];
+            parts->force[j][i] = 0.0;
+            parts->ref_centroid[j][i] = record[3+j];
+        }
+    }
+}
+
+/**
+ * Make room for a number of particles, doubling the capacity; mutator
+ *
+ * @param parts Particle set
+ * @param capacity Number of particles to make room for
+ */
+static void odem_mdomain_make_room(struct odem_particles* parts,
+    const int capacity)
+{
+    if (capacity <= parts->capacity) return;
+    odem_mparticles_reserve(parts, capacity > 2 * parts->capacity ?
+        capacity : 2 * parts->capacity);
+}
+
+/**
+ * Count a contact history to send to a rank or pack it, mutator
+ *
+ * @param domain Domain decomposition
+ * @param contact Contact history
+ * @param rank Rank to send it to
+ * @param pack Whether to pack it rather than count it
+ */
+static void odem_mdomain_pack_contact(struct odem_domain* domain,
+    const struct odem_contact* contact, const int rank, const int pack)
+{
+    const int size = (int)sizeof(struct odem_contact);
+
+    if (!pack)
+    {
+        domain->send_counts[rank] += size;
+        return;
+    }
+
+    memcpy((char*)domain->send + domain->send_displs[rank], contact, size);
+    domain->send_displs[rank] += size;
+}
+
+/**
+ * Send the contact histories of the listed particles to the ranks they
+ * migrate to and receive those sent to this rank, mutator
+ *
+ * Histories of pairs touched on the last evaluation go along; a pair of two
+ * migrating particles goes to the ranks of both.
+ *
+ * @param domain Domain decomposition
+ * @param parts Particle set
+ * @param store Contact store
+ * @param num_items Number of particles listed
+ * @return Number of histories received
+ */
+static int odem_mdomain_transfer_contacts(struct odem_domain* domain,
+    const struct odem_particles* parts,
+    const struct odem_contact_store* store, const int num_items)
+{
+    int i, r, s, pack, rank_lo, rank_hi, received = 0;
+    const struct odem_contact* contact;
+    const int size = (int)sizeof(struct odem_contact);
+
+    for (i = 0; i < num_items; i++)
+        domain->destination[parts->id[domain->item_index[i]]] =
+            domain->item_rank[i];
+    for (r = 0; r < domain->num_ranks; r++)
+        domain->send_counts[r] = 0;
+
+    /* count the histories on the first pass, pack them on the second */
+    for (pack = 0; pack < 2; pack++)
+    {
+        for (s = 0; s < store->capacity; s++)
+        {
+            contact = store->slots + s;
+            if (contact->key == ODEM_CONTACT_EMPTY ||
+                contact->step < store->step)
+                continue;
+
+            rank_lo = domain->destination[(int)(contact->key >> 32)];
+            rank_hi = domain->destination[(int)(contact->key & 0xffffffffu)];
+            if (rank_lo >= 0)
+                odem_mdomain_pack_contact(domain, contact, rank_lo, pack);
+            if (rank_hi >= 0 && rank_hi != rank_lo)
+                odem_mdomain_pack_contact(domain, contact, rank_hi, pack);
+        }
+
+        if (pack) break;
+        received = odem_mdomain_exchange_counts(domain);
+        domain->send = odem_grow_buffer(domain->send, &domain->send_capacity,
+            (size_t)(domain->send_displs[domain->num_ranks-1] +
+            domain->send_counts[domain->num_ranks-1]));
+        domain->recv = odem_grow_buffer(domain->recv, &domain->recv_capacity,
+            (size_t)received);
+    }
+    for (r = 0; r < domain->num_ranks; r++)
+        domain->send_displs[r] -= domain->send_counts[r];
+
+    for (i = 0; i < num_items; i++)
+        domain->destination[parts->id[domain->item_index[i]]] = -1;
+
+    MPI_Alltoallv(domain->send, domain->send_counts, domain->send_displs,
+        MPI_BYTE, domain->recv, domain->recv_counts, domain->recv_displs,
+        MPI_BYTE, domain->comm);
+
+    return received / size;
+}
+
+/**
+ * Store received contact histories, replacing those of the same pairs;
+ * mutator
+ *
+ * The sending rank owned a particle of each pair, so its history is the
+ * one that counts.
+ *
+ * @param domain Domain decomposition
+ * @param store Contact store
+ * @param count Number of received histories
+ */
+static void odem_domain_import_contacts(const struct odem_domain* domain,
+    struct odem_contact_store* store, const int count)
+{
+    int i, slot;
+    const struct odem_contact* contacts =
+        (const struct odem_contact*)domain->recv;
+
+    if (count == 0) return;
+
+    odem_mcontact_store_reserve(store, count);
+    for (i = 0; i < count; i++)
+    {
+        slot = odem_contact_find(store, contacts[i].key);
+        if (slot < 0)
+            slot = odem_mcontact_insert(store, contacts[i].key,
+                contacts[i].gamma);
+        store->slots[slot] = contacts[i];
+    }
+}
+
+/**
+ * Migrate the particles that left the slab of their rank and send the
+ * ghosts, mutator
+ *
+ * Must be called by every rank with only owned particles in the set, i.e.
+ * after dropping the ghosts of the previous exchange. Owned particles are
+ * kept in the order of their ids, the order of a serial run, as long as
+ * nothing else reorders them.
+ *
+ * @param domain Domain decomposition
+ * @param parts Particle set, owned particles then ghosts on return
+ * @param contacts Contact store, NULL for laws without history
+ */
+void odem_mdomain_exchange(struct odem_domain* domain,
+    struct odem_particles* parts, struct odem_contact_store* contacts)
+{
+    int i, r, layer, a, k, kept = 0, num_items = 0, num_in;
+    int* order;
+    struct odem_domain_arrival* arrivals;
+    const int n = parts->num_particles;
+    const int rank = domain->rank;
+    const int* start = domain->layer_start;
+
+    /* particles that left the slab move to the rank of their layer */
+    for (i = 0; i < n; i++)
+    {
+        r = domain->layer_rank[odem_domain_layer(domain, parts, i)];
+        if (r != rank) odem_mdomain_push_item(domain, num_items++, i, r);
+    }
+    num_in = odem_mdomain_transfer(domain, parts, num_items);
+    odem_mdomain_make_room(parts, n + num_in);
+    odem_domain_unpack(domain, parts, n, num_in);
+    if (contacts != NULL)
+        odem_domain_import_contacts(domain, contacts,
+            odem_mdomain_transfer_contacts(domain, parts, contacts,
+            num_items));
+
+    /* merge the arrivals, sorted by id, into the particles that stay */
+    if (num_items > 0 || num_in > 0)
+    {
+        order = (int*)malloc((n + num_in) * sizeof(int));
+        arrivals = (struct odem_domain_arrival*)malloc((num_in > 0 ? num_in :
+            1) * sizeof(struct odem_domain_arrival));
+        if (order == NULL || arrivals == NULL)
+            die("Memory allocation error");
+
+        for (a = 0; a < num_in; a++)
+        {
+            arrivals[a].id = parts->id[n+a];
+            arrivals[a].index = n + a;
+        }
+        qsort(arrivals, num_in, sizeof(struct odem_domain_arrival),
+            odem_compare_arrivals);
+
+        /* items are listed in ascending index */
+        for (i = 0, a = 0, k = 0; i < n; i++)
+        {
+            if (k < num_items && domain->item_index[k] == i)
+            {
+                k++;
+                continue;
+            }
+            while (a < num_in && arrivals[a].id < parts->id[i])
+                order[kept++] = arrivals[a++].index;
+            order[kept++] = i;
+        }
+        while (a < num_in)
+            order[kept++] = arrivals[a++].index;
+        odem_mparticles_permute(parts, order, kept);
+
+        free(order);
+        free(arrivals);
+    }
+    domain->num_owned = parts->num_particles;
+
+    /* particles in the edge layers of the slab are ghosts next door */
+    num_items = 0;
+    for (i = 0; i < domain->num_owned; i++)
+    {
+        layer = odem_domain_layer(domain, parts, i);
+        if (layer == start[rank] && rank > 0)
+            odem_mdomain_push_item(domain, num_items++, i, rank - 1);
+        if (layer == start[rank+1] - 1 && rank < domain->num_ranks - 1)
+            odem_mdomain_push_item(domain, num_items++, i, rank + 1);
+    }
+    num_in = odem_mdomain_transfer(domain, parts, num_items);
+    odem_mdomain_make_room(parts, domain->num_owned + num_in);
+    odem_domain_unpack(domain, parts, domain->num_owned, num_in);
+    parts->num_particles = domain->num_owned + num_in;
+    domain->num_ghosts = num_in;
+}
+
+/**
+ * Snapshot of the owned particles of this rank, grown as needed
+ *
+ * @param domain Domain decomposition
+ * @param dof Number of dofs of each field
+ * @param num_particles Number of particles to make room for
+ * @param fields Bit mask of fields to make room for
+ * @return Snapshot to fill and gather with odem_mdomain_gather
+ */
+struct odem_snapshot* odem_mdomain_snapshot(struct odem_domain* domain,
+    const int dof, const int num_particles, const unsigned int fields)
+{
+    if (domain->snapshot != NULL &&
+        domain->snapshot->capacity >= num_particles)
+        return domain->snapshot;
+
+    if (domain->snapshot != NULL) odem_dealloc_snapshot(domain->snapshot);
+    domain->snapshot = odem_alloc_snapshot(dof, num_particles > 0 ?
+        2 * num_particles : 1, fields);
+
+    return domain->snapshot;
+}
+
+/**
+ * Gather the snapshots of every rank into one on rank 0, mutator
+ *
+ * Rows are grouped by rank. Must be called by every rank.
+ *
+ * @param domain Domain decomposition
+ * @param local Snapshot of the owned particles of this rank
+ * @param snap Snapshot to fill on rank 0, with room for every particle;
+ *             ignored on other ranks
+ */
+void odem_mdomain_gather(struct odem_domain* domain,
+    const struct odem_snapshot* local, struct odem_snapshot* snap)
+{
+    int r, f, j, total = 0;
+    const int root = domain->rank == 0;
+
+    MPI_Gather(&local->num_particles, 1, MPI_INT, domain->recv_counts, 1,
+        MPI_INT, 0, domain->comm);
+    if (root)
+    {
+        for (r = 0; r < domain->num_ranks; r++)
+        {
+            domain->recv_displs[r] = total;
+            total += domain->recv_counts[r];
+        }
+        if (total > snap->capacity) die("Snapshot capacity exceeded.");
+        snap->time = local->time;
+        snap->num_particles = total;
+    }
+
+    MPI_Gatherv(local->particle_id, local->num_particles, MPI_INT,
+        root ? snap->particle_id : NULL, domain->recv_counts,
+        domain->recv_displs, MPI_INT, 0, domain->comm);
+    for (f = 0; f < ODEM_NUM_FIELDS; f++)
+    {
+        if (!(local->fields & ODEM_FIELD_MASK(f))) continue;
+        for (j = 0; j < local->dof; j++)
+            MPI_Gatherv(local->data[f][j], local->num_particles, MPI_DOUBLE,
+                root ? snap->data[f][j] : NULL, domain->recv_counts,
+                domain->recv_displs, MPI_DOUBLE, 0, domain->comm);
+    }
+}
+
+/**
+ * Sum of a value over every rank
+ *
+ * @param domain Domain decomposition
+ * @param value Value of this rank
+ * @return Sum over every rank
+ */
+long odem_domain_sum(const struct odem_domain* domain, const long value)
+{
+    long sum;
+
+    MPI_Allreduce(&value, &sum, 1, MPI_LONG, MPI_SUM, domain->comm);
+    return sum;
+}
+
+/**
+ * Largest value over every rank
+ *
+ * @param domain Domain decomposition
+ * @param value Value of this rank
+ * @return Largest value over every rank
+ */
+double odem_domain_max(const struct odem_domain* domain, const double value)
+{
+    double max;
+
+    MPI_Allreduce(&value, &max, 1, MPI_DOUBLE, MPI_MAX, domain->comm);
+    return max;
+}
+
+/**
+ * Sum an array of values over every rank, in place
+ *
+ * @param domain Domain decomposition
+ * @param values Values of this rank, replaced by their sums
+ * @param count Number of values
+ */
+void odem_domain_sum_values(const struct odem_domain* domain, double values[],
+    const int count)
+{
+    MPI_Allreduce(MPI_IN_PLACE, values, count, MPI_DOUBLE, MPI_SUM,
+        domain->comm);
+}
@@ -0,0 +1,101 @@
+#ifndef __DOMAIN_H
+
+#define __DOMAIN_H 1
+
+#include <mpi.h>
+
+#include "particle.h"
+#include "grid.h"
+#include "contact.h"
+#include "record.h"
+
+// data structures
+
+/**
+ * Slab decomposition of a run over the ranks of an MPI communicator
+ *
+ * The cells of the grid a serial run would use are split into slabs of
+ * whole layers of cells along the last dof, one slab per rank, balanced by
+ * the number of particles at the start of the run. A rank owns the particles
+ * binned into its slab and keeps copies, ghosts, of the particles in the
+ * layer on either side of it. Cells are at least as wide as the contact
+ * cutoff, so owned particles find every contact on their rank, and in the
+ * same order as the serial run.
+ *
+ * Owned particles come first in the particle set, ghosts after them. Ghosts
+ * are sent again before every force evaluation, particles that left the
+ * slab migrate to their new rank with their contact histories.
+ *
+ * @member comm Communicator
+ * @member rank Rank of this process
+ * @member num_ranks Number of ranks
+ * @member num_global Number of particles over every rank at the start
+ * @member max_radius Largest radius over every rank
+ * @member lattice Geometry of the grid of a serial run, without cells
+ * @member num_layers Number of layers of cells along the last dof
+ * @member layer_start First layer of the slab of each rank, num_ranks+1 long
+ * @member layer_rank Rank owning each layer
+ * @member num_owned Number of particles owned by this rank
+ * @member num_ghosts Number of ghosts
+ * @member destination Rank each particle id migrates to on this exchange,
+ *                     -1 if it stays
+ * @member item_index Index of each particle to send
+ * @member item_rank Rank to send each particle to
+ * @member item_capacity Number of particles there is room for sending
+ * @member send_counts Number of values sent to each rank
+ * @member send_displs Offset of the values sent to each rank
+ * @member recv_counts Number of values received from each rank
+ * @member recv_displs Offset of the values received from each rank
+ * @member send Send buffer
+ * @member send_capacity Number of bytes in the send buffer
+ * @member recv Receive buffer
+ * @member recv_capacity Number of bytes in the receive buffer
+ * @member snapshot Snapshot of the owned particles, gathered on rank 0
+ */
+struct odem_domain
+{
+    MPI_Comm comm;
+    int rank;
+    int num_ranks;
+    int num_global;
+    double max_radius;
+    struct odem_grid lattice;
+    int num_layers;
+    int* layer_start;
+    int* layer_rank;
+    int num_owned;
+    int num_ghosts;
+    int* destination;
+    int* item_index;
+    int* item_rank;
+    int item_capacity;
+    int* send_counts;
+    int* send_displs;
+    int* recv_counts;
+    int* recv_displs;
+    void* send;
+    size_t send_capacity;
+    void* recv;
+    size_t recv_capacity;
+    struct odem_snapshot* snapshot;
+};
+
+
+// function interfaces
+struct odem_domain* odem_alloc_domain(MPI_Comm,
+    const struct odem_particles*, const double[]);
+void odem_dealloc_domain(struct odem_domain*);
+struct odem_grid* odem_alloc_domain_grid(const struct odem_domain*,
+    const int);
+void odem_mdomain_scatter(struct odem_domain*, struct odem_particles*);
+void odem_mdomain_exchange(struct odem_domain*, struct odem_particles*,
+    struct odem_contact_store*);
+struct odem_snapshot* odem_mdomain_snapshot(struct odem_domain*, const int,
+    const int, const unsigned int);
+void odem_mdomain_gather(struct odem_domain*, const struct odem_snapshot*,
+    struct odem_snapshot*);
+long odem_domain_sum(const struct odem_domain*, const long);
+double odem_domain_max(const struct odem_domain*, const double);
+void odem_domain_sum_values(const struct odem_domain*, double[], const int);
+
+#endif  /* __DOMAIN_H */
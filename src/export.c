@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "particle.h"
+#include "record.h"
+#include "recorder.h"
+#include "frames.h"
+
+/*
+ * Print usage and exit
+ */
+static void usage(const char* prog)
+{
+    printf("Usage: %s [-t steps] [-p safe|fast|scratch] frames results\n"
+        "\tframes Frame file written by odem-sim -o frames\n"
+        "\tresults Results database, created or replaced\n"
+        "\t-t Time steps written per database transaction, default 64\n"
+        "\t-p Database journal/sync preset, default fast\n", prog);
+    exit(1);
+}
+
+/*
+ * Convert a columnar frame file into a sqlite results database with the
+ * layout odem-sim writes directly, bulk loaded and indexed at the end
+ */
+int main(int argc, char* argv[])
+{
+    int opt, k;
+    int steps_per_txn = 64;
+    enum odem_db_preset preset = ODEM_DB_FAST;
+    struct odem_frame_reader* reader;
+    struct odem_recorder* recorder;
+    struct odem_particles* parts;
+    struct odem_snapshot* snap;
+
+    while ((opt = getopt(argc, argv, "t:p:")) != -1)
+    {
+        switch (opt)
+        {
+            case 't':
+                steps_per_txn = atoi(optarg);
+                if (steps_per_txn < 1) usage(argv[0]);
+                break;
+            case 'p':
+                if (strcmp(optarg, "safe") == 0)
+                    preset = ODEM_DB_SAFE;
+                else if (strcmp(optarg, "fast") == 0)
+                    preset = ODEM_DB_FAST;
+                else if (strcmp(optarg, "scratch") == 0)
+                    preset = ODEM_DB_SCRATCH;
+                else
+                    usage(argv[0]);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (argc - optind != 2) usage(argv[0]);
+
+    reader = odem_alloc_frame_reader(argv[optind]);
+
+    unlink(argv[optind + 1]);
+    recorder = odem_alloc_db_recorder(argv[optind + 1], preset,
+        reader->header.dof, reader->header.fields, steps_per_txn, 1);
+    odem_recorder_init(recorder);
+
+    parts = odem_alloc_particles(reader->header.dof,
+        reader->header.num_particles);
+    odem_read_frame_particles(reader, parts);
+    odem_recorder_particle_data(recorder, parts);
+    odem_recorder_model_data(recorder, reader->header.iters,
+        reader->header.delta_time, reader->header.bounds);
+
+    snap = odem_alloc_snapshot(reader->header.dof,
+        reader->header.num_particles, reader->header.fields);
+    for (k = 0; k < reader->num_frames; k++)
+    {
+        odem_read_frame(reader, k, snap);
+        odem_recorder_motion(recorder, snap);
+    }
+
+    printf("Exported %d frames of %d particles.\n", reader->num_frames,
+        reader->header.num_particles);
+
+    odem_dealloc_snapshot(snap);
+    odem_dealloc_particles(parts);
+    odem_dealloc_recorder(recorder);
+    odem_dealloc_frame_reader(reader);
+
+    return 0;
+}
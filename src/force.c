@@ -0,0 +1,198 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "debug.h"
+#include "force.h"
+
+/* number of pairs handed to the batched contact kernel at a time */
+#define ODEM_PAIR_BLOCK 256
+
+/**
+ * Allocate per-pair force storage on the heap
+ *
+ * @param dof Number of dofs
+ * @param capacity Initial number of pairs to make room for
+ * @return Pointer to new pair force storage
+ */
+struct odem_pair_forces* odem_alloc_pair_forces(const int dof,
+    const int capacity)
+{
+    int i;
+
+    struct odem_pair_forces* new_forces = (struct odem_pair_forces*)malloc(
+        sizeof(struct odem_pair_forces));
+    if (new_forces == NULL) die("Memory allocation error");
+
+    new_forces->dof = dof;
+    new_forces->capacity = capacity > 0 ? capacity : 1;
+    for (i = 0; i < ODEM_MAX_DOF; i++)
+        new_forces->force[i] = NULL;
+    for (i = 0; i < dof; i++)
+    {
+        new_forces->force[i] = (double*)malloc(new_forces->capacity *
+            sizeof(double));
+        if (new_forces->force[i] == NULL) die("Memory allocation error");
+    }
+    new_forces->incident = (int*)malloc(2 * new_forces->capacity *
+        sizeof(int));
+    new_forces->contact = (int*)malloc(new_forces->capacity * sizeof(int));
+    new_forces->incident_start = NULL;
+    new_forces->num_particles = 0;
+    new_forces->stride = NULL;
+    if (new_forces->incident == NULL || new_forces->contact == NULL)
+        die("Memory allocation error");
+
+    return new_forces;
+}
+
+/**
+ * Free memory from per-pair force storage
+ *
+ * @param forces Pointer to pair force storage
+ */
+void odem_dealloc_pair_forces(struct odem_pair_forces* forces)
+{
+    int i;
+
+    for (i = 0; i < forces->dof; i++)
+        free(forces->force[i]);
+    free(forces->incident);
+    free(forces->incident_start);
+    free(forces->contact);
+    free(forces);
+}
+
+/**
+ * Grow pair force storage, mutator
+ *
+ * @param forces Pair force storage
+ * @param num_pairs Number of pairs to make room for
+ * @param num_particles Number of particles to make room for
+ */
+static void odem_mpair_forces_reserve(struct odem_pair_forces* forces,
+    const int num_pairs, const int num_particles)
+{
+    int i;
+
+    if (num_pairs > forces->capacity)
+    {
+        while (forces->capacity < num_pairs)
+            forces->capacity *= 2;
+        for (i = 0; i < forces->dof; i++)
+        {
+            forces->force[i] = (double*)realloc(forces->force[i],
+                forces->capacity * sizeof(double));
+            if (forces->force[i] == NULL) die("Memory allocation error");
+        }
+        forces->incident = (int*)realloc(forces->incident,
+            2 * forces->capacity * sizeof(int));
+        forces->contact = (int*)realloc(forces->contact,
+            forces->capacity * sizeof(int));
+        if (forces->incident == NULL || forces->contact == NULL)
+            die("Memory allocation error");
+    }
+
+    if (num_particles > forces->num_particles ||
+        forces->incident_start == NULL)
+    {
+        forces->num_particles = num_particles;
+        free(forces->incident_start);
+        forces->incident_start = (int*)malloc((num_particles + 1) *
+            sizeof(int));
+        if (forces->incident_start == NULL) die("Memory allocation error");
+    }
+}
+
+/**
+ * Index the pairs incident to every particle with a counting sort, mutator
+ *
+ * Must be called whenever the pair list changes. Pairs are listed per
+ * particle in ascending pair order.
+ *
+ * @param forces Pair force storage
+ * @param pairs Pair list
+ * @param num_particles Number of particles referenced by the pair list
+ */
+void odem_mpair_forces_index(struct odem_pair_forces* forces,
+    const struct odem_pair_list* pairs, const int num_particles)
+{
+    int i, k;
+    int* start;
+
+    odem_mpair_forces_reserve(forces, pairs->num_pairs, num_particles);
+    start = forces->incident_start;
+
+    for (i = 0; i <= num_particles; i++)
+        start[i] = 0;
+    for (k = 0; k < pairs->num_pairs; k++)
+    {
+        start[pairs->first[k]+1]++;
+        start[pairs->second[k]+1]++;
+    }
+    for (i = 0; i < num_particles; i++)
+        start[i+1] += start[i];
+
+    for (k = 0; k < pairs->num_pairs; k++)
+    {
+        forces->incident[start[pairs->first[k]]++] = k;
+        forces->incident[start[pairs->second[k]]++] = ~k;
+    }
+
+    /* filling advanced each start to the end of its range, shift back */
+    for (i = num_particles; i > 0; i--)
+        start[i] = start[i-1];
+    start[0] = 0;
+}
+
+/**
+ * Reset the accumulated net force of every particle, mutator
+ *
+ * @param parts Particle set
+ */
+void odem_mzero_forces(struct odem_particles* parts)
+{
+    int i, j;
+
+    for (i = 0; i < parts->dof; i++)
+    {
+        double* force = parts->force[i];
+        #pragma omp parallel for schedule(static)
+        for (j = 0; j < parts->num_particles; j++)
+            force[j] = 0.0;
+    }
+}
+
+/**
+ * Kernels specialised for a number of dofs
+ *
+ * @param dof Number of dofs, 2 or 3
+ * @return Pointer to the kernel table
+ */
+const struct odem_kernels* odem_select_kernels(const int dof)
+{
+    static const struct odem_kernels kernels_2d = { 2,
+        odem_mmove_particles_2d, odem_maccel_particles_2d,
+        odem_mkick_particles_2d,
+        odem_mforce_walls_2d, odem_mforce_pairs_2d,
+        odem_mforce_pairs_history_2d, odem_mforce_all_pairs_2d };
+    static const struct odem_kernels kernels_3d = { 3,
+        odem_mmove_particles_3d, odem_maccel_particles_3d,
+        odem_mkick_particles_3d,
+        odem_mforce_walls_3d, odem_mforce_pairs_3d,
+        odem_mforce_pairs_history_3d, odem_mforce_all_pairs_3d };
+
+    if (dof == 2) return &kernels_2d;
+    if (dof == 3) return &kernels_3d;
+    die("Particle sets are 2D or 3D.");
+    return NULL;
+}
+
+/* dof specialised kernels */
+
+#define ODEM_KERNEL_DOF 2
+#include "force_kernels.h"
+#undef ODEM_KERNEL_DOF
+
+#define ODEM_KERNEL_DOF 3
+#include "force_kernels.h"
+#undef ODEM_KERNEL_DOF
@@ -0,0 +1,121 @@
+#ifndef __FORCE_H
+
+#define __FORCE_H 1
+
+#include "particle.h"
+#include "grid.h"
+#include "contact.h"
+#include "wall.h"
+
+/**
+ * Pair contact kernel
+ *
+ * ODEM_CONTACT_KERNEL_SCALAR evaluates one pair per call.
+ * ODEM_CONTACT_KERNEL_BATCH evaluates blocks of pairs with vector
+ * instructions, see odem_mforce_collision_spring_batch.
+ */
+enum odem_contact_kernel
+{
+    ODEM_CONTACT_KERNEL_SCALAR,
+    ODEM_CONTACT_KERNEL_BATCH
+};
+
+// data structures
+
+/**
+ * Per-pair force storage used to accumulate contact forces without races
+ *
+ * Pair forces are computed independently, then every particle gathers the
+ * forces of its incident pairs in a fixed order, so the result does not
+ * depend on the number of threads.
+ *
+ * @member dof Number of dofs
+ * @member force Force on the first particle of each pair, one array per dof
+ * @member capacity Number of pairs the storage has room for
+ * @member incident_start Offset of each particle in incident, num_particles+1
+ *                        long
+ * @member incident Pairs incident to each particle, k when the particle is
+ *                  first in pair k and ~k when it is second
+ * @member num_particles Number of particles incident_start has room for
+ * @member contact Contact store slot of each pair in contact, -1 for pairs
+ *                 apart, used by the contact laws with history
+ * @member stride Number of substeps each pair force stands for in a
+ *                sub-cycled run, see odem_subcycle, NULL otherwise; not
+ *                owned
+ */
+struct odem_pair_forces
+{
+    int dof;
+    double* force[ODEM_MAX_DOF];
+    int capacity;
+    int* incident_start;
+    int* incident;
+    int num_particles;
+    int* contact;
+    const int* stride;
+};
+
+/**
+ * Solver kernels specialised for a number of dofs
+ *
+ * Chosen once per run with odem_select_kernels, so the dof is never tested
+ * inside a time step.
+ *
+ * @member dof Number of dofs
+ * @member move Move every particle for a time step
+ * @member accel Accelerate every particle by its net force for a time step
+ * @member kick Accelerate the particles of the time step classes due at a
+ *             substep
+ * @member force_walls Accumulate wall contact forces
+ * @member force_pairs Accumulate spring contact forces over a pair list
+ * @member force_pairs_history Accumulate contact forces of a law with
+ *                             history over a pair list
+ * @member force_all_pairs Accumulate spring contact forces between every pair
+ */
+struct odem_kernels
+{
+    int dof;
+    void (*move)(struct odem_particles*, const double);
+    void (*accel)(struct odem_particles*, const double);
+    void (*kick)(struct odem_particles*, const int[], const int,
+        const double, const double[]);
+    int (*force_walls)(struct odem_particles*, const struct odem_walls*,
+        const struct odem_contact_model*);
+    int (*force_pairs)(struct odem_particles*, struct odem_pair_forces*,
+        const struct odem_pair_list*, const double,
+        const enum odem_contact_kernel);
+    int (*force_pairs_history)(struct odem_particles*,
+        struct odem_pair_forces*, const struct odem_pair_list*,
+        const struct odem_contact_model*, struct odem_contact_store*,
+        const double);
+    int (*force_all_pairs)(struct odem_particles*, const double);
+};
+
+
+// function interfaces
+struct odem_pair_forces* odem_alloc_pair_forces(const int, const int);
+void odem_dealloc_pair_forces(struct odem_pair_forces*);
+void odem_mpair_forces_index(struct odem_pair_forces*,
+    const struct odem_pair_list*, const int);
+
+const struct odem_kernels* odem_select_kernels(const int);
+void odem_mzero_forces(struct odem_particles*);
+
+/* dof specialised kernels, see force_kernels.h */
+#define ODEM_DECLARE_FORCE_KERNELS(dof) \
+    int ODEM_KERNEL_NAME(odem_mforce_walls, dof)(struct odem_particles*, \
+        const struct odem_walls*, const struct odem_contact_model*); \
+    int ODEM_KERNEL_NAME(odem_mforce_pairs, dof)(struct odem_particles*, \
+        struct odem_pair_forces*, const struct odem_pair_list*, \
+        const double, const enum odem_contact_kernel); \
+    int ODEM_KERNEL_NAME(odem_mforce_pairs_history, dof)( \
+        struct odem_particles*, struct odem_pair_forces*, \
+        const struct odem_pair_list*, const struct odem_contact_model*, \
+        struct odem_contact_store*, const double); \
+    int ODEM_KERNEL_NAME(odem_mforce_all_pairs, dof)( \
+        struct odem_particles*, const double);
+
+ODEM_DECLARE_FORCE_KERNELS(2)
+ODEM_DECLARE_FORCE_KERNELS(3)
+
+#endif  /* __FORCE_H */
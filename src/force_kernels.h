@@ -0,0 +1,496 @@
+/*
+ * Force kernels specialised for ODEM_KERNEL_DOF dofs
+ *
+ * Included by force.c once per supported dof, without an include guard.
+ */
+
+#ifndef ODEM_KERNEL_DOF
+#error "ODEM_KERNEL_DOF must be defined before including force_kernels.h"
+#endif
+
+/**
+ * Particle-wall collision model, spring or spring-dashpot; mutator
+ *
+ * The spring pushes the particle along the wall normal, the dashpot acts
+ * against the velocity of the particle relative to the wall along the
+ * normal. Its coefficient is that of a pair with the particle mass as its
+ * reduced mass. Walls have no friction. Finite walls are thin plates and
+ * push a particle back towards whichever side its centroid is on.
+ *
+ * @param force_vec Array to store the force vector in, zeroed without a
+ *                  collision
+ * @param parts Particle set
+ * @param index Index of particle
+ * @param wall Wall
+ * @param spring_constant Spring constant, k
+ * @param damping Dashpot coefficient over the square root of the mass, 0 for
+ *                a spring
+ * @return Whether or not a collision has occurred
+ */
+static int ODEM_KERNEL(odem_mforce_wall_collision)(double force_vec[],
+    const struct odem_particles* parts, const int index,
+    const struct odem_wall* wall, const double spring_constant,
+    const double damping)
+{
+    int i;
+    double offset[ODEM_KERNEL_DOF];
+    double dist = 0.0, side = 1.0, tangent2 = 0.0, delta, f, d, v_n = 0.0;
+
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+    {
+        force_vec[i] = 0.0;
+        offset[i] = parts->centroid[i][index] - wall->point[i];
+        dist += wall->normal[i] * offset[i];
+    }
+
+    if (wall->extent > 0)
+    {
+        for (i = 0; i < ODEM_KERNEL_DOF; i++)
+        {
+            d = offset[i] - dist * wall->normal[i];
+            tangent2 += d * d;
+        }
+        if (tangent2 > wall->extent * wall->extent) return 0;
+        if (dist < 0)
+        {
+            dist = -dist;
+            side = -1.0;
+        }
+    }
+
+    delta = dist - parts->radius[index];
+    if (delta >= 0) return 0;
+
+    f = -delta * spring_constant;
+    if (damping > 0)
+    {
+        for (i = 0; i < ODEM_KERNEL_DOF; i++)
+            v_n += (parts->velocity[i][index] - wall->velocity[i]) *
+                wall->normal[i];
+        f -= damping * sqrt(parts->mass[index]) * side * v_n;
+    }
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+        force_vec[i] = side * f * wall->normal[i];
+
+    return 1;
+}
+
+/**
+ * Accumulate the contact forces of the static or of the moving walls on a
+ * particle, mutator
+ *
+ * @param parts Particle set
+ * @param index Index of particle
+ * @param walls Set of walls
+ * @param moving Whether to check the moving walls rather than the static
+ *               ones
+ * @param spring_constant Spring constant, k
+ * @param damping Dashpot coefficient over the square root of the mass
+ * @return Whether or not the particle touches a wall
+ */
+static int ODEM_KERNEL(odem_mforce_particle_walls)(
+    struct odem_particles* parts, const int index,
+    const struct odem_walls* walls, const int moving,
+    const double spring_constant, const double damping)
+{
+    int i, w, collision = 0;
+    double force_vec[ODEM_KERNEL_DOF], total[ODEM_KERNEL_DOF] = {0.0};
+
+    for (w = 0; w < walls->num_walls; w++)
+    {
+        if (walls->walls[w].moving != moving) continue;
+        if (ODEM_KERNEL(odem_mforce_wall_collision)(force_vec, parts, index,
+            walls->walls + w, spring_constant, damping))
+        {
+            collision = 1;
+            for (i = 0; i < ODEM_KERNEL_DOF; i++)
+                total[i] += force_vec[i];
+        }
+    }
+
+    if (collision)
+        for (i = 0; i < ODEM_KERNEL_DOF; i++)
+            parts->force[i][index] += total[i];
+
+    return collision;
+}
+
+/**
+ * Accumulate wall contact forces, mutator
+ *
+ * Walls are a spring for the spring law and a spring-dashpot for the other
+ * laws. Static walls are only checked against the particles binned into the
+ * cells collected by odem_mwalls_cull, each particle belongs to one cell so
+ * the cells are shared out between threads without races. Moving walls are
+ * checked against every particle.
+ *
+ * @param parts Particle set
+ * @param walls Set of walls at the current time
+ * @param model Contact model
+ * @return Number of particles in contact with a static wall plus number of
+ *         particles in contact with a moving wall
+ */
+int ODEM_KERNEL(odem_mforce_walls)(struct odem_particles* parts,
+    const struct odem_walls* walls, const struct odem_contact_model* model)
+{
+    int c, i, collisions = 0;
+    const double k = model->spring_constant;
+    const double damping = model->law != ODEM_CONTACT_SPRING ?
+        model->damping : 0.0;
+    const struct odem_grid* grid = walls->grid;
+
+    if (walls->num_moving < walls->num_walls && grid != NULL)
+    {
+        #pragma omp parallel for schedule(static) reduction(+:collisions)
+        for (c = 0; c < walls->num_cells; c++)
+        {
+            int a;
+            const int cell = walls->cells[c];
+
+            for (a = grid->cell_start[cell]; a < grid->cell_start[cell+1];
+                a++)
+                collisions += ODEM_KERNEL(odem_mforce_particle_walls)(parts,
+                    grid->cell_particles[a], walls, 0, k, damping);
+        }
+    }
+    else if (walls->num_moving < walls->num_walls)
+    {
+        #pragma omp parallel for schedule(static) reduction(+:collisions)
+        for (i = 0; i < parts->num_particles; i++)
+            collisions += ODEM_KERNEL(odem_mforce_particle_walls)(parts, i,
+                walls, 0, k, damping);
+    }
+
+    if (walls->num_moving > 0)
+    {
+        #pragma omp parallel for schedule(static) reduction(+:collisions)
+        for (i = 0; i < parts->num_particles; i++)
+            collisions += ODEM_KERNEL(odem_mforce_particle_walls)(parts, i,
+                walls, 1, k, damping);
+    }
+
+    return collisions;
+}
+
+/**
+ * Gather the per-pair forces into the net force of every particle, mutator
+ *
+ * In a sub-cycled run each pair force counts for its stride.
+ *
+ * @param parts Particle set
+ * @param forces Pair force storage indexed for the pair list
+ * @param num_pairs Number of pairs to gather, only a leading part of the
+ *                  pair list may have been evaluated
+ */
+static void ODEM_KERNEL(odem_mgather_pair_forces)(struct odem_particles* parts,
+    const struct odem_pair_forces* forces, const int num_pairs)
+{
+    int i;
+
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        int j, entry, pair, k;
+        double weight = 1.0;
+
+        /* incident pairs are in ascending order */
+        for (entry = forces->incident_start[i];
+            entry < forces->incident_start[i+1]; entry++)
+        {
+            pair = forces->incident[entry];
+            k = pair >= 0 ? pair : ~pair;
+            if (k >= num_pairs) break;
+            if (forces->stride != NULL) weight = forces->stride[k];
+            if (pair >= 0)
+                for (j = 0; j < ODEM_KERNEL_DOF; j++)
+                    parts->force[j][i] += weight * forces->force[j][k];
+            else
+                for (j = 0; j < ODEM_KERNEL_DOF; j++)
+                    parts->force[j][i] -= weight * forces->force[j][k];
+        }
+    }
+}
+
+/**
+ * Accumulate spring contact forces over a pair list, mutator
+ *
+ * Pair forces are computed in parallel into per-pair storage, then each
+ * particle gathers its incident pairs, see odem_mpair_forces_index.
+ *
+ * @param parts Particle set
+ * @param forces Pair force storage indexed for the pair list
+ * @param pairs Pair list
+ * @param k Spring constant
+ * @param kernel Pair contact kernel
+ * @return Number of pairs in contact
+ */
+int ODEM_KERNEL(odem_mforce_pairs)(struct odem_particles* parts,
+    struct odem_pair_forces* forces, const struct odem_pair_list* pairs,
+    const double k, const enum odem_contact_kernel kernel)
+{
+    int p, collisions = 0;
+
+    if (kernel == ODEM_CONTACT_KERNEL_BATCH)
+    {
+        #pragma omp parallel for schedule(static) reduction(+:collisions)
+        for (p = 0; p < pairs->num_pairs; p += ODEM_PAIR_BLOCK)
+        {
+            int j;
+            double* block_force[ODEM_KERNEL_DOF];
+            const int count = pairs->num_pairs - p < ODEM_PAIR_BLOCK ?
+                pairs->num_pairs - p : ODEM_PAIR_BLOCK;
+
+            for (j = 0; j < ODEM_KERNEL_DOF; j++)
+                block_force[j] = forces->force[j] + p;
+            collisions += ODEM_KERNEL(odem_mforce_collision_spring_batch)(
+                block_force, parts, pairs->first + p, pairs->second + p, count,
+                k);
+        }
+    }
+    else
+    {
+        #pragma omp parallel for schedule(static) reduction(+:collisions)
+        for (p = 0; p < pairs->num_pairs; p++)
+        {
+            int j;
+            double force_vec[ODEM_KERNEL_DOF];
+
+            collisions += ODEM_KERNEL(odem_mforce_collision_spring)(force_vec,
+                parts, pairs->first[p], pairs->second[p], k);
+            for (j = 0; j < ODEM_KERNEL_DOF; j++)
+                forces->force[j][p] = force_vec[j];
+        }
+    }
+
+    ODEM_KERNEL(odem_mgather_pair_forces)(parts, forces, pairs->num_pairs);
+
+    return collisions;
+}
+
+/**
+ * Particle-particle collision model with history, spring-dashpot or
+ * spring-dashpot with Coulomb friction; mutator
+ *
+ * The normal force is (k*delta + gamma*(v_12*e_12))*e_12. With friction the
+ * tangential spring is projected onto the current tangent plane, stretched
+ * by the relative tangential velocity over the time step and capped at
+ * mu(v_r) times the repulsive part of the normal force, sliding otherwise.
+ *
+ * @param force_vec Array to store the force on particle 1 in
+ * @param parts Particle set
+ * @param p1 Index of particle 1, the particle of lower id
+ * @param p2 Index of particle 2
+ * @param model Contact model
+ * @param contact History of the pair, its tangential spring is advanced
+ * @param delta_time Time since the previous evaluation
+ */
+static void ODEM_KERNEL(odem_mforce_collision_history)(double force_vec[],
+    const struct odem_particles* parts, const int p1, const int p2,
+    const struct odem_contact_model* model, struct odem_contact* contact,
+    const double delta_time)
+{
+    int i;
+    double e12[ODEM_KERNEL_DOF], v12[ODEM_KERNEL_DOF];
+    double tangent[ODEM_KERNEL_DOF];
+    double v_n = 0.0, f_n, spring_n = 0.0, v_t2 = 0.0, f_t2 = 0.0, limit;
+
+    ODEM_KERNEL(odem_me12)(e12, parts, p1, p2);
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+    {
+        v12[i] = parts->velocity[i][p2] - parts->velocity[i][p1];
+        v_n += v12[i] * e12[i];
+    }
+    f_n = model->spring_constant * ODEM_KERNEL(odem_delta)(parts, p1, p2) +
+        contact->gamma * v_n;
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+        force_vec[i] = f_n * e12[i];
+    if (model->law != ODEM_CONTACT_FRICTION) return;
+
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+        spring_n += contact->spring[i] * e12[i];
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+    {
+        v12[i] -= v_n * e12[i];
+        v_t2 += v12[i] * v12[i];
+        contact->spring[i] += v12[i] * delta_time - spring_n * e12[i];
+        tangent[i] = model->tangential_constant * contact->spring[i];
+        f_t2 += tangent[i] * tangent[i];
+    }
+
+    /* sliding, the spring only keeps what friction holds; a repulsive
+     * normal force is negative, and a pair the dashpot pulls together
+     * holds no friction */
+    limit = odem_friction_coefficient(model, sqrt(v_t2)) *
+        (f_n < 0 ? -f_n : 0.0);
+    if (f_t2 > limit * limit)
+    {
+        limit /= sqrt(f_t2);
+        for (i = 0; i < ODEM_KERNEL_DOF; i++)
+        {
+            tangent[i] *= limit;
+            contact->spring[i] *= limit;
+        }
+    }
+
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+        force_vec[i] += tangent[i];
+}
+
+/**
+ * Accumulate contact forces of a law with history over a pair list, mutator
+ *
+ * Pairs are matched with their history in three passes: a parallel lookup
+ * of the pairs in contact, a serial insertion of the contacts that started
+ * this step and a parallel force evaluation into per-pair storage. Forces
+ * are then gathered as in odem_mforce_pairs. The dashpot coefficient of a
+ * pair is computed once, when its contact starts.
+ *
+ * @param parts Particle set
+ * @param forces Pair force storage indexed for the pair list
+ * @param pairs Pair list
+ * @param model Contact model
+ * @param store Contact store, advanced by one step
+ * @param delta_time Time since the previous evaluation, a substep in a
+ *                   sub-cycled run where each pair advances by its stride
+ * @return Number of pairs in contact
+ */
+int ODEM_KERNEL(odem_mforce_pairs_history)(struct odem_particles* parts,
+    struct odem_pair_forces* forces, const struct odem_pair_list* pairs,
+    const struct odem_contact_model* model, struct odem_contact_store* store,
+    const double delta_time)
+{
+    int p, collisions = 0, started = 0;
+    int* slot = forces->contact;
+    const int* stride = forces->stride;
+
+    store->step++;
+
+    /* slots of the pairs in contact, -2 for contacts that start this step;
+     * contacts that lapsed before this step start over */
+    #pragma omp parallel for schedule(static) \
+        reduction(+:collisions) reduction(+:started)
+    for (p = 0; p < pairs->num_pairs; p++)
+    {
+        int j;
+        struct odem_contact* contact;
+        const int p1 = pairs->first[p], p2 = pairs->second[p];
+
+        slot[p] = -1;
+        if (ODEM_KERNEL(odem_delta)(parts, p1, p2) >= 0) continue;
+        collisions++;
+
+        slot[p] = odem_contact_find(store, odem_contact_key(parts->id[p1],
+            parts->id[p2]));
+        if (slot[p] < 0)
+        {
+            slot[p] = -2;
+            started++;
+            continue;
+        }
+        contact = store->slots + slot[p];
+        if (contact->step < store->step - 1)
+        {
+            contact->gamma = odem_pair_damping(model, parts->mass[p1],
+                parts->mass[p2]);
+            for (j = 0; j < ODEM_MAX_DOF; j++)
+                contact->spring[j] = 0.0;
+        }
+        contact->step = store->step + (stride != NULL ? stride[p] - 1 : 0);
+    }
+
+    /* contacts that started, serially as they change the table */
+    if (started > 0)
+    {
+        if (odem_mcontact_store_reserve(store, started))
+        {
+            #pragma omp parallel for schedule(static)
+            for (p = 0; p < pairs->num_pairs; p++)
+                if (slot[p] >= 0)
+                    slot[p] = odem_contact_find(store, odem_contact_key(
+                        parts->id[pairs->first[p]],
+                        parts->id[pairs->second[p]]));
+        }
+        for (p = 0; p < pairs->num_pairs; p++)
+        {
+            if (slot[p] != -2) continue;
+            slot[p] = odem_mcontact_insert(store, odem_contact_key(
+                parts->id[pairs->first[p]], parts->id[pairs->second[p]]),
+                odem_pair_damping(model, parts->mass[pairs->first[p]],
+                parts->mass[pairs->second[p]]));
+            if (stride != NULL) store->slots[slot[p]].step += stride[p] - 1;
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (p = 0; p < pairs->num_pairs; p++)
+    {
+        int j;
+        double force_vec[ODEM_KERNEL_DOF];
+        const int p1 = pairs->first[p], p2 = pairs->second[p];
+        const double pair_time = stride != NULL ? stride[p] * delta_time :
+            delta_time;
+
+        if (slot[p] < 0)
+        {
+            for (j = 0; j < ODEM_KERNEL_DOF; j++)
+                forces->force[j][p] = 0.0;
+            continue;
+        }
+
+        /* the history is seen from the particle of lower id */
+        if (parts->id[p1] < parts->id[p2])
+        {
+            ODEM_KERNEL(odem_mforce_collision_history)(force_vec, parts, p1,
+                p2, model, store->slots + slot[p], pair_time);
+            for (j = 0; j < ODEM_KERNEL_DOF; j++)
+                forces->force[j][p] = force_vec[j];
+        }
+        else
+        {
+            ODEM_KERNEL(odem_mforce_collision_history)(force_vec, parts, p2,
+                p1, model, store->slots + slot[p], pair_time);
+            for (j = 0; j < ODEM_KERNEL_DOF; j++)
+                forces->force[j][p] = -force_vec[j];
+        }
+    }
+
+    ODEM_KERNEL(odem_mgather_pair_forces)(parts, forces, pairs->num_pairs);
+
+    return collisions;
+}
+
+/**
+ * Accumulate spring contact forces between every pair of particles, mutator
+ *
+ * Each particle sums the forces from every other particle, so each pair is
+ * evaluated twice but no two threads write the same particle.
+ *
+ * @param parts Particle set
+ * @param k Spring constant
+ * @return Number of pairs in contact
+ */
+int ODEM_KERNEL(odem_mforce_all_pairs)(struct odem_particles* parts,
+    const double k)
+{
+    int i, collisions = 0;
+
+    #pragma omp parallel for schedule(dynamic, 64) reduction(+:collisions)
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        int j, other, collision;
+        double force_vec[ODEM_KERNEL_DOF];
+
+        for (other = 0; other < parts->num_particles; other++)
+        {
+            if (other == i) continue;
+            collision = ODEM_KERNEL(odem_mforce_collision_spring)(force_vec,
+                parts, i, other, k);
+            if (!collision) continue;
+            if (other > i) collisions++;
+            for (j = 0; j < ODEM_KERNEL_DOF; j++)
+                parts->force[j][i] += force_vec[j];
+        }
+    }
+
+    return collisions;
+}
@@ -0,0 +1,594 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+#include "debug.h"
+#include "frames.h"
+#include "recorder.h"
+
+/* first bytes of a frame file */
+static const char odem_frame_magic[8] = { 'O', 'D', 'E', 'M', 'F', 'R', 'M',
+    '\0' };
+
+#define ODEM_FRAME_BYTE_ORDER 0x01020304u
+#define ODEM_FRAME_VERSION 1u
+#define ODEM_FRAME_TAG 0x314d5246u
+#define ODEM_FRAME_SLEEP_TAG 0x324d5246u
+
+/* stdio buffer of a frame writer */
+#define ODEM_FRAME_BUFFER (1 << 20)
+
+/* particle ids are stored as 32 bit integers */
+typedef char odem_frame_int_is_32_bits[sizeof(int) == 4 ? 1 : -1];
+
+/**
+ * Exit with an error message about a frame file
+ *
+ * @param what Description of the error
+ */
+static void odem_frame_error(const char* what)
+{
+    errno = 0;
+    die(what);
+}
+
+/**
+ * Number of fields in a field mask
+ *
+ * @param fields Bit mask of fields
+ * @return Number of fields
+ */
+static int odem_frame_num_fields(const unsigned int fields)
+{
+    int i, count = 0;
+
+    for (i = 0; i < ODEM_NUM_FIELDS; i++)
+        if (fields & ODEM_FIELD_MASK(i)) count++;
+    return count;
+}
+
+/**
+ * Bytes taken by the particle id column of a frame, padded to 8
+ *
+ * @param num_rows Number of particles in the frame
+ * @return Padded size of the id column
+ */
+static uint64_t odem_frame_id_bytes(const int num_rows)
+{
+    return ((uint64_t)num_rows * sizeof(int32_t) + 7) / 8 * 8;
+}
+
+/**
+ * Size of a frame
+ *
+ * @param num_rows Number of particles in the frame
+ * @param dof Number of dofs of each field
+ * @param fields Bit mask of fields in the frame
+ * @return Number of bytes of the frame including its header
+ */
+static uint64_t odem_frame_size(const int num_rows, const int dof,
+    const unsigned int fields)
+{
+    return sizeof(struct odem_frame_record) + odem_frame_id_bytes(num_rows) +
+        (uint64_t)odem_frame_num_fields(fields) * dof * num_rows *
+        sizeof(double);
+}
+
+/**
+ * Bytes taken by the sleep block of a frame, see frames.h
+ *
+ * @param num_changes Number of particles that fell asleep or woke up
+ * @return Size of the sleep block including its count
+ */
+static uint64_t odem_frame_sleep_bytes(const int num_changes)
+{
+    return 2 * sizeof(int32_t) + odem_frame_id_bytes(num_changes);
+}
+
+/**
+ * Read a block of a frame file, exiting on a short read
+ *
+ * @param file Frame file
+ * @param offset Offset of the block
+ * @param data Buffer to read into
+ * @param size Number of bytes to read
+ */
+static void odem_frame_read(FILE* file, const uint64_t offset, void* data,
+    const size_t size)
+{
+    if (fseeko(file, (off_t)offset, SEEK_SET) != 0 ||
+        (size > 0 && fread(data, 1, size, file) != size))
+        odem_frame_error("Truncated frame file.");
+}
+
+/**
+ * Read and check the header of a frame file
+ *
+ * @param file Frame file
+ * @param header Header to fill
+ */
+static void odem_frame_read_header(FILE* file,
+    struct odem_frame_file_header* header)
+{
+    odem_frame_read(file, 0, header, sizeof(*header));
+    if (memcmp(header->magic, odem_frame_magic, sizeof(odem_frame_magic)) != 0)
+        odem_frame_error("Not a frame file.");
+    if (header->byte_order != ODEM_FRAME_BYTE_ORDER)
+        odem_frame_error("Frame file was written with another byte order.");
+    if (header->version != ODEM_FRAME_VERSION)
+        odem_frame_error("Unsupported frame file version.");
+    if (header->dof != 2 && header->dof != 3)
+        odem_frame_error("Frame file is neither 2D nor 3D.");
+}
+
+/**
+ * Append an entry to a frame index, growing it as needed
+ *
+ * @param index Pointer to the frame index
+ * @param num_frames Pointer to the number of frames
+ * @param capacity Pointer to the number of entries there is room for
+ * @param time Time of step
+ * @param offset Offset of the frame
+ */
+static void odem_frame_index_push(struct odem_frame_entry** index,
+    int* num_frames, int* capacity, const double time, const uint64_t offset)
+{
+    if (*num_frames == *capacity)
+    {
+        *capacity = *capacity > 0 ? 2 * *capacity : 64;
+        *index = (struct odem_frame_entry*)realloc(*index,
+            *capacity * sizeof(struct odem_frame_entry));
+        if (*index == NULL) die("Memory allocation error");
+    }
+    (*index)[*num_frames].time = time;
+    (*index)[*num_frames].offset = offset;
+    (*num_frames)++;
+}
+
+/**
+ * Load the frame index of a frame file, rebuilding it from the frames when
+ * the file was not closed or its index was cut off
+ *
+ * @param file Frame file
+ * @param header File header
+ * @param index Pointer to store the frame index in
+ * @param num_frames Pointer to store the number of frames in
+ * @param capacity Pointer to store the index capacity in
+ * @return Offset just past the last complete frame
+ */
+static uint64_t odem_frame_load_index(FILE* file,
+    const struct odem_frame_file_header* header,
+    struct odem_frame_entry** index, int* num_frames, int* capacity)
+{
+    uint64_t offset, size, end;
+    struct odem_frame_record record;
+    int32_t changes[2];
+
+    *index = NULL;
+    *num_frames = 0;
+    *capacity = 0;
+
+    if (fseeko(file, 0, SEEK_END) != 0) odem_frame_error("Bad frame file.");
+    end = (uint64_t)ftello(file);
+
+    if (header->index_offset != 0 && header->index_offset +
+        header->num_frames * sizeof(struct odem_frame_entry) <= end)
+    {
+        *capacity = header->num_frames > 0 ? (int)header->num_frames : 1;
+        *index = (struct odem_frame_entry*)malloc(*capacity *
+            sizeof(struct odem_frame_entry));
+        if (*index == NULL) die("Memory allocation error");
+        odem_frame_read(file, header->index_offset, *index,
+            header->num_frames * sizeof(struct odem_frame_entry));
+        *num_frames = (int)header->num_frames;
+        return header->index_offset;
+    }
+
+    /* walk the frames up to the first incomplete one */
+    offset = header->frames_offset;
+    if (offset == 0)
+        return header->particle_offset != 0 ? header->particle_offset +
+            2 * (uint64_t)header->num_particles * sizeof(double) :
+            sizeof(*header);
+
+    while (offset + sizeof(record) <= end)
+    {
+        odem_frame_read(file, offset, &record, sizeof(record));
+        if ((record.tag != ODEM_FRAME_TAG &&
+            record.tag != ODEM_FRAME_SLEEP_TAG) || record.num_rows < 0)
+            break;
+        size = odem_frame_size(record.num_rows, header->dof, header->fields);
+        if (record.tag == ODEM_FRAME_SLEEP_TAG)
+        {
+            if (offset + sizeof(record) + sizeof(changes) > end) break;
+            odem_frame_read(file, offset + sizeof(record), changes,
+                sizeof(changes));
+            if (changes[0] < 0) break;
+            size += odem_frame_sleep_bytes(changes[0]);
+        }
+        if (offset + size > end) break;
+        odem_frame_index_push(index, num_frames, capacity, record.time,
+            offset);
+        offset += size;
+    }
+
+    return offset;
+}
+
+/* frame recorder */
+
+/**
+ * State of a frame recorder
+ *
+ * @member file Frame file
+ * @member header File header, rewritten as it changes
+ * @member index Frame index
+ * @member num_frames Number of frames written
+ * @member capacity Number of index entries there is room for
+ * @member end Offset of the end of the file
+ */
+struct odem_frame_writer
+{
+    FILE* file;
+    struct odem_frame_file_header header;
+    struct odem_frame_entry* index;
+    int num_frames;
+    int capacity;
+    uint64_t end;
+};
+
+/**
+ * Write a block at the end of a frame file
+ *
+ * @param writer Frame writer
+ * @param data Block to write
+ * @param size Number of bytes to write
+ */
+static void odem_frame_append(struct odem_frame_writer* writer,
+    const void* data, const size_t size)
+{
+    if (size > 0 && fwrite(data, 1, size, writer->file) != size)
+        die("Could not write frame file");
+    writer->end += size;
+}
+
+/**
+ * Rewrite the header of a frame file in place
+ *
+ * @param writer Frame writer
+ */
+static void odem_frame_write_header(struct odem_frame_writer* writer)
+{
+    if (fseeko(writer->file, 0, SEEK_SET) != 0 ||
+        fwrite(&writer->header, sizeof(writer->header), 1, writer->file) != 1 ||
+        fseeko(writer->file, (off_t)writer->end, SEEK_SET) != 0)
+        die("Could not write frame file");
+}
+
+static void odem_frame_recorder_init(void* impl)
+{
+    struct odem_frame_writer* writer = (struct odem_frame_writer*)impl;
+    const int dof = writer->header.dof;
+    const unsigned int fields = writer->header.fields;
+
+    memset(&writer->header, 0, sizeof(writer->header));
+    memcpy(writer->header.magic, odem_frame_magic, sizeof(odem_frame_magic));
+    writer->header.byte_order = ODEM_FRAME_BYTE_ORDER;
+    writer->header.version = ODEM_FRAME_VERSION;
+    writer->header.dof = dof;
+    writer->header.fields = fields;
+
+    writer->end = 0;
+    writer->num_frames = 0;
+    if (fseeko(writer->file, 0, SEEK_SET) != 0 ||
+        ftruncate(fileno(writer->file), 0) != 0)
+        die("Could not write frame file");
+    odem_frame_append(writer, &writer->header, sizeof(writer->header));
+}
+
+static void odem_frame_recorder_particle_data(void* impl,
+    const struct odem_particles* parts)
+{
+    struct odem_frame_writer* writer = (struct odem_frame_writer*)impl;
+    const size_t n = (size_t)parts->num_particles;
+
+    writer->header.particle_offset = writer->end;
+    writer->header.num_particles = parts->num_particles;
+    odem_frame_append(writer, parts->mass, n * sizeof(double));
+    odem_frame_append(writer, parts->radius, n * sizeof(double));
+    odem_frame_write_header(writer);
+}
+
+static void odem_frame_recorder_model_data(void* impl, const int iters,
+    const double delta_time, const double bounds[])
+{
+    int i;
+    struct odem_frame_writer* writer = (struct odem_frame_writer*)impl;
+
+    writer->header.iters = iters;
+    writer->header.delta_time = delta_time;
+    for (i = 0; i < 2*writer->header.dof; i++)
+        writer->header.bounds[i] = bounds[i];
+    odem_frame_write_header(writer);
+}
+
+static void odem_frame_recorder_motion(void* impl,
+    const struct odem_snapshot* snap)
+{
+    int i, j;
+    struct odem_frame_record record;
+    struct odem_frame_writer* writer = (struct odem_frame_writer*)impl;
+    const int rows = snap->num_particles;
+    const int32_t changes[2] = { snap->num_sleep_changes, 0 };
+    const unsigned int fields = writer->header.fields;
+    static const char zeros[8] = { 0 };
+
+    if (writer->header.frames_offset == 0)
+    {
+        writer->header.frames_offset = writer->end;
+        odem_frame_write_header(writer);
+    }
+    odem_frame_index_push(&writer->index, &writer->num_frames,
+        &writer->capacity, snap->time, writer->end);
+
+    record.tag = changes[0] > 0 ? ODEM_FRAME_SLEEP_TAG : ODEM_FRAME_TAG;
+    record.num_rows = rows;
+    record.time = snap->time;
+    odem_frame_append(writer, &record, sizeof(record));
+    if (changes[0] > 0)
+    {
+        odem_frame_append(writer, changes, sizeof(changes));
+        odem_frame_append(writer, snap->sleep_change,
+            changes[0] * sizeof(int32_t));
+        odem_frame_append(writer, zeros, odem_frame_id_bytes(changes[0]) -
+            changes[0] * sizeof(int32_t));
+    }
+    odem_frame_append(writer, snap->particle_id, rows * sizeof(int32_t));
+    odem_frame_append(writer, zeros, odem_frame_id_bytes(rows) -
+        rows * sizeof(int32_t));
+    for (i = 0; i < ODEM_NUM_FIELDS; i++)
+    {
+        if (!(fields & ODEM_FIELD_MASK(i))) continue;
+        for (j = 0; j < writer->header.dof; j++)
+            odem_frame_append(writer, snap->data[i][j], rows * sizeof(double));
+    }
+}
+
+static void odem_frame_recorder_commit(void* impl)
+{
+    struct odem_frame_writer* writer = (struct odem_frame_writer*)impl;
+
+    if (fflush(writer->file) != 0 || fsync(fileno(writer->file)) != 0)
+        die("Could not write frame file");
+}
+
+static void odem_frame_recorder_truncate(void* impl, const double time)
+{
+    int k;
+    struct odem_frame_writer* writer = (struct odem_frame_writer*)impl;
+
+    for (k = 0; k < writer->num_frames && writer->index[k].time <= time; k++);
+    if (k == writer->num_frames) return;
+
+    writer->end = writer->index[k].offset;
+    writer->num_frames = k;
+    if (fflush(writer->file) != 0 ||
+        ftruncate(fileno(writer->file), (off_t)writer->end) != 0 ||
+        fseeko(writer->file, (off_t)writer->end, SEEK_SET) != 0)
+        die("Could not truncate frame file");
+}
+
+static void odem_frame_recorder_close(void* impl)
+{
+    struct odem_frame_writer* writer = (struct odem_frame_writer*)impl;
+
+    /* the index goes last, a file without one is rebuilt by walking it */
+    writer->header.index_offset = writer->end;
+    writer->header.num_frames = (uint64_t)writer->num_frames;
+    odem_frame_append(writer, writer->index,
+        writer->num_frames * sizeof(struct odem_frame_entry));
+    odem_frame_write_header(writer);
+
+    if (fclose(writer->file) != 0) die("Could not write frame file");
+    free(writer->index);
+    free(writer);
+}
+
+/**
+ * Allocate a recorder appending frames to a frame file on the heap
+ *
+ * A new file is created unless appending, in which case frames are added
+ * after the last complete frame of the existing file.
+ *
+ * @param path Path of the frame file
+ * @param dof Number of dofs
+ * @param fields Bit mask of recorded fields
+ * @param append Whether or not to append to an existing file
+ * @return Pointer to a new recorder
+ */
+struct odem_recorder* odem_alloc_frame_recorder(const char* path,
+    const int dof, const unsigned int fields, const int append)
+{
+    struct odem_frame_writer* impl = (struct odem_frame_writer*)malloc(
+        sizeof(struct odem_frame_writer));
+    struct odem_recorder* new_rec = (struct odem_recorder*)malloc(
+        sizeof(struct odem_recorder));
+    if (impl == NULL || new_rec == NULL) die("Memory allocation error");
+
+    impl->file = fopen(path, append ? "r+b" : "w+b");
+    if (impl->file == NULL) die("Could not open frame file");
+    setvbuf(impl->file, NULL, _IOFBF, ODEM_FRAME_BUFFER);
+
+    memset(&impl->header, 0, sizeof(impl->header));
+    impl->header.dof = dof;
+    impl->header.fields = fields;
+    impl->index = NULL;
+    impl->num_frames = 0;
+    impl->capacity = 0;
+    impl->end = 0;
+
+    if (append)
+    {
+        odem_frame_read_header(impl->file, &impl->header);
+        if (impl->header.dof != dof || impl->header.fields != fields)
+            odem_frame_error("Frame file records other fields.");
+        impl->end = odem_frame_load_index(impl->file, &impl->header,
+            &impl->index, &impl->num_frames, &impl->capacity);
+
+        /* drop the index and any partial frame, they are rewritten */
+        impl->header.index_offset = 0;
+        impl->header.num_frames = 0;
+        if (fflush(impl->file) != 0 ||
+            ftruncate(fileno(impl->file), (off_t)impl->end) != 0)
+            die("Could not truncate frame file");
+        odem_frame_write_header(impl);
+    }
+
+    new_rec->impl = impl;
+    new_rec->init = odem_frame_recorder_init;
+    new_rec->particle_data = odem_frame_recorder_particle_data;
+    new_rec->model_data = odem_frame_recorder_model_data;
+    new_rec->motion = odem_frame_recorder_motion;
+    new_rec->commit = odem_frame_recorder_commit;
+    new_rec->truncate = odem_frame_recorder_truncate;
+    new_rec->profile = NULL;
+    new_rec->stats = NULL;
+    new_rec->close = odem_frame_recorder_close;
+
+    return new_rec;
+}
+
+/* frame reader */
+
+/**
+ * Open a frame file for reading, allocated on the heap
+ *
+ * @param path Path of the frame file
+ * @return Pointer to a new frame reader
+ */
+struct odem_frame_reader* odem_alloc_frame_reader(const char* path)
+{
+    int capacity;
+
+    struct odem_frame_reader* new_reader = (struct odem_frame_reader*)malloc(
+        sizeof(struct odem_frame_reader));
+    if (new_reader == NULL) die("Memory allocation error");
+
+    new_reader->file = fopen(path, "rb");
+    if (new_reader->file == NULL) die("Could not open frame file");
+    odem_frame_read_header(new_reader->file, &new_reader->header);
+    odem_frame_load_index(new_reader->file, &new_reader->header,
+        &new_reader->index, &new_reader->num_frames, &capacity);
+
+    return new_reader;
+}
+
+/**
+ * Close a frame file and free memory from its reader
+ *
+ * @param reader Pointer to frame reader
+ */
+void odem_dealloc_frame_reader(struct odem_frame_reader* reader)
+{
+    fclose(reader->file);
+    free(reader->index);
+    free(reader);
+}
+
+/**
+ * Read the particle block of a frame file into a particle set, mutator
+ *
+ * Only masses and radii are recorded, the other attributes are zeroed.
+ *
+ * @param reader Frame reader
+ * @param parts Particle set with room for the recorded particles
+ */
+void odem_read_frame_particles(struct odem_frame_reader* reader,
+    struct odem_particles* parts)
+{
+    int i;
+    double zero[ODEM_MAX_DOF] = { 0.0 };
+    const int n = reader->header.num_particles;
+
+    if (n > parts->capacity)
+        odem_frame_error("Particle set too small for the frame file.");
+    if (parts->dof != reader->header.dof)
+        odem_frame_error("Particle set dof does not match the frame file.");
+
+    parts->num_particles = 0;
+    for (i = 0; i < n; i++)
+        odem_mparticles_push(parts, 0.0, 0.0, zero, zero);
+    if (n == 0 || reader->header.particle_offset == 0) return;
+
+    odem_frame_read(reader->file, reader->header.particle_offset, parts->mass,
+        n * sizeof(double));
+    odem_frame_read(reader->file, reader->header.particle_offset +
+        n * sizeof(double), parts->radius, n * sizeof(double));
+}
+
+/**
+ * Read one frame into a snapshot, mutator
+ *
+ * @param reader Frame reader
+ * @param k Index of the frame
+ * @param snap Snapshot holding at least the recorded fields
+ */
+void odem_read_frame(struct odem_frame_reader* reader, const int k,
+    struct odem_snapshot* snap)
+{
+    int i, j;
+    uint64_t offset;
+    struct odem_frame_record record;
+    int32_t changes[2] = { 0, 0 };
+    const unsigned int fields = reader->header.fields;
+
+    if (k < 0 || k >= reader->num_frames)
+        odem_frame_error("Frame index out of range.");
+
+    offset = reader->index[k].offset;
+    odem_frame_read(reader->file, offset, &record, sizeof(record));
+    if (record.tag != ODEM_FRAME_TAG && record.tag != ODEM_FRAME_SLEEP_TAG)
+        odem_frame_error("Corrupt frame.");
+    offset += sizeof(record);
+    if (record.tag == ODEM_FRAME_SLEEP_TAG)
+    {
+        odem_frame_read(reader->file, offset, changes, sizeof(changes));
+        if (changes[0] < 0) odem_frame_error("Corrupt frame.");
+        if (changes[0] > snap->capacity)
+            odem_frame_error("Snapshot too small for the frame.");
+        odem_frame_read(reader->file, offset + sizeof(changes),
+            snap->sleep_change, changes[0] * sizeof(int32_t));
+        offset += odem_frame_sleep_bytes(changes[0]);
+    }
+    if (record.num_rows > snap->capacity)
+        odem_frame_error("Snapshot too small for the frame.");
+    if (snap->dof != reader->header.dof)
+        odem_frame_error("Snapshot dof does not match the frame file.");
+
+    snap->time = record.time;
+    snap->num_particles = record.num_rows;
+    snap->num_sleep_changes = changes[0];
+    odem_frame_read(reader->file, offset, snap->particle_id,
+        record.num_rows * sizeof(int32_t));
+    offset += odem_frame_id_bytes(record.num_rows);
+    if (fseeko(reader->file, (off_t)offset, SEEK_SET) != 0)
+        odem_frame_error("Truncated frame file.");
+
+    /* the columns follow each other, read them sequentially */
+    for (i = 0; i < ODEM_NUM_FIELDS; i++)
+    {
+        if (!(fields & ODEM_FIELD_MASK(i))) continue;
+        if (snap->data[i][0] == NULL)
+            odem_frame_error("Snapshot lacks a recorded field.");
+        for (j = 0; j < reader->header.dof; j++)
+        {
+            if (record.num_rows > 0 &&
+                fread(snap->data[i][j], sizeof(double), record.num_rows,
+                reader->file) != (size_t)record.num_rows)
+                odem_frame_error("Truncated frame file.");
+        }
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef __FRAMES_H
+
+#define __FRAMES_H 1
+
+#include <stdio.h>
+#include <stdint.h>
+#include "particle.h"
+#include "record.h"
+
+/*
+ * Frame file layout, native byte order
+ *
+ *   file header   struct odem_frame_file_header
+ *   particles     mass and radius columns, num_particles doubles each
+ *   frames        struct odem_frame_record, the particle id column padded to
+ *                 8 bytes, then one column of num_rows doubles per recorded
+ *                 field and dof, in field order; a frame tagged as a sleep
+ *                 frame has a sleep block between its record and its id
+ *                 column: the number of sleep changes and a zero as 32 bit
+ *                 integers, then the sleep changes of the snapshot padded
+ *                 to 8 bytes
+ *   frame index   one struct odem_frame_entry per frame, written on close
+ *
+ * A file that was not closed has no index, readers rebuild it by walking the
+ * frames.
+ */
+
+// data structures
+
+/**
+ * Header of a frame file
+ *
+ * @member magic File magic
+ * @member byte_order Byte order marker
+ * @member version Format version
+ * @member dof Number of dofs of the recorded fields
+ * @member fields Bit mask of recorded fields, see ODEM_FIELD_MASK
+ * @member num_particles Number of particles in the particle block
+ * @member iters Number of iterations
+ * @member delta_time Size of time step
+ * @member bounds Array of boundary values, room for three dofs
+ * @member particle_offset Offset of the particle block, 0 if none
+ * @member frames_offset Offset of the first frame, 0 if none
+ * @member index_offset Offset of the frame index, 0 if the file is open
+ * @member num_frames Number of frames in the index
+ */
+struct odem_frame_file_header
+{
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    int32_t dof;
+    uint32_t fields;
+    int32_t num_particles;
+    int32_t iters;
+    double delta_time;
+    double bounds[6];
+    uint64_t particle_offset;
+    uint64_t frames_offset;
+    uint64_t index_offset;
+    uint64_t num_frames;
+    char padding[8];
+};
+
+/**
+ * Header of a frame
+ *
+ * @member tag Frame marker
+ * @member num_rows Number of particles in the frame
+ * @member time Time of step
+ */
+struct odem_frame_record
+{
+    uint32_t tag;
+    int32_t num_rows;
+    double time;
+};
+
+/**
+ * Frame index entry
+ *
+ * @member time Time of step
+ * @member offset Offset of the frame in the file
+ */
+struct odem_frame_entry
+{
+    double time;
+    uint64_t offset;
+};
+
+/**
+ * Random access reader of a frame file
+ *
+ * @member file Frame file
+ * @member header File header
+ * @member index Frame index
+ * @member num_frames Number of frames
+ */
+struct odem_frame_reader
+{
+    FILE* file;
+    struct odem_frame_file_header header;
+    struct odem_frame_entry* index;
+    int num_frames;
+};
+
+
+// function interfaces
+struct odem_frame_reader* odem_alloc_frame_reader(const char*);
+void odem_dealloc_frame_reader(struct odem_frame_reader*);
+void odem_read_frame_particles(struct odem_frame_reader*,
+    struct odem_particles*);
+void odem_read_frame(struct odem_frame_reader*, const int,
+    struct odem_snapshot*);
+
+#endif  /* __FRAMES_H */
@@ -0,0 +1,488 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "debug.h"
+#include "grid.h"
+
+/* upper bound on the number of cells per binned particle */
+#define ODEM_GRID_CELLS_PER_PARTICLE 4
+
+/* bits per coordinate of a 64 bit Morton code */
+#define ODEM_MORTON_BITS(dof) ((dof) == 2 ? 32 : 21)
+
+/**
+ * Morton code of a particle and its index, sorted together
+ *
+ * @member code Morton code of the centroid
+ * @member index Index of the particle
+ */
+struct odem_morton_entry
+{
+    uint64_t code;
+    int index;
+};
+
+/**
+ * Set the number of cells along each dof for a given cell size
+ *
+ * @param grid Grid to size
+ * @param bounds Array containing boundaries
+ * @param cell_size Minimum edge length of a cell
+ * @return Total number of cells
+ */
+static long odem_grid_size_cells(struct odem_grid* grid, const double bounds[],
+    const double cell_size)
+{
+    int i;
+    long num_cells = 1;
+
+    for (i = 0; i < grid->dof; i++)
+    {
+        grid->origin[i] = bounds[2*i];
+        grid->first[i] = 0;
+        grid->dims[i] = (int)floor((bounds[2*i+1] - bounds[2*i]) / cell_size);
+        if (grid->dims[i] < 1) grid->dims[i] = 1;
+        grid->cell_size[i] = (bounds[2*i+1] - bounds[2*i]) / grid->dims[i];
+        if (grid->cell_size[i] < cell_size) grid->cell_size[i] = cell_size;
+        num_cells *= grid->dims[i];
+    }
+
+    return num_cells;
+}
+
+/**
+ * Allocate a uniform grid on the heap
+ *
+ * Cells are at least cell_size wide so that any two particles in contact
+ * are binned into the same or neighbouring cells. The cell size is grown
+ * when the domain would otherwise need an excessive number of cells.
+ *
+ * @param dof Number of dofs
+ * @param bounds Array containing boundaries
+ * @param cell_size Minimum edge length of a cell, i.e. the contact cutoff
+ * @param capacity Number of particles to make room for
+ * @return Pointer to a new grid
+ */
+struct odem_grid* odem_alloc_grid(const int dof, const double bounds[],
+    const double cell_size, const int capacity)
+{
+    long num_cells, max_cells;
+    double size = cell_size;
+
+    if (cell_size <= 0) die("Grid cell size must be positive.");
+
+    struct odem_grid* new_grid = (struct odem_grid*)malloc(
+        sizeof(struct odem_grid));
+    if (new_grid == NULL) die("Memory allocation error");
+
+    new_grid->dof = dof;
+    max_cells = (long)ODEM_GRID_CELLS_PER_PARTICLE * (capacity > 0 ?
+        capacity : 1);
+    num_cells = odem_grid_size_cells(new_grid, bounds, size);
+    while (num_cells > max_cells)
+    {
+        size *= 2.0;
+        num_cells = odem_grid_size_cells(new_grid, bounds, size);
+    }
+
+    new_grid->num_cells = (int)num_cells;
+    new_grid->num_particles = 0;
+    new_grid->capacity = capacity;
+    new_grid->cell_start = (int*)malloc((num_cells + 1) * sizeof(int));
+    new_grid->cell_particles = (int*)malloc(capacity * sizeof(int));
+    new_grid->particle_cell = (int*)malloc(capacity * sizeof(int));
+    if (new_grid->cell_start == NULL || new_grid->cell_particles == NULL ||
+        new_grid->particle_cell == NULL)
+        die("Memory allocation error");
+
+    return new_grid;
+}
+
+/**
+ * Allocate a grid on the heap covering a range of the cells of another grid
+ * along its last dof
+ *
+ * The cells keep their place in the other grid, so both grids bin a particle
+ * into the same cell. Particles outside of the range are binned into its
+ * edge cells.
+ *
+ * @param grid Grid to cut the range from
+ * @param first First cell of the range along the last dof
+ * @param count Number of cells in the range along the last dof
+ * @param capacity Number of particles to make room for
+ * @return Pointer to a new grid
+ */
+struct odem_grid* odem_alloc_grid_range(const struct odem_grid* grid,
+    const int first, const int count, const int capacity)
+{
+    int i;
+    const int last = grid->dof - 1;
+
+    if (first < 0 || count < 1 || first + count > grid->dims[last])
+        die("Grid range out of bounds.");
+
+    struct odem_grid* new_grid = (struct odem_grid*)malloc(
+        sizeof(struct odem_grid));
+    if (new_grid == NULL) die("Memory allocation error");
+
+    *new_grid = *grid;
+    new_grid->dims[last] = count;
+    new_grid->first[last] = grid->first[last] + first;
+    new_grid->num_cells = 1;
+    for (i = 0; i < new_grid->dof; i++)
+        new_grid->num_cells *= new_grid->dims[i];
+
+    new_grid->num_particles = 0;
+    new_grid->capacity = capacity > 0 ? capacity : 1;
+    new_grid->cell_start = (int*)malloc((new_grid->num_cells + 1) *
+        sizeof(int));
+    new_grid->cell_particles = (int*)malloc(new_grid->capacity * sizeof(int));
+    new_grid->particle_cell = (int*)malloc(new_grid->capacity * sizeof(int));
+    if (new_grid->cell_start == NULL || new_grid->cell_particles == NULL ||
+        new_grid->particle_cell == NULL)
+        die("Memory allocation error");
+
+    return new_grid;
+}
+
+/**
+ * Free memory from a grid
+ *
+ * @param grid Pointer to grid
+ */
+void odem_dealloc_grid(struct odem_grid* grid)
+{
+    free(grid->cell_start);
+    free(grid->cell_particles);
+    free(grid->particle_cell);
+    free(grid);
+}
+
+/**
+ * Make room for binning a number of particles, mutator
+ *
+ * @param grid Grid
+ * @param capacity Number of particles to make room for
+ */
+void odem_mgrid_reserve(struct odem_grid* grid, const int capacity)
+{
+    if (capacity <= grid->capacity) return;
+
+    grid->capacity = capacity;
+    grid->cell_particles = (int*)realloc(grid->cell_particles,
+        capacity * sizeof(int));
+    grid->particle_cell = (int*)realloc(grid->particle_cell,
+        capacity * sizeof(int));
+    if (grid->cell_particles == NULL || grid->particle_cell == NULL)
+        die("Memory allocation error");
+}
+
+/**
+ * Bin particles into grid cells with a counting sort, mutator
+ *
+ * Particles outside of the boundaries are binned into the nearest edge cell.
+ *
+ * @param grid Grid to bin particles into
+ * @param parts Particle set
+ */
+void odem_mgrid_bin(struct odem_grid* grid, const struct odem_particles* parts)
+{
+    int i, j, cell, coord;
+    const int num_particles = parts->num_particles;
+
+    if (num_particles > grid->capacity) die("Grid capacity exceeded.");
+    if (parts->dof != grid->dof) die("Grid and particle dofs differ.");
+    grid->num_particles = num_particles;
+
+    for (i = 0; i <= grid->num_cells; i++)
+        grid->cell_start[i] = 0;
+
+    /* count particles per cell */
+    for (i = 0; i < num_particles; i++)
+    {
+        cell = 0;
+        for (j = grid->dof - 1; j >= 0; j--)
+        {
+            coord = (int)floor((parts->centroid[j][i] - grid->origin[j]) /
+                grid->cell_size[j]) - grid->first[j];
+            if (coord < 0) coord = 0;
+            if (coord >= grid->dims[j]) coord = grid->dims[j] - 1;
+            cell = cell * grid->dims[j] + coord;
+        }
+        grid->particle_cell[i] = cell;
+        grid->cell_start[cell+1]++;
+    }
+
+    /* prefix sum */
+    for (i = 0; i < grid->num_cells; i++)
+        grid->cell_start[i+1] += grid->cell_start[i];
+
+    /* scatter, using particle_cell order to keep the sort stable */
+    for (i = 0; i < num_particles; i++)
+        grid->cell_particles[grid->cell_start[grid->particle_cell[i]]++] = i;
+
+    /* scatter advanced each start to the end of its cell, shift back */
+    for (i = grid->num_cells; i > 0; i--)
+        grid->cell_start[i] = grid->cell_start[i-1];
+    grid->cell_start[0] = 0;
+}
+
+/**
+ * Collect candidate contact pairs from a binned grid, mutator
+ *
+ * Every pair of particles sharing a cell or lying in neighbouring cells is
+ * emitted exactly once.
+ *
+ * @param pairs Pair list to fill, emptied first
+ * @param grid Binned grid
+ */
+void odem_mgrid_pairs(struct odem_pair_list* pairs, const struct odem_grid* grid)
+{
+    int i, j, a, b, cell, neighbour, coord;
+    int cell_coords[ODEM_MAX_DOF], offset[ODEM_MAX_DOF];
+
+    pairs->num_pairs = 0;
+
+    for (cell = 0; cell < grid->num_cells; cell++)
+    {
+        if (grid->cell_start[cell] == grid->cell_start[cell+1]) continue;
+
+        /* pairs within the cell */
+        for (a = grid->cell_start[cell]; a < grid->cell_start[cell+1]; a++)
+            for (b = a + 1; b < grid->cell_start[cell+1]; b++)
+                odem_mpair_list_push(pairs, grid->cell_particles[a],
+                    grid->cell_particles[b]);
+
+        /* pairs with neighbouring cells of higher index */
+        neighbour = cell;
+        for (i = 0; i < grid->dof; i++)
+        {
+            cell_coords[i] = neighbour % grid->dims[i];
+            neighbour /= grid->dims[i];
+            offset[i] = -1;
+        }
+
+        for (;;)
+        {
+            neighbour = 0;
+            for (i = grid->dof - 1; i >= 0; i--)
+            {
+                coord = cell_coords[i] + offset[i];
+                if (coord < 0 || coord >= grid->dims[i]) break;
+                neighbour = neighbour * grid->dims[i] + coord;
+            }
+
+            if (i < 0 && neighbour > cell)
+            {
+                for (a = grid->cell_start[cell]; a < grid->cell_start[cell+1];
+                    a++)
+                    for (b = grid->cell_start[neighbour];
+                        b < grid->cell_start[neighbour+1]; b++)
+                        odem_mpair_list_push(pairs, grid->cell_particles[a],
+                            grid->cell_particles[b]);
+            }
+
+            /* advance stencil offset */
+            for (j = 0; j < grid->dof && offset[j] == 1; j++)
+                offset[j] = -1;
+            if (j == grid->dof) break;
+            offset[j]++;
+        }
+    }
+}
+
+/**
+ * Fill a pair list with every pair of particles, mutator
+ *
+ * Stands in for a broad phase when every pair is tested, O(N^2) pairs.
+ *
+ * @param pairs Pair list to fill, emptied first
+ * @param num_particles Number of particles
+ */
+void odem_mall_pairs(struct odem_pair_list* pairs, const int num_particles)
+{
+    int a, b;
+
+    pairs->num_pairs = 0;
+    for (a = 0; a < num_particles; a++)
+        for (b = a + 1; b < num_particles; b++)
+            odem_mpair_list_push(pairs, a, b);
+}
+
+/**
+ * Mean distance between the indices of the two particles of a pair, a
+ * measure of how far apart in memory neighbours in space are
+ *
+ * @param pairs Pair list
+ * @return Mean index distance, 0 for an empty list
+ */
+double odem_pair_spread(const struct odem_pair_list* pairs)
+{
+    int p;
+    double sum = 0.0;
+
+    if (pairs->num_pairs == 0) return 0.0;
+
+    #pragma omp parallel for schedule(static) reduction(+:sum)
+    for (p = 0; p < pairs->num_pairs; p++)
+        sum += abs(pairs->first[p] - pairs->second[p]);
+    return sum / pairs->num_pairs;
+}
+
+/**
+ * Spread the bits of a coordinate so that those of the other coordinates
+ * fit in between
+ *
+ * @param x Coordinate, ODEM_MORTON_BITS(dof) bits
+ * @param dof Number of dofs
+ * @return Coordinate with dof - 1 zero bits after each of its bits
+ */
+static uint64_t odem_morton_spread(uint64_t x, const int dof)
+{
+    if (dof == 2)
+    {
+        x &= 0xffffffffULL;
+        x = (x | x << 16) & 0x0000ffff0000ffffULL;
+        x = (x | x << 8) & 0x00ff00ff00ff00ffULL;
+        x = (x | x << 4) & 0x0f0f0f0f0f0f0f0fULL;
+        x = (x | x << 2) & 0x3333333333333333ULL;
+        return (x | x << 1) & 0x5555555555555555ULL;
+    }
+
+    x &= 0x1fffffULL;
+    x = (x | x << 32) & 0x001f00000000ffffULL;
+    x = (x | x << 16) & 0x001f0000ff0000ffULL;
+    x = (x | x << 8) & 0x100f00f00f00f00fULL;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+    return (x | x << 2) & 0x1249249249249249ULL;
+}
+
+/**
+ * Order of two Morton entries, by code then by index, for qsort
+ *
+ * @param a Pointer to the first entry
+ * @param b Pointer to the second entry
+ * @return Negative, zero or positive as a is before, equal to or after b
+ */
+static int odem_compare_morton(const void* a, const void* b)
+{
+    const struct odem_morton_entry* entry_a =
+        (const struct odem_morton_entry*)a;
+    const struct odem_morton_entry* entry_b =
+        (const struct odem_morton_entry*)b;
+
+    if (entry_a->code != entry_b->code)
+        return entry_a->code < entry_b->code ? -1 : 1;
+    return (entry_a->index > entry_b->index) -
+        (entry_a->index < entry_b->index);
+}
+
+/**
+ * Order particles along a Morton (Z order) curve through the domain, so that
+ * particles close in space are mostly close in the order
+ *
+ * Centroids outside of the boundaries are clamped onto them.
+ *
+ * @param order Array to store the particle indices in, in curve order,
+ *              num_particles long
+ * @param parts Particle set
+ * @param bounds Array containing boundaries
+ */
+void odem_spatial_order(int order[], const struct odem_particles* parts,
+    const double bounds[])
+{
+    int i, j;
+    double scale[ODEM_MAX_DOF];
+    const int dof = parts->dof;
+    const double max_coord = (double)((1ULL << ODEM_MORTON_BITS(dof)) - 1);
+
+    struct odem_morton_entry* entries = (struct odem_morton_entry*)malloc(
+        parts->num_particles * sizeof(struct odem_morton_entry));
+    if (entries == NULL && parts->num_particles > 0)
+        die("Memory allocation error");
+
+    for (j = 0; j < dof; j++)
+        scale[j] = max_coord / (bounds[2*j+1] - bounds[2*j]);
+
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        int k;
+        double cell;
+
+        entries[i].code = 0;
+        entries[i].index = i;
+        for (k = 0; k < dof; k++)
+        {
+            cell = (parts->centroid[k][i] - bounds[2*k]) * scale[k];
+            if (cell < 0.0) cell = 0.0;
+            if (cell > max_coord) cell = max_coord;
+            entries[i].code |= odem_morton_spread((uint64_t)cell, dof) << k;
+        }
+    }
+
+    qsort(entries, parts->num_particles, sizeof(struct odem_morton_entry),
+        odem_compare_morton);
+    for (i = 0; i < parts->num_particles; i++)
+        order[i] = entries[i].index;
+
+    free(entries);
+}
+
+/**
+ * Allocate a pair list on the heap
+ *
+ * @param capacity Initial number of pairs to make room for
+ * @return Pointer to a new pair list
+ */
+struct odem_pair_list* odem_alloc_pair_list(const int capacity)
+{
+    struct odem_pair_list* new_list = (struct odem_pair_list*)malloc(
+        sizeof(struct odem_pair_list));
+    if (new_list == NULL) die("Memory allocation error");
+    new_list->num_pairs = 0;
+    new_list->capacity = capacity > 0 ? capacity : 1;
+    new_list->first = (int*)malloc(new_list->capacity * sizeof(int));
+    new_list->second = (int*)malloc(new_list->capacity * sizeof(int));
+    if (new_list->first == NULL || new_list->second == NULL)
+        die("Memory allocation error");
+    return new_list;
+}
+
+/**
+ * Append a pair to a pair list, growing it as needed; mutator
+ *
+ * @param pairs Pair list
+ * @param first Index of the first particle
+ * @param second Index of the second particle
+ */
+void odem_mpair_list_push(struct odem_pair_list* pairs, const int first,
+    const int second)
+{
+    if (pairs->num_pairs == pairs->capacity)
+    {
+        pairs->capacity *= 2;
+        pairs->first = (int*)realloc(pairs->first,
+            pairs->capacity * sizeof(int));
+        pairs->second = (int*)realloc(pairs->second,
+            pairs->capacity * sizeof(int));
+        if (pairs->first == NULL || pairs->second == NULL)
+            die("Memory allocation error");
+    }
+    pairs->first[pairs->num_pairs] = first;
+    pairs->second[pairs->num_pairs] = second;
+    pairs->num_pairs++;
+}
+
+/**
+ * Free memory from a pair list
+ *
+ * @param pairs Pointer to pair list
+ */
+void odem_dealloc_pair_list(struct odem_pair_list* pairs)
+{
+    free(pairs->first);
+    free(pairs->second);
+    free(pairs);
+}
@@ -0,0 +1,74 @@
+#ifndef __GRID_H
+
+#define __GRID_H 1
+
+#include "particle.h"
+
+// data structures
+
+/**
+ * Uniform grid used for broad phase contact detection
+ *
+ * @member dof Number of dofs
+ * @member cell_size Edge length of a grid cell along each dof
+ * @member origin Coordinates of the grid origin
+ * @member dims Number of cells along each dof
+ * @member first Place of the first cell along each dof in the grid this one
+ *               was cut from, 0 for a whole grid
+ * @member num_cells Total number of cells
+ * @member cell_start Offset of each cell in cell_particles, num_cells+1 long
+ * @member cell_particles Particle indices sorted by cell
+ * @member particle_cell Cell index of each particle
+ * @member num_particles Number of binned particles
+ * @member capacity Number of particles the grid has room for
+ */
+struct odem_grid
+{
+    int dof;
+    double cell_size[ODEM_MAX_DOF];
+    double origin[ODEM_MAX_DOF];
+    int dims[ODEM_MAX_DOF];
+    int first[ODEM_MAX_DOF];
+    int num_cells;
+    int* cell_start;
+    int* cell_particles;
+    int* particle_cell;
+    int num_particles;
+    int capacity;
+};
+
+/**
+ * Candidate contact pair list
+ *
+ * @member first Index of the first particle of each pair
+ * @member second Index of the second particle of each pair
+ * @member num_pairs Number of pairs in the list
+ * @member capacity Number of pairs the list has room for
+ */
+struct odem_pair_list
+{
+    int* first;
+    int* second;
+    int num_pairs;
+    int capacity;
+};
+
+
+// function interfaces
+struct odem_grid* odem_alloc_grid(const int, const double[], const double,
+    const int);
+struct odem_grid* odem_alloc_grid_range(const struct odem_grid*, const int,
+    const int, const int);
+void odem_dealloc_grid(struct odem_grid*);
+void odem_mgrid_reserve(struct odem_grid*, const int);
+void odem_mgrid_bin(struct odem_grid*, const struct odem_particles*);
+void odem_mgrid_pairs(struct odem_pair_list*, const struct odem_grid*);
+void odem_mall_pairs(struct odem_pair_list*, const int);
+double odem_pair_spread(const struct odem_pair_list*);
+void odem_spatial_order(int[], const struct odem_particles*, const double[]);
+
+struct odem_pair_list* odem_alloc_pair_list(const int);
+void odem_mpair_list_push(struct odem_pair_list*, const int, const int);
+void odem_dealloc_pair_list(struct odem_pair_list*);
+
+#endif  /* __GRID_H */
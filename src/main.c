@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <sqlite3.h>
+#include <string.h>
+#include <unistd.h>
 #include <math.h>
 #include <errno.h>
 
@@ -8,65 +9,527 @@
 #include "particle.h"
 #include "analysis.h"
 #include "record.h"
+#include "scene.h"
+#include "recorder.h"
+#include "subcycle.h"
+#ifdef ODEM_MPI
+#include <mpi.h>
+#include "domain.h"
+#endif
+
+/*
+ * Print usage and exit
+ */
+static void usage(const char* prog)
+{
+    printf("Usage: %s [-b all|grid|verlet] [-n skin] [-c scalar|batch]"
+        " [-l spring|dashpot|friction] [-t steps] [-p safe|fast|scratch]"
+        " [-B] [-o sqlite|frames]"
+        " [-w depth] [-s stride] [-f pvaf] [-i ids] [-j threads]"
+        " [-m euler|verlet] [-u classes] [-z steps] [-v speed] [-d dt]"
+        " [-S safety] [-T time]"
+        " [-k steps] [-x stride] [-X cells]"
+        " [-K file] [-R file] [-P] [-C file] [-r steps] [-g factor] [-q]"
+        " [scene [results]]\n"
+        "\tscene Text or binary scene file, default a built-in demo\n"
+        "\tresults Results file, default the scene output or results.db,"
+        " results.frames\n"
+        "\t-b Broad phase contact detection, default grid\n"
+        "\t-n Neighbour list skin distance, default half the largest"
+        " radius\n"
+        "\t-c Pair contact kernel, default batch\n"
+        "\t-l Contact law, default the scene contact law or spring\n"
+        "\t-t Time steps recorded per database transaction, default 1\n"
+        "\t-p Database journal/sync preset, default safe\n"
+        "\t-B Bulk load, index the motion table once at the end of the run\n"
+        "\t-o Results format, a sqlite database or a columnar frame file to"
+        " be converted\n\t   with odem-export, default sqlite\n"
+        "\t-w Snapshots queued for the writer thread, 0 writes inline,"
+        " default 2\n"
+        "\t-s Record every stride-th time step, 0 for no motion, default 1\n"
+        "\t-f Recorded fields: (p)osition, (v)elocity, (a)cceleration,"
+        " (f)orce, default pvaf\n"
+        "\t-i Recorded particle ids, e.g. 1,4,10-20, default all\n"
+        "\t-j Threads used by the solver, default all cores\n"
+        "\t-m Time integration scheme, default euler\n"
+        "\t-u Sub-cycle particles in up to this many time step classes by"
+        " their mass, the\n\t   lightest class taking 2^(classes-1)"
+        " substeps per time step, default 1\n"
+        "\t-z Put particles to sleep after this many quiet steps in a row,"
+        " default never\n"
+        "\t-v Speed below which a particle is quiet, with -z, default a ten"
+        " thousandth of\n\t   the largest radius per time step\n"
+        "\t-d Time step, default the scene time step or 0.1\n"
+        "\t-S Choose the time step as a safety fraction of the critical"
+        " time step\n"
+        "\t-T Simulated time, sets the number of iterations from the time"
+        " step\n"
+        "\t-P Record the wall time profile of every step in the results"
+        " database\n"
+        "\t-x Reduce energies, contacts, overlaps, speeds and density into"
+        " the stats tables\n\t   of the results database every stride-th"
+        " time step, default never\n"
+        "\t-X Density cells along each dof of the stats, default 4\n"
+        "\t-k Save a checkpoint every k-th time step, default never\n"
+        "\t-K Checkpoint file, default the results path plus .ckpt\n"
+        "\t-R Resume from a checkpoint of the same scene, appending to its"
+        " results\n"
+        "\t-C Write the scene to a binary scene file and exit\n"
+        "\t-r Reorder particles along a space filling curve every r-th time"
+        " step, default\n\t   never\n"
+        "\t-g Reorder particles once their pairs spread over memory by this"
+        " factor, default\n\t   never\n"
+        "\t-q Do not display info every iteration\n", prog);
+    exit(1);
+}
+
+/*
+ * Parse a list of recorded fields such as "pv"
+ */
+static unsigned int parse_fields(const char* list, const char* prog)
+{
+    unsigned int fields = 0;
+
+    for (; *list != '\0'; list++)
+    {
+        switch (*list)
+        {
+            case 'p': fields |= ODEM_FIELD_MASK(ODEM_FIELD_POSITION); break;
+            case 'v': fields |= ODEM_FIELD_MASK(ODEM_FIELD_VELOCITY); break;
+            case 'a': fields |= ODEM_FIELD_MASK(ODEM_FIELD_ACCELERATION); break;
+            case 'f': fields |= ODEM_FIELD_MASK(ODEM_FIELD_FORCE); break;
+            default: usage(prog);
+        }
+    }
+
+    return fields;
+}
+
+/*
+ * Parse a list of particle ids and ranges such as "1,4,10-20" into an
+ * ascending array of unique ids
+ */
+static void parse_particle_ids(struct odem_record_opts* record,
+    const char* list, const int num_particles)
+{
+    char* end;
+    long first, last, id;
+    int count = 0;
+
+    char* selected = (char*)calloc(num_particles + 1, 1);
+    if (selected == NULL) die("Memory allocation error");
+
+    while (*list != '\0')
+    {
+        first = last = strtol(list, &end, 10);
+        if (end == list) die("Invalid particle id list.");
+        if (*end == '-')
+        {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list) die("Invalid particle id list.");
+        }
+        if (first < 1 || last > num_particles || first > last)
+            die("Particle id out of range.");
+        for (id = first; id <= last; id++)
+            selected[id] = 1;
+        list = *end == ',' ? end + 1 : end;
+        if (*end != ',' && *end != '\0') die("Invalid particle id list.");
+    }
+
+    record->particle_ids = (int*)malloc(num_particles * sizeof(int));
+    if (record->particle_ids == NULL) die("Memory allocation error");
+    for (id = 1; id <= num_particles; id++)
+        if (selected[id]) record->particle_ids[count++] = (int)id;
+    record->num_particle_ids = count;
+
+    free(selected);
+}
+
+/*
+ * Built-in demo scene of four particles in 2D
+ */
+static struct odem_scene* demo_scene(void)
+{
+    double c1[ODEM_MAX_DOF] = {0.0, 5.0};
+    double c2[ODEM_MAX_DOF] = {5.0, 0.0};
+    double c3[ODEM_MAX_DOF] = {10.0, 0.0};
+    double c4[ODEM_MAX_DOF] = {0.0, 10.0};
+
+    double v1[ODEM_MAX_DOF] = {1.0, 0.0};
+    double v2[ODEM_MAX_DOF] = {0.0, 1.0};
+    double v3[ODEM_MAX_DOF] = {0.5, 0.0};
+    double v4[ODEM_MAX_DOF] = {0.0, 0.7};
+
+    double bounds[2*ODEM_MAX_DOF] = {0.0, 20.0, 0.0, 20.0};
+    int i;
+
+    struct odem_scene* scene = odem_alloc_scene(2, 4);
+    odem_mparticles_push(scene->parts, 3.2, 1.0, c4, v4);
+    odem_mparticles_push(scene->parts, 3.2, 0.7, c3, v3);
+    odem_mparticles_push(scene->parts, 3.2, 1.0, c2, v2);
+    odem_mparticles_push(scene->parts, 12.1, 3.2, c1, v1);
+    for (i = 0; i < 2*ODEM_MAX_DOF; i++)
+        scene->bounds[i] = bounds[i];
+
+    return scene;
+}
 
 /*
  * Main function
  */
 int main(int argc, char* argv[])
 {
-    /* TODO: read model data in from a file */
+    struct odem_analysis_opts opts;
+    enum odem_db_preset preset = ODEM_DB_SAFE;
+    enum odem_recorder_format format = ODEM_RECORDER_SQLITE;
+    struct odem_recorder* recorder = NULL;
+    int rank = 0;
+    int steps_per_txn = 1;
+    int bulk = 0;
+    const char* particle_id_list = NULL;
+    const char* convert_file = NULL;
+    const char* resume_file = NULL;
+    char* checkpoint_file = NULL;
+    double delta_time = 0.0, safety = 0.0, end_time = 0.0;
+    enum odem_contact_law law = ODEM_CONTACT_SPRING;
+    int law_given = 0;
+    int sleep_steps = 0;
+    double sleep_speed = 0.0;
+    int opt;
+
+    #ifdef ODEM_MPI
+        MPI_Init(&argc, &argv);
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        /* rank 0 reports for the whole run */
+        if (rank != 0 && freopen("/dev/null", "w", stdout) == NULL)
+            die("Unable to silence rank output");
+        /* MPI start up may leave errno set, see die */
+        errno = 0;
+    #endif
+
+    opts.broad_phase = ODEM_BROAD_PHASE_GRID;
+    opts.skin = 0.0;
+    opts.contact_kernel = ODEM_CONTACT_KERNEL_BATCH;
+    opts.integrator = ODEM_INTEGRATOR_EULER;
+    opts.step_classes = 1;
+    opts.sleep = NULL;
+    opts.contacts = NULL;
+    opts.queue_depth = 2;
+    opts.num_threads = 0;
+    opts.checkpoint_every = 0;
+    opts.checkpoint_file = NULL;
+    opts.start.iteration = 0;
+    opts.start.time = 0.0;
+    opts.start.delta_time = 0.0;
+    opts.profile_steps = 0;
+    opts.stats_every = 0;
+    opts.stats_cells = 4;
+    opts.sort_every = 0;
+    opts.sort_spread = 0.0;
+    opts.record.stride = 1;
+    opts.record.fields = ODEM_ALL_FIELDS;
+    opts.record.particle_ids = NULL;
+    opts.record.num_particle_ids = 0;
+    opts.verbose = 1;
+    opts.domain = NULL;
+
+    while ((opt = getopt(argc, argv, "b:n:c:l:t:p:Bo:w:s:f:i:j:m:u:z:v:d:S:T:k:K:R:Px:X:C:r:g:q")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b':
+                if (strcmp(optarg, "all") == 0)
+                    opts.broad_phase = ODEM_BROAD_PHASE_ALL_PAIRS;
+                else if (strcmp(optarg, "grid") == 0)
+                    opts.broad_phase = ODEM_BROAD_PHASE_GRID;
+                else if (strcmp(optarg, "verlet") == 0)
+                    opts.broad_phase = ODEM_BROAD_PHASE_VERLET;
+                else
+                    usage(argv[0]);
+                break;
+            case 'n':
+                opts.skin = atof(optarg);
+                if (opts.skin <= 0) usage(argv[0]);
+                break;
+            case 'c':
+                if (strcmp(optarg, "scalar") == 0)
+                    opts.contact_kernel = ODEM_CONTACT_KERNEL_SCALAR;
+                else if (strcmp(optarg, "batch") == 0)
+                    opts.contact_kernel = ODEM_CONTACT_KERNEL_BATCH;
+                else
+                    usage(argv[0]);
+                break;
+            case 'l':
+                if (!odem_parse_contact_law(optarg, &law)) usage(argv[0]);
+                law_given = 1;
+                break;
+            case 't':
+                steps_per_txn = atoi(optarg);
+                if (steps_per_txn < 1) usage(argv[0]);
+                break;
+            case 'p':
+                if (strcmp(optarg, "safe") == 0)
+                    preset = ODEM_DB_SAFE;
+                else if (strcmp(optarg, "fast") == 0)
+                    preset = ODEM_DB_FAST;
+                else if (strcmp(optarg, "scratch") == 0)
+                    preset = ODEM_DB_SCRATCH;
+                else
+                    usage(argv[0]);
+                break;
+            case 'B':
+                bulk = 1;
+                break;
+            case 'o':
+                if (strcmp(optarg, "sqlite") == 0)
+                    format = ODEM_RECORDER_SQLITE;
+                else if (strcmp(optarg, "frames") == 0)
+                    format = ODEM_RECORDER_FRAMES;
+                else
+                    usage(argv[0]);
+                break;
+            case 'w':
+                opts.queue_depth = atoi(optarg);
+                if (opts.queue_depth < 0) usage(argv[0]);
+                break;
+            case 's':
+                opts.record.stride = atoi(optarg);
+                if (opts.record.stride < 0) usage(argv[0]);
+                break;
+            case 'f':
+                opts.record.fields = parse_fields(optarg, argv[0]);
+                break;
+            case 'i':
+                particle_id_list = optarg;
+                break;
+            case 'j':
+                opts.num_threads = atoi(optarg);
+                if (opts.num_threads < 1) usage(argv[0]);
+                break;
+            case 'm':
+                if (strcmp(optarg, "euler") == 0)
+                    opts.integrator = ODEM_INTEGRATOR_EULER;
+                else if (strcmp(optarg, "verlet") == 0)
+                    opts.integrator = ODEM_INTEGRATOR_VELOCITY_VERLET;
+                else
+                    usage(argv[0]);
+                break;
+            case 'u':
+                opts.step_classes = atoi(optarg);
+                if (opts.step_classes < 1 ||
+                    opts.step_classes > ODEM_MAX_STEP_CLASSES)
+                    usage(argv[0]);
+                break;
+            case 'z':
+                sleep_steps = atoi(optarg);
+                if (sleep_steps < 1) usage(argv[0]);
+                break;
+            case 'v':
+                sleep_speed = atof(optarg);
+                if (sleep_speed <= 0) usage(argv[0]);
+                break;
+            case 'd':
+                delta_time = atof(optarg);
+                if (delta_time <= 0) usage(argv[0]);
+                break;
+            case 'S':
+                safety = atof(optarg);
+                if (safety <= 0) usage(argv[0]);
+                break;
+            case 'T':
+                end_time = atof(optarg);
+                if (end_time <= 0) usage(argv[0]);
+                break;
+            case 'P':
+                opts.profile_steps = 1;
+                break;
+            case 'x':
+                opts.stats_every = atoi(optarg);
+                if (opts.stats_every < 1) usage(argv[0]);
+                break;
+            case 'X':
+                opts.stats_cells = atoi(optarg);
+                if (opts.stats_cells < 1) usage(argv[0]);
+                break;
+            case 'k':
+                opts.checkpoint_every = atoi(optarg);
+                if (opts.checkpoint_every < 1) usage(argv[0]);
+                break;
+            case 'K':
+                opts.checkpoint_file = optarg;
+                break;
+            case 'R':
+                resume_file = optarg;
+                break;
+            case 'C':
+                convert_file = optarg;
+                break;
+            case 'r':
+                opts.sort_every = atoi(optarg);
+                if (opts.sort_every < 1) usage(argv[0]);
+                break;
+            case 'g':
+                opts.sort_spread = atof(optarg);
+                if (opts.sort_spread <= 1) usage(argv[0]);
+                break;
+            case 'q':
+                opts.verbose = 0;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    /* the sleep speed only applies to particles that sleep */
+    if (sleep_speed > 0 && sleep_steps == 0) usage(argv[0]);
+    if (opts.step_classes > 1 &&
+        (opts.broad_phase == ODEM_BROAD_PHASE_ALL_PAIRS ||
+        opts.integrator != ODEM_INTEGRATOR_EULER))
+        die("Sub-cycling needs the grid or verlet broad phase and the euler"
+            " integrator.");
+    if (sleep_steps > 0 &&
+        (opts.broad_phase == ODEM_BROAD_PHASE_ALL_PAIRS ||
+        opts.integrator != ODEM_INTEGRATOR_EULER || opts.step_classes > 1))
+        die("Sleeping needs the grid or verlet broad phase and the euler"
+            " integrator, without sub-cycling.");
+    if (opts.stats_every > 0 && format != ODEM_RECORDER_SQLITE)
+        die("Stats are recorded in a results database, not a frame file.");
+
+    #ifdef ODEM_MPI
+        if (opts.broad_phase != ODEM_BROAD_PHASE_GRID)
+            die("Distributed runs need the grid broad phase.");
+        if (opts.checkpoint_every > 0 || resume_file != NULL)
+            die("Distributed runs do not checkpoint.");
+        if (opts.step_classes > 1)
+            die("Distributed runs do not sub-cycle.");
+        if (sleep_steps > 0)
+            die("Distributed runs do not put particles to sleep.");
+    #endif
+
     /* model data */
-    double c1[ODEM_DOF] = {0.0, 5.0};
-    double c2[ODEM_DOF] = {5.0, 0.0};
-    double c3[ODEM_DOF] = {10.0, 0.0};
-    double c4[ODEM_DOF] = {0.0, 10.0};
-
-    double v1[ODEM_DOF] = {1.0, 0.0};
-    double v2[ODEM_DOF] = {0.0, 1.0};
-    double v3[ODEM_DOF] = {0.5, 0.0};
-    double v4[ODEM_DOF] = {0.0, 0.7};
-
-    struct odem_particle_node* ppart_list = odem_alloc_particle_node(
-        odem_alloc_particle(12.1, 3.2, c1, v1));
-    odem_mparticle_list_push(&ppart_list,
-        odem_alloc_particle(3.2, 1.0, c2, v2));
-    odem_mparticle_list_push(&ppart_list,
-        odem_alloc_particle(3.2, 0.7, c3, v3));
-    odem_mparticle_list_push(&ppart_list,
-        odem_alloc_particle(3.2, 1.0, c4, v4));
-
-    const int iters = 550;
-    const double delta_time = 0.1;
-    double bounds[2*ODEM_DOF] = {0.0, 20.0, 0.0, 20.0};
-
-    sqlite3 *db;
-    int rc;
-    char *errmsg;
-    #define BUFFER_SIZE 256
-    char sqlite_msg[BUFFER_SIZE];
-    size_t msg_size = sizeof(sqlite_msg);
-
-    const char* data_file = "results.db";
-
-    /* TODO: pass database file name as command-line argument */
-    rc = sqlite3_open(data_file, &db);
-    if (rc != SQLITE_OK) {
-        snprintf(sqlite_msg, msg_size, "ERROR opening database: %s\n",
-            sqlite3_errmsg(db));
-        die(sqlite_msg);
+    if (optind + 2 < argc) usage(argv[0]);
+    struct odem_scene* scene = optind < argc ? odem_load_scene(argv[optind]) :
+        demo_scene();
+    struct odem_particles* parts = scene->parts;
+    if (law_given) scene->contact.law = law;
+
+    if (convert_file != NULL)
+    {
+        if (rank == 0) odem_save_scene(convert_file, scene, ODEM_SCENE_BINARY);
+        odem_dealloc_scene(scene);
+        #ifdef ODEM_MPI
+            MPI_Finalize();
+        #endif
+        return 0;
     }
 
-    /* run analysis and write results to the database */
-    printf("Initializing results database: %s\n", data_file);
-    odem_init_results_db(db);
-    odem_record_particle_data(db, ppart_list);
-    odem_record_model_data(db, iters, delta_time, bounds);
-    odem_run_analysis(db, ppart_list, bounds, iters, delta_time, 1);
+    /* contact histories outlive the analysis so a checkpoint can seed them */
+    opts.contact = scene->contact;
+    odem_mcontact_model_derive(&opts.contact);
+    opts.walls = scene->walls;
+    opts.outlets = scene->outlets;
+    opts.num_outlets = scene->num_outlets;
+    if (opts.contact.law != ODEM_CONTACT_SPRING)
+        opts.contacts = odem_alloc_contact_store(parts->dof,
+            parts->num_particles);
+    /* so does the sleep state, every particle starts awake */
+    if (sleep_steps > 0)
+        opts.sleep = odem_alloc_sleep(parts, sleep_steps, sleep_speed);
+
+    /* continue from the particles, contacts, sleep state and time of a
+     * checkpoint */
+    if (resume_file != NULL)
+    {
+        odem_load_checkpoint(resume_file, parts, opts.contacts, opts.sleep,
+            &opts.start);
+        if (delta_time <= 0) delta_time = opts.start.delta_time;
+        printf("Resuming from iteration %d, time %g\n", opts.start.iteration,
+            opts.start.time);
+    }
+
+    if (particle_id_list != NULL)
+        parse_particle_ids(&opts.record, particle_id_list, parts->next_id);
+
+    int iters = scene->iters > 0 ? scene->iters : 550;
+    if (delta_time <= 0)
+        delta_time = scene->delta_time > 0 ? scene->delta_time : 0.1;
+    if (safety > 0)
+    {
+        /* sub-cycled particles step at their own critical time step */
+        delta_time = safety * (opts.step_classes > 1 ?
+            odem_subcycle_time_step(parts, opts.contact.spring_constant,
+            opts.step_classes) :
+            odem_critical_time_step(parts, opts.contact.spring_constant));
+        printf("Time step: %g\n", delta_time);
+    }
+    if (end_time > 0) iters = (int)ceil(end_time / delta_time);
+    const double* bounds = scene->bounds;
+
+    const char* data_file = optind + 1 < argc ? argv[optind+1] :
+        scene->output != NULL ? scene->output :
+        format == ODEM_RECORDER_FRAMES ? "results.frames" : "results.db";
+
+    if (opts.checkpoint_every > 0 && opts.checkpoint_file == NULL)
+    {
+        checkpoint_file = (char*)malloc(strlen(data_file) + 6);
+        if (checkpoint_file == NULL) die("Memory allocation error");
+        sprintf(checkpoint_file, "%s.ckpt", data_file);
+        opts.checkpoint_file = checkpoint_file;
+    }
+
+    #ifdef ODEM_MPI
+        /* split the domain before rank 0 creates the results, so a scene
+         * that does not split leaves none behind */
+        opts.domain = odem_alloc_domain(MPI_COMM_WORLD, parts, bounds);
+    #endif
+
+    /* only rank 0 of a distributed run records */
+    if (rank == 0)
+    {
+        if (format == ODEM_RECORDER_FRAMES)
+            recorder = odem_alloc_frame_recorder(data_file, parts->dof,
+                opts.record.fields, resume_file != NULL);
+        else
+            recorder = odem_alloc_db_recorder(data_file, preset, parts->dof,
+                opts.record.fields, steps_per_txn, bulk);
+
+        if (resume_file != NULL)
+        {
+            /* drop motion recorded after the checkpoint by the interrupted
+             * run */
+            printf("Resuming results: %s\n", data_file);
+            odem_recorder_truncate(recorder, opts.start.time);
+        }
+        else
+        {
+            printf("Initializing results: %s\n", data_file);
+            odem_recorder_init(recorder);
+            odem_recorder_particle_data(recorder, parts);
+            odem_recorder_model_data(recorder, iters, delta_time, bounds);
+        }
+    }
+
+    #ifdef ODEM_MPI
+        /* every rank loaded the whole scene and keeps its slab of it */
+        odem_mdomain_scatter(opts.domain, parts);
+    #endif
+
+    /* run analysis and write results */
+    odem_run_analysis(recorder, parts, bounds, iters, delta_time, &opts);
 
     /* clean up */
     printf("Freeing dynamic memory...\n");
-    sqlite3_close(db);
-    odem_dealloc_particle_list(ppart_list);
+    if (recorder != NULL) odem_dealloc_recorder(recorder);
+    if (opts.contacts != NULL) odem_dealloc_contact_store(opts.contacts);
+    if (opts.sleep != NULL) odem_dealloc_sleep(opts.sleep);
+    odem_dealloc_scene(scene);
+    free(opts.record.particle_ids);
+    free(checkpoint_file);
+    #ifdef ODEM_MPI
+        odem_dealloc_domain(opts.domain);
+        MPI_Finalize();
+    #endif
 
     return 0;
 }
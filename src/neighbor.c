@@ -0,0 +1,125 @@
+#include <stdlib.h>
+
+#include "debug.h"
+#include "neighbor.h"
+
+/**
+ * Allocate a neighbour list on the heap
+ *
+ * @param dof Number of dofs
+ * @param bounds Array containing boundaries
+ * @param max_radius Largest particle radius
+ * @param skin Skin distance
+ * @param capacity Number of particles to make room for
+ * @return Pointer to a new, empty neighbour list
+ */
+struct odem_neighbor_list* odem_alloc_neighbor_list(const int dof,
+    const double bounds[], const double max_radius, const double skin,
+    const int capacity)
+{
+    if (skin <= 0) die("Neighbour list skin must be positive.");
+
+    struct odem_neighbor_list* new_list = (struct odem_neighbor_list*)malloc(
+        sizeof(struct odem_neighbor_list));
+    if (new_list == NULL) die("Memory allocation error");
+
+    new_list->grid = odem_alloc_grid(dof, bounds, 2.0 * max_radius + skin,
+        capacity);
+    new_list->candidates = odem_alloc_pair_list(capacity);
+    new_list->pairs = odem_alloc_pair_list(capacity);
+    new_list->skin = skin;
+    new_list->num_builds = 0;
+
+    return new_list;
+}
+
+/**
+ * Free memory from a neighbour list
+ *
+ * @param list Pointer to neighbour list
+ */
+void odem_dealloc_neighbor_list(struct odem_neighbor_list* list)
+{
+    odem_dealloc_grid(list->grid);
+    odem_dealloc_pair_list(list->candidates);
+    odem_dealloc_pair_list(list->pairs);
+    free(list);
+}
+
+/**
+ * Build a neighbour list and store reference positions, mutator
+ *
+ * @param list Neighbour list
+ * @param parts Particle set
+ */
+void odem_mneighbor_list_build(struct odem_neighbor_list* list,
+    struct odem_particles* parts)
+{
+    int i, j, p1, p2;
+    double d, dist2, cutoff;
+    const struct odem_pair_list* candidates = list->candidates;
+
+    odem_mgrid_bin(list->grid, parts);
+    odem_mgrid_pairs(list->candidates, list->grid);
+
+    /* keep pairs within the contact distance plus the skin */
+    list->pairs->num_pairs = 0;
+    for (i = 0; i < candidates->num_pairs; i++)
+    {
+        p1 = candidates->first[i];
+        p2 = candidates->second[i];
+        dist2 = 0.0;
+        for (j = 0; j < parts->dof; j++)
+        {
+            d = parts->centroid[j][p1] - parts->centroid[j][p2];
+            dist2 += d * d;
+        }
+        cutoff = parts->radius[p1] + parts->radius[p2] + list->skin;
+        if (dist2 < cutoff * cutoff)
+            odem_mpair_list_push(list->pairs, p1, p2);
+    }
+
+    for (j = 0; j < parts->dof; j++)
+        for (i = 0; i < parts->num_particles; i++)
+            parts->ref_centroid[j][i] = parts->centroid[j][i];
+
+    list->num_builds++;
+}
+
+/**
+ * Rebuild a neighbour list if some particle has moved more than half the
+ * skin since the last build, mutator
+ *
+ * @param list Neighbour list
+ * @param parts Particle set
+ * @return Whether or not the list was rebuilt
+ */
+int odem_mneighbor_list_update(struct odem_neighbor_list* list,
+    struct odem_particles* parts)
+{
+    int i, rebuild = 0;
+    const double limit = 0.25 * list->skin * list->skin;
+
+    if (list->num_builds == 0)
+    {
+        odem_mneighbor_list_build(list, parts);
+        return 1;
+    }
+
+    #pragma omp parallel for schedule(static) reduction(||:rebuild)
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        int j;
+        double d, disp2 = 0.0;
+
+        for (j = 0; j < parts->dof; j++)
+        {
+            d = parts->centroid[j][i] - parts->ref_centroid[j][i];
+            disp2 += d * d;
+        }
+        if (disp2 > limit) rebuild = 1;
+    }
+
+    if (rebuild) odem_mneighbor_list_build(list, parts);
+    return rebuild;
+}
@@ -0,0 +1,43 @@
+#ifndef __NEIGHBOR_H
+
+#define __NEIGHBOR_H 1
+
+#include "particle.h"
+#include "grid.h"
+
+// data structures
+
+/**
+ * Verlet neighbour list
+ *
+ * Holds every pair of particles closer than the sum of their radii plus a
+ * skin distance. The list stays valid until some particle has moved more
+ * than half the skin since it was built.
+ *
+ * @member grid Grid used to build the list, cells span the contact cutoff
+ *              plus the skin
+ * @member candidates Scratch pair list of grid neighbours
+ * @member pairs Neighbour pairs
+ * @member skin Skin distance
+ * @member num_builds Number of times the list has been built
+ */
+struct odem_neighbor_list
+{
+    struct odem_grid* grid;
+    struct odem_pair_list* candidates;
+    struct odem_pair_list* pairs;
+    double skin;
+    int num_builds;
+};
+
+
+// function interfaces
+struct odem_neighbor_list* odem_alloc_neighbor_list(const int,
+    const double[], const double, const double, const int);
+void odem_dealloc_neighbor_list(struct odem_neighbor_list*);
+void odem_mneighbor_list_build(struct odem_neighbor_list*,
+    struct odem_particles*);
+int odem_mneighbor_list_update(struct odem_neighbor_list*,
+    struct odem_particles*);
+
+#endif  /* __NEIGHBOR_H */
@@ -1,229 +1,352 @@
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include "debug.h"
 #include "particle.h"
 
+/* number of per-particle arrays carved out of a particle allocation */
+#define ODEM_PARTICLE_ARRAYS(dof) (2 + 4*(dof))
+
 /**
- * Allocate a particle on the heap
+ * Number of doubles reserved per array so that every array stays aligned
  *
- * @param mass Mass of the particle
- * @param radius Radius of the particle
- * @param centroid Coordinates of the particle centroid
- * @param velocity Components of the velocity vector
- * @return Pointer to a new particle
+ * @param capacity Number of particles
+ * @return Padded array length
+ */
+static size_t odem_particle_stride(const int capacity)
+{
+    const size_t per_line = ODEM_ALIGNMENT / sizeof(double);
+    return ((size_t)capacity + per_line - 1) / per_line * per_line;
+}
+
+/**
+ * Carve the per-particle arrays out of a new aligned block, mutator
+ *
+ * @param parts Particle set, its dof set
+ * @param capacity Number of particles to make room for
  */
-struct odem_particle* odem_alloc_particle(const double mass, const double radius,
-    const double centroid[], const double velocity[])
+static void odem_particles_carve(struct odem_particles* parts,
+    const int capacity)
 {
     int i;
+    double* data;
+    const int dof = parts->dof;
+    const size_t stride = odem_particle_stride(capacity);
+
+    /* the id column follows the double columns, still aligned */
+    if (posix_memalign(&parts->block, ODEM_ALIGNMENT,
+        ODEM_PARTICLE_ARRAYS(dof) * stride * sizeof(double) +
+        stride * sizeof(int)) != 0)
+        die("Memory allocation error");
+    data = (double*)parts->block;
 
-    struct odem_particle* new_particle = (struct odem_particle*)malloc(
-        sizeof(struct odem_particle));
-    if (new_particle == NULL) die("Memory allocation error");
-    new_particle->mass = mass;
-    new_particle->radius = radius;
-    for (i = 0; i < ODEM_DOF; i++)
+    parts->capacity = capacity;
+    parts->mass = data;
+    parts->radius = data + stride;
+    for (i = 0; i < ODEM_MAX_DOF; i++)
     {
-        new_particle->centroid[i] = centroid[i];
-        new_particle->velocity[i] = velocity[i];
+        if (i >= dof)
+        {
+            parts->centroid[i] = NULL;
+            parts->velocity[i] = NULL;
+            parts->force[i] = NULL;
+            parts->ref_centroid[i] = NULL;
+            continue;
+        }
+        parts->centroid[i] = data + (2 + i) * stride;
+        parts->velocity[i] = data + (2 + dof + i) * stride;
+        parts->force[i] = data + (2 + 2*dof + i) * stride;
+        parts->ref_centroid[i] = data + (2 + 3*dof + i) * stride;
     }
-    return new_particle;
+    parts->id = (int*)(data + ODEM_PARTICLE_ARRAYS(dof) * stride);
 }
 
 /**
- * Allocate a particle node on the heap
+ * Allocate storage for a set of particles on the heap
  *
- * @param ppart Pointer to a particle
- * @return Pointer to a new particle node
+ * Every per-particle array lives in one aligned block so that the set is
+ * reserved with a single allocation and released with a single free.
+ *
+ * @param dof Number of dofs, 2 or 3
+ * @param capacity Number of particles to make room for
+ * @return Pointer to a new, empty particle set
  */
-struct odem_particle_node* odem_alloc_particle_node(
-    struct odem_particle* const ppart)
+struct odem_particles* odem_alloc_particles(const int dof, const int capacity)
 {
-    struct odem_particle_node* new_node = (struct odem_particle_node*)malloc(
-        sizeof(struct odem_particle_node));
-    if (new_node == NULL) die("Memory allocation error.");
-    new_node->next = NULL;
-    new_node->ppart = ppart;
-    return new_node;
+    if (capacity < 0) die("Particle capacity must not be negative.");
+    if (dof != 2 && dof != 3) die("Particle sets are 2D or 3D.");
+
+    struct odem_particles* new_particles = (struct odem_particles*)malloc(
+        sizeof(struct odem_particles));
+    if (new_particles == NULL) die("Memory allocation error");
+
+    new_particles->dof = dof;
+    new_particles->num_particles = 0;
+    new_particles->next_id = 0;
+    odem_particles_carve(new_particles, capacity);
+
+    return new_particles;
 }
 
 /**
- * Push a particle node onto a linked list
+ * Free memory from a particle set
  *
- * @param head Pointer to the head node
- * @param ppart Pointer to particle to be added
+ * @param parts Pointer to particle set
  */
-void odem_mparticle_list_push(struct odem_particle_node** head,
-    struct odem_particle* const ppart)
+void odem_dealloc_particles(struct odem_particles* parts)
 {
-    struct odem_particle_node* new_node = odem_alloc_particle_node(ppart);
-    new_node->next = *head;
-    *head = new_node;
+    free(parts->block);
+    free(parts);
 }
 
 /**
- * Free memory from a particle linked list
+ * Make room for a number of particles, moving the arrays to a larger block
+ * if needed; mutator
  *
- * @param head Pointer to head node of list
+ * Array pointers taken from the set before the call are invalid after it.
+ *
+ * @param parts Particle set
+ * @param capacity Number of particles to make room for
  */
-void odem_dealloc_particle_list(struct odem_particle_node* head)
+void odem_mparticles_reserve(struct odem_particles* parts, const int capacity)
 {
-    struct odem_particle_node *curr_node, *node_to_free;
+    int i;
+    struct odem_particles old = *parts;
+    const size_t n = (size_t)parts->num_particles;
 
-    curr_node = head;
-    while (curr_node != NULL)
+    if (capacity <= parts->capacity) return;
+
+    odem_particles_carve(parts, capacity);
+    memcpy(parts->mass, old.mass, n * sizeof(double));
+    memcpy(parts->radius, old.radius, n * sizeof(double));
+    for (i = 0; i < parts->dof; i++)
     {
-        node_to_free = curr_node;
-        curr_node = curr_node->next;
-        free(node_to_free->ppart);
-        free(node_to_free);
+        memcpy(parts->centroid[i], old.centroid[i], n * sizeof(double));
+        memcpy(parts->velocity[i], old.velocity[i], n * sizeof(double));
+        memcpy(parts->force[i], old.force[i], n * sizeof(double));
+        memcpy(parts->ref_centroid[i], old.ref_centroid[i],
+            n * sizeof(double));
     }
+    memcpy(parts->id, old.id, n * sizeof(int));
+    free(old.block);
 }
 
 /**
- * Move a particle for a given time step, mutator
+ * Append a particle to a particle set, doubling its capacity when full;
+ * mutator
  *
- * @param ppart Pointer to particle to move
- * @param delta_time Time of step
+ * @param parts Particle set
+ * @param mass Mass of the particle
+ * @param radius Radius of the particle
+ * @param centroid Coordinates of the particle centroid, dof long
+ * @param velocity Components of the velocity vector, dof long
+ * @return Index of the new particle
  */
-void odem_mmove_particle(struct odem_particle* ppart, const double delta_time)
+int odem_mparticles_push(struct odem_particles* parts, const double mass,
+    const double radius, const double centroid[], const double velocity[])
 {
-    int i;
-    for (i = 0; i < ODEM_DOF; i++)
-        ppart->centroid[i] += ppart->velocity[i] * delta_time;
+    int i, index;
+
+    if (parts->num_particles == parts->capacity)
+        odem_mparticles_reserve(parts, parts->capacity > 0 ?
+            2 * parts->capacity : 1);
+
+    index = parts->num_particles++;
+    parts->mass[index] = mass;
+    parts->radius[index] = radius;
+    for (i = 0; i < parts->dof; i++)
+    {
+        parts->centroid[i][index] = centroid[i];
+        parts->velocity[i][index] = velocity[i];
+        parts->force[i][index] = 0.0;
+        parts->ref_centroid[i][index] = centroid[i];
+    }
+    parts->id[index] = parts->next_id++;
+    return index;
 }
 
 /**
- * Accelerate a particle for a given time step, mutator
+ * Remove a particle from a particle set in constant time, mutator
+ *
+ * The last particle is moved into the slot of the removed one.
  *
- * @param ppart Pointer to particle to accelerate
- * @param delta_time Time of step
+ * @param parts Particle set
+ * @param index Index of the particle to remove
+ * @return Previous index of the particle now at index, -1 if none moved
  */
-void odem_maccel_particle(struct odem_particle* ppart, const double delta_time,
-    const double acceleration[])
+int odem_mparticles_remove(struct odem_particles* parts, const int index)
 {
     int i;
-    for (i = 0; i < ODEM_DOF; i++)
-        ppart->velocity[i] += acceleration[i] * delta_time;
+    const int last = --parts->num_particles;
+
+    if (index == last) return -1;
+
+    parts->mass[index] = parts->mass[last];
+    parts->radius[index] = parts->radius[last];
+    for (i = 0; i < parts->dof; i++)
+    {
+        parts->centroid[i][index] = parts->centroid[i][last];
+        parts->velocity[i][index] = parts->velocity[i][last];
+        parts->force[i][index] = parts->force[i][last];
+        parts->ref_centroid[i][index] = parts->ref_centroid[i][last];
+    }
+    parts->id[index] = parts->id[last];
+    return last;
 }
 
 /**
- * Unit vector normal to particle 1 in the direction of particle 2, mutator
+ * Remove every particle whose centroid lies inside an axis aligned box,
+ * mutator
+ *
+ * Particles are visited from the last, so every particle moved into a
+ * removed slot has been visited already.
  *
- * @param e12 Array to store unit ODEM_NORMal vector in
- * @param pp1 Pointer to particle 1
- * @param pp2 Pointer to particle 2
+ * @param parts Particle set
+ * @param box Array containing the min and max of the box along each dof
+ * @return Number of particles removed
  */
-void odem_me12(double e12[], const struct odem_particle* pp1,
-    const struct odem_particle* pp2)
+int odem_mparticles_remove_inside(struct odem_particles* parts,
+    const double box[])
 {
-    int i;
-    double ODEM_NORM;
+    int i, j, inside, removed = 0;
 
-    for (i = 0; i < ODEM_DOF; i++)
-        e12[i] = pp2->centroid[i] - pp1->centroid[i];
+    for (i = parts->num_particles - 1; i >= 0; i--)
+    {
+        inside = 1;
+        for (j = 0; j < parts->dof && inside; j++)
+            inside = parts->centroid[j][i] >= box[2*j] &&
+                parts->centroid[j][i] <= box[2*j+1];
+        if (!inside) continue;
+        odem_mparticles_remove(parts, i);
+        removed++;
+    }
 
-    #if ODEM_DOF == 2
-        ODEM_NORM = ODEM_NORM_2D_VEC(e12);
-    #elif ODEM_DOF == 3
-        ODEM_NORM = ODEM_NORM_3D_VEC(e12);
-    #endif
+    return removed;
+}
 
-    if (ODEM_NORM != 0)
+/**
+ * Reorder the particles of a set, or keep some of them in a given order;
+ * mutator
+ *
+ * The columns are gathered into a new block of the same capacity, ids move
+ * with their particles.
+ *
+ * @param parts Particle set
+ * @param order Previous index of the particle at each new index, each index
+ *              at most once
+ * @param count Number of particles kept, the length of order
+ */
+void odem_mparticles_permute(struct odem_particles* parts, const int order[],
+    const int count)
+{
+    int i;
+    struct odem_particles old = *parts;
+
+    odem_particles_carve(parts, parts->capacity);
+    parts->num_particles = count;
+
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < parts->num_particles; i++)
     {
-        for (i = 0; i < ODEM_DOF; i++)
-            e12[i] /= ODEM_NORM;
+        int j;
+        const int from = order[i];
+
+        parts->mass[i] = old.mass[from];
+        parts->radius[i] = old.radius[from];
+        for (j = 0; j < parts->dof; j++)
+        {
+            parts->centroid[j][i] = old.centroid[j][from];
+            parts->velocity[j][i] = old.velocity[j][from];
+            parts->force[j][i] = old.force[j][from];
+            parts->ref_centroid[j][i] = old.ref_centroid[j][from];
+        }
+        parts->id[i] = old.id[from];
     }
+
+    free(old.block);
 }
 
 /**
- * Distance between two particles
+ * Number the particles of a set from 0 in index order, for sets filled
+ * without odem_mparticles_push; mutator
  *
- * @param pp1 Pointer to particle 1
- * @param pp2 Pointer to particle 2
- * @return Distance between particles
+ * @param parts Particle set
  */
-double odem_delta(const struct odem_particle* pp1, const struct odem_particle* pp2)
+void odem_mparticles_reset_ids(struct odem_particles* parts)
 {
-    #if ODEM_DOF == 2
-        return ODEM_NORM_2D(pp1->centroid[X] - pp2->centroid[X],
-            pp1->centroid[Y] - pp2->centroid[Y]) - pp1->radius - pp2->radius;
-    #elif ODEM_DOF == 3
-        return ODEM_NORM_3D(pp1->centroid[X] - pp2->centroid[X],
-            pp1->centroid[Y] - pp2->centroid[Y],
-            pp1->centroid[Z] - pp2->centroid[Z],) - pp1->radius - pp2->radius;
-    #endif
+    int i;
+
+    for (i = 0; i < parts->num_particles; i++)
+        parts->id[i] = i;
+    parts->next_id = parts->num_particles;
 }
 
 /**
- * Particle-particle collision model, spring; mutator
+ * Largest radius in a particle set
  *
- * @param force_vec Array to store force vector in
- * @param pp1 Pointer to particle 1
- * @param pp2 Pointer to particle 2
- * @param spring_constant Spring constant, k
- * @return whether or not a collision has occurred
+ * @param parts Particle set
+ * @return Maximum particle radius, 0 for an empty set
  */
-int odem_mforce_collision_spring(double force_vec[],
-    const struct odem_particle* pp1, const struct odem_particle* pp2,
-    const double spring_constant)
+double odem_max_radius(const struct odem_particles* parts)
 {
     int i;
-    double delta;
+    double max_radius = 0.0;
 
-    delta = odem_delta(pp1, pp2);
-    if (delta < 0)
-    {
-        odem_me12(force_vec, pp1, pp2);
-        for (i = 0; i < ODEM_DOF; i++)
-            force_vec[i] *= delta * spring_constant;
-        return 1;
-    }
-    else
-    {
-        for (i = 0; i < ODEM_DOF; i++)
-            force_vec[i] = 0;
-        return 0;
-    }
+    for (i = 0; i < parts->num_particles; i++)
+        if (parts->radius[i] > max_radius) max_radius = parts->radius[i];
+    return max_radius;
 }
 
 /**
- * Particle-boundary collision model, spring; mutator
+ * Critical time step of the spring contact model, the smallest sqrt(m/k) over
+ * the particle set
+ *
+ * Stable time steps are a safety fraction of this value.
  *
- * @param force_vec Array to store force vector in
- * @param ppart Pointer to particle
- * @param bounds Array containing boundaries
+ * @param parts Particle set
  * @param spring_constant Spring constant, k
- * @return whether or not a collision has occurred
+ * @return Critical time step, 0 for an empty set
  */
-int odem_mforce_boundary_collision_spring(double force_vec[],
-    const struct odem_particle* ppart, const double bounds[],
+double odem_critical_time_step(const struct odem_particles* parts,
     const double spring_constant)
 {
-    int i, collision = 0;
-    double delta;
+    int i;
+    double min_mass;
 
-    for (i = 0; i < ODEM_DOF; i++)
-    {
-        /* check for collision at min dof boundary */
-        delta = ppart->centroid[i] - bounds[2*i] - ppart->radius;
-        if (delta < 0)
-        {
-            collision = 1;
-            force_vec[i] = -delta * spring_constant;
-            continue;
-        }
+    if (parts->num_particles == 0) return 0.0;
 
-        /* check for collision at max dof boundary */
-        delta = bounds[2*i+1] - ppart->centroid[i] - ppart->radius;
-        if (delta < 0)
-        {
-            collision = 1;
-            force_vec[i] = delta * spring_constant;
-        }
-    }
+    min_mass = parts->mass[0];
+    for (i = 1; i < parts->num_particles; i++)
+        if (parts->mass[i] < min_mass) min_mass = parts->mass[i];
+    return sqrt(min_mass / spring_constant);
+}
 
-    return collision;
+#if defined(__AVX512F__) || defined(__AVX2__)
+/**
+ * Number of set bits in a lane mask
+ *
+ * @param mask Lane mask
+ * @return Number of lanes set
+ */
+static int odem_count_lanes(unsigned int mask)
+{
+    int count = 0;
+    for (; mask != 0; mask &= mask - 1)
+        count++;
+    return count;
 }
+#endif
+
+/* dof specialised kernels */
+
+#define ODEM_KERNEL_DOF 2
+#include "particle_kernels.h"
+#undef ODEM_KERNEL_DOF
 
+#define ODEM_KERNEL_DOF 3
+#include "particle_kernels.h"
+#undef ODEM_KERNEL_DOF
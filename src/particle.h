@@ -2,63 +2,100 @@
 
 #define __PARTICLE_H 1
 
-enum odem_ODEM_DOF { X, Y, Z };
+enum odem_dof { X, Y, Z };
 
-#define ODEM_DOF 2
+/* largest number of dofs, a particle set is 2D or 3D at runtime */
+#define ODEM_MAX_DOF 3
 
-#define ODEM_NORM_2D(x, y) sqrt((x)*(x)+(y)*(y))
-#define ODEM_NORM_3D(x, y, z) sqrt((x)*(x)+(y)*(y)+(z)*(z))
+/*
+ * Kernels specialised for a number of dofs are generated from templates,
+ * e.g. particle_kernels.h, included once per dof with ODEM_KERNEL_DOF
+ * defined. ODEM_KERNEL(name) names the variant, name_2d or name_3d.
+ */
+#define ODEM_KERNEL_NAME_(name, dof) name##_##dof##d
+#define ODEM_KERNEL_NAME(name, dof) ODEM_KERNEL_NAME_(name, dof)
+#define ODEM_KERNEL(name) ODEM_KERNEL_NAME(name, ODEM_KERNEL_DOF)
 
-#define ODEM_NORM_2D_VEC(v) ODEM_NORM_2D(v[X], v[Y])
-#define ODEM_NORM_3D_VEC(v) ODEM_NORM_3D(v[X], v[Y], v[Z])
+/* alignment, in bytes, of every particle array */
+#define ODEM_ALIGNMENT 64
 
 // data structures
 
 /**
- * Particle structure
+ * Particle storage, structure of arrays
  *
- * @member mass Particle mass
- * @member radius Particle radius
- * @memeber centroid Coordinates of the particle centroid
- * @member velocity Components of the velocity vector
- */
-struct odem_particle
-{
-    double mass;
-    double radius;
-    double centroid[ODEM_DOF];
-    double velocity[ODEM_DOF];
-};
-
-/**
- * Particle list node
+ * Every array is carved out of a single allocation, reserved up front for
+ * the expected number of particles, and indexed by particle. Only the first
+ * dof arrays of each vector quantity are allocated. Particles stay packed:
+ * a removed particle's slot is filled by the last particle, so indices
+ * change and id is what identifies a particle over a run.
  *
- * @member ppart Pointer to the particle
- * @member next Link to next node
+ * @member dof Number of dofs, 2 or 3
+ * @member num_particles Number of particles in the set
+ * @member capacity Number of particles the set has room for
+ * @member next_id Id of the next particle added to the set
+ * @member block Allocation holding every array
+ * @member mass Particle masses
+ * @member radius Particle radii
+ * @member centroid Coordinates of the particle centroids, one array per dof
+ * @member velocity Components of the velocity vectors, one array per dof
+ * @member force Components of the net force on each particle accumulated
+ *               during a time step, one array per dof
+ * @member ref_centroid Centroid coordinates when the neighbour list was last
+ *                      built, one array per dof
+ * @member id Particle ids, from 0 in the order particles were added and
+ *            never reused
  */
-struct odem_particle_node
+struct odem_particles
 {
-    struct odem_particle* ppart;
-    struct odem_particle_node* next;
+    int dof;
+    int num_particles;
+    int capacity;
+    int next_id;
+    void* block;
+    double* mass;
+    double* radius;
+    double* centroid[ODEM_MAX_DOF];
+    double* velocity[ODEM_MAX_DOF];
+    double* force[ODEM_MAX_DOF];
+    double* ref_centroid[ODEM_MAX_DOF];
+    int* id;
 };
 
 
 // function interfaces
-struct odem_particle* odem_alloc_particle(const double, const double, const double[],
-    const double[]);
-void odem_mmove_particle(struct odem_particle*, const double);
-void odem_maccel_particle(struct odem_particle*, const double, const double[]);
-void odem_me12(double[], const struct odem_particle*, const struct odem_particle*);
-double odem_delta(const struct odem_particle*, const struct odem_particle*);
-int odem_mforce_collision_spring(double[], const struct odem_particle*,
-    const struct odem_particle*, const double);
-int odem_mforce_boundary_collision_spring(double[], const struct odem_particle*,
-    const double[], const double);
+struct odem_particles* odem_alloc_particles(const int, const int);
+void odem_dealloc_particles(struct odem_particles*);
+void odem_mparticles_reserve(struct odem_particles*, const int);
+int odem_mparticles_push(struct odem_particles*, const double, const double,
+    const double[], const double[]);
+int odem_mparticles_remove(struct odem_particles*, const int);
+int odem_mparticles_remove_inside(struct odem_particles*, const double[]);
+void odem_mparticles_permute(struct odem_particles*, const int[], const int);
+void odem_mparticles_reset_ids(struct odem_particles*);
+double odem_max_radius(const struct odem_particles*);
+double odem_critical_time_step(const struct odem_particles*, const double);
 
-struct odem_particle_node* odem_alloc_particle_node(struct odem_particle* const);
-void odem_mparticle_list_push(struct odem_particle_node**,
-    struct odem_particle* const);
-void odem_dealloc_particle_list(struct odem_particle_node*);
+/* dof specialised kernels, see particle_kernels.h */
+#define ODEM_DECLARE_PARTICLE_KERNELS(dof) \
+    void ODEM_KERNEL_NAME(odem_mmove_particles, dof)( \
+        struct odem_particles*, const double); \
+    void ODEM_KERNEL_NAME(odem_maccel_particles, dof)( \
+        struct odem_particles*, const double); \
+    void ODEM_KERNEL_NAME(odem_mkick_particles, dof)( \
+        struct odem_particles*, const int[], const int, const double, \
+        const double[]); \
+    void ODEM_KERNEL_NAME(odem_me12, dof)(double[], \
+        const struct odem_particles*, const int, const int); \
+    double ODEM_KERNEL_NAME(odem_delta, dof)(const struct odem_particles*, \
+        const int, const int); \
+    int ODEM_KERNEL_NAME(odem_mforce_collision_spring, dof)(double[], \
+        const struct odem_particles*, const int, const int, const double); \
+    int ODEM_KERNEL_NAME(odem_mforce_collision_spring_batch, dof)( \
+        double* const[], const struct odem_particles*, const int[], \
+        const int[], const int, const double);
 
-#endif  /* __PARTICLE_H */
+ODEM_DECLARE_PARTICLE_KERNELS(2)
+ODEM_DECLARE_PARTICLE_KERNELS(3)
 
+#endif  /* __PARTICLE_H */
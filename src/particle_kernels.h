@@ -0,0 +1,291 @@
+/*
+ * Particle kernels specialised for ODEM_KERNEL_DOF dofs
+ *
+ * Included by particle.c once per supported dof, without an include guard.
+ * Every dof loop has a compile time trip count, so the compiler unrolls it
+ * and vectorises across particles.
+ */
+
+#ifndef ODEM_KERNEL_DOF
+#error "ODEM_KERNEL_DOF must be defined before including particle_kernels.h"
+#endif
+
+/**
+ * Move every particle for a given time step, mutator
+ *
+ * @param parts Particle set to move
+ * @param delta_time Time of step
+ */
+void ODEM_KERNEL(odem_mmove_particles)(struct odem_particles* parts,
+    const double delta_time)
+{
+    int i, j;
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+    {
+        double* centroid = parts->centroid[i];
+        const double* velocity = parts->velocity[i];
+        #pragma omp parallel for schedule(static)
+        for (j = 0; j < parts->num_particles; j++)
+            centroid[j] += velocity[j] * delta_time;
+    }
+}
+
+/**
+ * Accelerate every particle by its accumulated net force for a given time
+ * step, mutator
+ *
+ * @param parts Particle set to accelerate
+ * @param delta_time Time of step
+ */
+void ODEM_KERNEL(odem_maccel_particles)(struct odem_particles* parts,
+    const double delta_time)
+{
+    int i, j;
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+    {
+        double* velocity = parts->velocity[i];
+        const double* force = parts->force[i];
+        const double* mass = parts->mass;
+        #pragma omp parallel for schedule(static)
+        for (j = 0; j < parts->num_particles; j++)
+            velocity[j] += force[j] / mass[j] * delta_time;
+    }
+}
+
+/**
+ * Accelerate the particles of the time step classes due at a substep by the
+ * force gathered over their step, mutator
+ *
+ * See odem_subcycle. The gathered force is scaled by the factor of the class
+ * afterwards, reset to 0 without factors.
+ *
+ * @param parts Particle set to accelerate
+ * @param level Class of every particle
+ * @param due Coarsest class due, finer classes are due as well
+ * @param delta_time Time of a substep
+ * @param keep Factor each class keeps its force with, NULL to reset it
+ */
+void ODEM_KERNEL(odem_mkick_particles)(struct odem_particles* parts,
+    const int level[], const int due, const double delta_time,
+    const double keep[])
+{
+    int i, j;
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+    {
+        double* velocity = parts->velocity[i];
+        double* force = parts->force[i];
+        const double* mass = parts->mass;
+        #pragma omp parallel for schedule(static)
+        for (j = 0; j < parts->num_particles; j++)
+        {
+            if (level[j] < due) continue;
+            velocity[j] += force[j] / mass[j] * delta_time;
+            force[j] = keep != NULL ? force[j] * keep[level[j]] : 0.0;
+        }
+    }
+}
+
+/**
+ * Unit vector normal to particle 1 in the direction of particle 2, mutator
+ *
+ * @param e12 Array to store unit normal vector in
+ * @param parts Particle set
+ * @param p1 Index of particle 1
+ * @param p2 Index of particle 2
+ */
+void ODEM_KERNEL(odem_me12)(double e12[], const struct odem_particles* parts,
+    const int p1, const int p2)
+{
+    int i;
+    double norm2 = 0.0, norm;
+
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+    {
+        e12[i] = parts->centroid[i][p2] - parts->centroid[i][p1];
+        norm2 += e12[i] * e12[i];
+    }
+    norm = sqrt(norm2);
+
+    if (norm != 0)
+    {
+        for (i = 0; i < ODEM_KERNEL_DOF; i++)
+            e12[i] /= norm;
+    }
+}
+
+/**
+ * Distance between two particles
+ *
+ * @param parts Particle set
+ * @param p1 Index of particle 1
+ * @param p2 Index of particle 2
+ * @return Distance between particles
+ */
+double ODEM_KERNEL(odem_delta)(const struct odem_particles* parts,
+    const int p1, const int p2)
+{
+    int i;
+    double d, dist2 = 0.0;
+
+    for (i = 0; i < ODEM_KERNEL_DOF; i++)
+    {
+        d = parts->centroid[i][p1] - parts->centroid[i][p2];
+        dist2 += d * d;
+    }
+    return sqrt(dist2) - parts->radius[p1] - parts->radius[p2];
+}
+
+/**
+ * Particle-particle collision model, spring; mutator
+ *
+ * @param force_vec Array to store force vector in
+ * @param parts Particle set
+ * @param p1 Index of particle 1
+ * @param p2 Index of particle 2
+ * @param spring_constant Spring constant, k
+ * @return whether or not a collision has occurred
+ */
+int ODEM_KERNEL(odem_mforce_collision_spring)(double force_vec[],
+    const struct odem_particles* parts, const int p1, const int p2,
+    const double spring_constant)
+{
+    int i;
+    double delta;
+
+    delta = ODEM_KERNEL(odem_delta)(parts, p1, p2);
+    if (delta < 0)
+    {
+        ODEM_KERNEL(odem_me12)(force_vec, parts, p1, p2);
+        for (i = 0; i < ODEM_KERNEL_DOF; i++)
+            force_vec[i] *= delta * spring_constant;
+        return 1;
+    }
+    else
+    {
+        for (i = 0; i < ODEM_KERNEL_DOF; i++)
+            force_vec[i] = 0;
+        return 0;
+    }
+}
+
+/**
+ * Particle-particle collision model, spring, for a batch of pairs; mutator
+ *
+ * Same model as odem_mforce_collision_spring, but the separation norm is
+ * computed once per pair and the contact test is applied as a mask, so
+ * several pairs are evaluated per instruction. AVX-512 and AVX2 builds
+ * process 8 and 4 pairs at a time, other builds rely on the compiler to
+ * vectorise the scalar loop, which also handles the remainder.
+ *
+ * @param force_vec Arrays to store the force on the first particle of each
+ *                  pair in, one array per dof
+ * @param parts Particle set
+ * @param first Index of the first particle of each pair
+ * @param second Index of the second particle of each pair
+ * @param num_pairs Number of pairs
+ * @param spring_constant Spring constant, k
+ * @return Number of pairs in contact
+ */
+int ODEM_KERNEL(odem_mforce_collision_spring_batch)(double* const force_vec[],
+    const struct odem_particles* parts, const int first[], const int second[],
+    const int num_pairs, const double spring_constant)
+{
+    int p = 0, tail, collisions = 0;
+
+    #if defined(__AVX512F__)
+        int i;
+        const __m512d zero = _mm512_setzero_pd();
+        const __m512d k = _mm512_set1_pd(spring_constant);
+        for (; p + 8 <= num_pairs; p += 8)
+        {
+            __m512d d[ODEM_KERNEL_DOF], dist2 = zero, dist, delta, scale;
+            __mmask8 contact, valid;
+            const __m256i idx1 = _mm256_loadu_si256(
+                (const __m256i*)(first + p));
+            const __m256i idx2 = _mm256_loadu_si256(
+                (const __m256i*)(second + p));
+
+            for (i = 0; i < ODEM_KERNEL_DOF; i++)
+            {
+                d[i] = _mm512_sub_pd(
+                    _mm512_i32gather_pd(idx2, parts->centroid[i], 8),
+                    _mm512_i32gather_pd(idx1, parts->centroid[i], 8));
+                dist2 = _mm512_add_pd(dist2, _mm512_mul_pd(d[i], d[i]));
+            }
+            dist = _mm512_sqrt_pd(dist2);
+            delta = _mm512_sub_pd(_mm512_sub_pd(dist,
+                _mm512_i32gather_pd(idx1, parts->radius, 8)),
+                _mm512_i32gather_pd(idx2, parts->radius, 8));
+
+            contact = _mm512_cmp_pd_mask(delta, zero, _CMP_LT_OQ);
+            valid = _mm512_cmp_pd_mask(dist, zero, _CMP_NEQ_OQ);
+            scale = _mm512_maskz_mul_pd(contact, delta, k);
+            for (i = 0; i < ODEM_KERNEL_DOF; i++)
+                _mm512_storeu_pd(force_vec[i] + p, _mm512_mul_pd(
+                    _mm512_mask_div_pd(d[i], valid, d[i], dist), scale));
+            collisions += odem_count_lanes(contact);
+        }
+    #elif defined(__AVX2__)
+        int i;
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d k = _mm256_set1_pd(spring_constant);
+        for (; p + 4 <= num_pairs; p += 4)
+        {
+            __m256d d[ODEM_KERNEL_DOF], dist2 = zero, dist, delta, scale,
+                contact, valid;
+            const __m128i idx1 = _mm_loadu_si128((const __m128i*)(first + p));
+            const __m128i idx2 = _mm_loadu_si128((const __m128i*)(second + p));
+
+            for (i = 0; i < ODEM_KERNEL_DOF; i++)
+            {
+                d[i] = _mm256_sub_pd(
+                    _mm256_i32gather_pd(parts->centroid[i], idx2, 8),
+                    _mm256_i32gather_pd(parts->centroid[i], idx1, 8));
+                dist2 = _mm256_add_pd(dist2, _mm256_mul_pd(d[i], d[i]));
+            }
+            dist = _mm256_sqrt_pd(dist2);
+            delta = _mm256_sub_pd(_mm256_sub_pd(dist,
+                _mm256_i32gather_pd(parts->radius, idx1, 8)),
+                _mm256_i32gather_pd(parts->radius, idx2, 8));
+
+            contact = _mm256_cmp_pd(delta, zero, _CMP_LT_OQ);
+            valid = _mm256_cmp_pd(dist, zero, _CMP_NEQ_OQ);
+            scale = _mm256_and_pd(contact, _mm256_mul_pd(delta, k));
+            for (i = 0; i < ODEM_KERNEL_DOF; i++)
+                _mm256_storeu_pd(force_vec[i] + p, _mm256_mul_pd(
+                    _mm256_blendv_pd(d[i], _mm256_div_pd(d[i], dist), valid),
+                    scale));
+            collisions += odem_count_lanes(
+                (unsigned int)_mm256_movemask_pd(contact));
+        }
+    #endif
+
+    tail = p;
+    #pragma omp simd reduction(+:collisions)
+    for (p = tail; p < num_pairs; p++)
+    {
+        int j;
+        double d[ODEM_KERNEL_DOF], dist2 = 0.0, dist, delta, scale;
+        const int p1 = first[p], p2 = second[p];
+
+        /* same operation order as odem_mforce_collision_spring so both
+         * kernels agree to the last bit */
+
+        for (j = 0; j < ODEM_KERNEL_DOF; j++)
+        {
+            d[j] = parts->centroid[j][p2] - parts->centroid[j][p1];
+            dist2 += d[j] * d[j];
+        }
+        dist = sqrt(dist2);
+        delta = dist - parts->radius[p1] - parts->radius[p2];
+
+        /* select rather than branch so the loop stays vectorisable */
+        scale = delta < 0.0 ? delta * spring_constant : 0.0;
+        if (dist == 0.0) dist = 1.0;
+        for (j = 0; j < ODEM_KERNEL_DOF; j++)
+            force_vec[j][p] = d[j] / dist * scale;
+        collisions += delta < 0.0;
+    }
+
+    return collisions;
+}
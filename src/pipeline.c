@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "debug.h"
+#include "pipeline.h"
+
+/**
+ * Writer thread, drains published snapshots until the solver is done
+ *
+ * @param arg Pointer to the pipeline
+ * @return NULL
+ */
+static void* odem_pipeline_drain(void* arg)
+{
+    struct odem_pipeline* pipeline = (struct odem_pipeline*)arg;
+    struct odem_snapshot* snap;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pipeline->lock);
+        while (pipeline->count == 0 && !pipeline->done)
+            pthread_cond_wait(&pipeline->not_empty, &pipeline->lock);
+        if (pipeline->count == 0)
+        {
+            pthread_mutex_unlock(&pipeline->lock);
+            break;
+        }
+        snap = pipeline->slots[pipeline->tail];
+        pthread_mutex_unlock(&pipeline->lock);
+
+        /* the slot is owned by this thread until it is released below */
+        odem_recorder_motion(pipeline->recorder, snap);
+
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->tail = (pipeline->tail + 1) % pipeline->depth;
+        pipeline->count--;
+        pthread_cond_signal(&pipeline->not_full);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * Allocate a recording pipeline on the heap and start its writer thread
+ *
+ * @param recorder Recorder, only used by the writer thread until the
+ *                 pipeline is freed or synced
+ * @param dof Number of dofs of each field
+ * @param num_particles Number of particles per snapshot
+ * @param fields Bit mask of fields per snapshot
+ * @param depth Number of snapshots that may wait to be written, 0 to write
+ *              synchronously
+ * @return Pointer to a new pipeline
+ */
+struct odem_pipeline* odem_alloc_pipeline(struct odem_recorder* recorder,
+    const int dof, const int num_particles, const unsigned int fields,
+    const int depth)
+{
+    int i, num_slots;
+
+    struct odem_pipeline* new_pipeline = (struct odem_pipeline*)malloc(
+        sizeof(struct odem_pipeline));
+    if (new_pipeline == NULL) die("Memory allocation error");
+
+    new_pipeline->recorder = recorder;
+    new_pipeline->depth = depth > 0 ? depth : 0;
+    new_pipeline->head = 0;
+    new_pipeline->tail = 0;
+    new_pipeline->count = 0;
+    new_pipeline->done = 0;
+
+    num_slots = depth > 0 ? depth : 1;
+    new_pipeline->slots = (struct odem_snapshot**)malloc(num_slots *
+        sizeof(struct odem_snapshot*));
+    if (new_pipeline->slots == NULL) die("Memory allocation error");
+    for (i = 0; i < num_slots; i++)
+        new_pipeline->slots[i] = odem_alloc_snapshot(dof, num_particles,
+            fields);
+
+    if (new_pipeline->depth > 0)
+    {
+        pthread_mutex_init(&new_pipeline->lock, NULL);
+        pthread_cond_init(&new_pipeline->not_empty, NULL);
+        pthread_cond_init(&new_pipeline->not_full, NULL);
+        if (pthread_create(&new_pipeline->thread, NULL, odem_pipeline_drain,
+            new_pipeline) != 0)
+            die("Unable to start writer thread");
+    }
+
+    return new_pipeline;
+}
+
+/**
+ * Flush every published snapshot, stop the writer thread and free memory
+ * from a pipeline
+ *
+ * @param pipeline Pointer to pipeline
+ */
+void odem_dealloc_pipeline(struct odem_pipeline* pipeline)
+{
+    int i;
+
+    if (pipeline->depth > 0)
+    {
+        pthread_mutex_lock(&pipeline->lock);
+        pipeline->done = 1;
+        pthread_cond_signal(&pipeline->not_empty);
+        pthread_mutex_unlock(&pipeline->lock);
+
+        pthread_join(pipeline->thread, NULL);
+        pthread_mutex_destroy(&pipeline->lock);
+        pthread_cond_destroy(&pipeline->not_empty);
+        pthread_cond_destroy(&pipeline->not_full);
+    }
+
+    for (i = 0; i < (pipeline->depth > 0 ? pipeline->depth : 1); i++)
+        odem_dealloc_snapshot(pipeline->slots[i]);
+    free(pipeline->slots);
+    free(pipeline);
+}
+
+/**
+ * Get the next free snapshot, blocking while every slot is waiting to be
+ * written
+ *
+ * @param pipeline Pipeline
+ * @return Snapshot to fill, owned by the caller until published
+ */
+struct odem_snapshot* odem_pipeline_acquire(struct odem_pipeline* pipeline)
+{
+    struct odem_snapshot* snap;
+
+    if (pipeline->depth == 0) return pipeline->slots[0];
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (pipeline->count == pipeline->depth)
+        pthread_cond_wait(&pipeline->not_full, &pipeline->lock);
+    snap = pipeline->slots[pipeline->head];
+    pthread_mutex_unlock(&pipeline->lock);
+
+    return snap;
+}
+
+/**
+ * Hand the acquired snapshot over to the writer, mutator
+ *
+ * @param pipeline Pipeline
+ */
+void odem_mpipeline_publish(struct odem_pipeline* pipeline)
+{
+    if (pipeline->depth == 0)
+    {
+        odem_recorder_motion(pipeline->recorder, pipeline->slots[0]);
+        return;
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->head = (pipeline->head + 1) % pipeline->depth;
+    pipeline->count++;
+    pthread_cond_signal(&pipeline->not_empty);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+/**
+ * Block until every published snapshot is written and committed
+ *
+ * @param pipeline Pipeline
+ */
+void odem_pipeline_sync(struct odem_pipeline* pipeline)
+{
+    if (pipeline->depth > 0)
+    {
+        /* the count only drops once a snapshot is written, so the writer
+         * thread is idle once it reaches 0 */
+        pthread_mutex_lock(&pipeline->lock);
+        while (pipeline->count > 0)
+            pthread_cond_wait(&pipeline->not_full, &pipeline->lock);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+
+    odem_recorder_commit(pipeline->recorder);
+}
@@ -0,0 +1,55 @@
+#ifndef __PIPELINE_H
+
+#define __PIPELINE_H 1
+
+#include <pthread.h>
+#include "record.h"
+#include "recorder.h"
+
+// data structures
+
+/**
+ * Bounded producer/consumer queue between the solver and a writer thread
+ *
+ * The solver fills snapshots in a ring of depth slots and a dedicated thread
+ * drains them into the recorder. The solver blocks when every slot is
+ * waiting to be written. A depth of 0 writes each snapshot synchronously on
+ * the solver thread.
+ *
+ * @member recorder Recorder used to drain snapshots
+ * @member slots Ring of snapshots
+ * @member depth Number of slots in the ring, 0 when synchronous
+ * @member head Next slot to be filled by the solver
+ * @member tail Next slot to be drained by the writer thread
+ * @member count Number of filled slots waiting to be written
+ * @member done Whether or not the solver has published its last snapshot
+ * @member lock Mutex guarding head, tail, count and done
+ * @member not_empty Signalled when a slot is published
+ * @member not_full Signalled when a slot is drained
+ * @member thread Writer thread
+ */
+struct odem_pipeline
+{
+    struct odem_recorder* recorder;
+    struct odem_snapshot** slots;
+    int depth;
+    int head;
+    int tail;
+    int count;
+    int done;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    pthread_t thread;
+};
+
+
+// function interfaces
+struct odem_pipeline* odem_alloc_pipeline(struct odem_recorder*,
+    const int, const int, const unsigned int, const int);
+void odem_dealloc_pipeline(struct odem_pipeline*);
+struct odem_snapshot* odem_pipeline_acquire(struct odem_pipeline*);
+void odem_mpipeline_publish(struct odem_pipeline*);
+void odem_pipeline_sync(struct odem_pipeline*);
+
+#endif  /* __PIPELINE_H */
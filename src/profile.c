@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "debug.h"
+#include "profile.h"
+
+/* name of each phase, also used as profile table column names */
+const char* const odem_profile_phase_name[ODEM_NUM_PHASES] =
+    { "integrate", "boundary", "broad_phase", "pair_contact", "record",
+      "checkpoint" };
+
+/* name of each counter, also used as profile table column names */
+const char* const odem_profile_counter_name[ODEM_NUM_COUNTERS] =
+    { "pair_tests", "contacts", "rows", "bytes" };
+
+/**
+ * Read the monotonic wall clock
+ *
+ * @return Wall time in seconds since an arbitrary origin
+ */
+double odem_wall_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/**
+ * Allocate and start a profile on the heap
+ *
+ * @param keep_steps Whether or not to keep the profile of every step
+ * @return Pointer to a new profile
+ */
+struct odem_profile* odem_alloc_profile(const int keep_steps)
+{
+    struct odem_profile* new_prof = (struct odem_profile*)malloc(
+        sizeof(struct odem_profile));
+    if (new_prof == NULL) die("Memory allocation error");
+
+    memset(&new_prof->total, 0, sizeof(struct odem_profile_step));
+    memset(&new_prof->current, 0, sizeof(struct odem_profile_step));
+    new_prof->num_steps = 0;
+    new_prof->capacity = 0;
+    new_prof->steps = NULL;
+    if (keep_steps)
+    {
+        new_prof->capacity = 64;
+        new_prof->steps = (struct odem_profile_step*)malloc(
+            new_prof->capacity * sizeof(struct odem_profile_step));
+        if (new_prof->steps == NULL) die("Memory allocation error");
+    }
+    new_prof->begin = odem_wall_time();
+    new_prof->elapsed = 0.0;
+
+    return new_prof;
+}
+
+/**
+ * Free memory from a profile
+ *
+ * @param prof Pointer to profile
+ */
+void odem_dealloc_profile(struct odem_profile* prof)
+{
+    free(prof->steps);
+    free(prof);
+}
+
+/**
+ * Charge the wall time since a lap start to a phase, mutator
+ *
+ * Returns the current time so consecutive phases can be timed with a single
+ * clock read each.
+ *
+ * @param prof Profile
+ * @param phase Phase to charge
+ * @param since Wall time the phase started at
+ * @return Current wall time
+ */
+double odem_mprofile_lap(struct odem_profile* prof,
+    const enum odem_profile_phase phase, const double since)
+{
+    const double now = odem_wall_time();
+
+    prof->current.phase_time[phase] += now - since;
+    return now;
+}
+
+/**
+ * Add to a counter of the step in progress, mutator
+ *
+ * @param prof Profile
+ * @param counter Counter to add to
+ * @param n Amount to add
+ */
+void odem_mprofile_count(struct odem_profile* prof,
+    const enum odem_profile_counter counter, const long n)
+{
+    prof->current.counters[counter] += n;
+}
+
+/**
+ * Close the step in progress, adding it to the totals; mutator
+ *
+ * @param prof Profile
+ */
+void odem_mprofile_end_step(struct odem_profile* prof)
+{
+    int i;
+
+    for (i = 0; i < ODEM_NUM_PHASES; i++)
+        prof->total.phase_time[i] += prof->current.phase_time[i];
+    for (i = 0; i < ODEM_NUM_COUNTERS; i++)
+        prof->total.counters[i] += prof->current.counters[i];
+
+    if (prof->steps != NULL)
+    {
+        if (prof->num_steps == prof->capacity)
+        {
+            prof->capacity *= 2;
+            prof->steps = (struct odem_profile_step*)realloc(prof->steps,
+                prof->capacity * sizeof(struct odem_profile_step));
+            if (prof->steps == NULL) die("Memory allocation error");
+        }
+        prof->steps[prof->num_steps] = prof->current;
+    }
+    prof->num_steps++;
+
+    memset(&prof->current, 0, sizeof(struct odem_profile_step));
+}
+
+/**
+ * Stop the profile clock, mutator
+ *
+ * Work charged after the last step, e.g. the final flush, is added to the
+ * totals but not to any step.
+ *
+ * @param prof Profile
+ */
+void odem_mprofile_finish(struct odem_profile* prof)
+{
+    int i;
+
+    for (i = 0; i < ODEM_NUM_PHASES; i++)
+        prof->total.phase_time[i] += prof->current.phase_time[i];
+    for (i = 0; i < ODEM_NUM_COUNTERS; i++)
+        prof->total.counters[i] += prof->current.counters[i];
+    memset(&prof->current, 0, sizeof(struct odem_profile_step));
+
+    prof->elapsed = odem_wall_time() - prof->begin;
+}
+
+/**
+ * Display a summary table of a finished profile
+ *
+ * @param prof Profile
+ */
+void odem_print_profile(const struct odem_profile* prof)
+{
+    int i;
+    double timed = 0.0;
+    const double elapsed = prof->elapsed > 0 ? prof->elapsed : 1.0;
+
+    printf("Profile, %d steps in %g seconds of wall time:\n", prof->num_steps,
+        prof->elapsed);
+    printf("\t%-14s %12s %8s\n", "phase", "seconds", "percent");
+    for (i = 0; i < ODEM_NUM_PHASES; i++)
+    {
+        timed += prof->total.phase_time[i];
+        printf("\t%-14s %12.6f %7.2f%%\n", odem_profile_phase_name[i],
+            prof->total.phase_time[i],
+            100.0 * prof->total.phase_time[i] / elapsed);
+    }
+    printf("\t%-14s %12.6f %7.2f%%\n", "other", prof->elapsed - timed,
+        100.0 * (prof->elapsed - timed) / elapsed);
+
+    printf("\t%-14s %12s %12s\n", "counter", "total", "per second");
+    for (i = 0; i < ODEM_NUM_COUNTERS; i++)
+        printf("\t%-14s %12ld %12.4g\n", odem_profile_counter_name[i],
+            prof->total.counters[i], prof->total.counters[i] / elapsed);
+}
@@ -0,0 +1,97 @@
+#ifndef __PROFILE_H
+
+#define __PROFILE_H 1
+
+/**
+ * Phases of a time step timed by the profiler
+ *
+ * ODEM_PHASE_INTEGRATE moves and accelerates particles.
+ * ODEM_PHASE_BOUNDARY clears forces and applies wall contacts.
+ * ODEM_PHASE_BROAD_PHASE bins particles and builds the candidate pairs.
+ * ODEM_PHASE_PAIR_CONTACT evaluates particle-particle contacts.
+ * ODEM_PHASE_RECORD hands snapshots to the writer, including time the
+ * solver is blocked on a full queue and the final flush.
+ * ODEM_PHASE_CHECKPOINT flushes recorded motion and saves checkpoints.
+ */
+enum odem_profile_phase
+{
+    ODEM_PHASE_INTEGRATE,
+    ODEM_PHASE_BOUNDARY,
+    ODEM_PHASE_BROAD_PHASE,
+    ODEM_PHASE_PAIR_CONTACT,
+    ODEM_PHASE_RECORD,
+    ODEM_PHASE_CHECKPOINT,
+    ODEM_NUM_PHASES
+};
+
+/**
+ * Event counters kept by the profiler
+ *
+ * ODEM_COUNTER_PAIR_TESTS counts pairs handed to the contact kernel.
+ * ODEM_COUNTER_CONTACTS counts pairs found in contact.
+ * ODEM_COUNTER_ROWS counts motion rows handed to the writer.
+ * ODEM_COUNTER_BYTES counts bytes of values bound to those rows.
+ */
+enum odem_profile_counter
+{
+    ODEM_COUNTER_PAIR_TESTS,
+    ODEM_COUNTER_CONTACTS,
+    ODEM_COUNTER_ROWS,
+    ODEM_COUNTER_BYTES,
+    ODEM_NUM_COUNTERS
+};
+
+// data structures
+
+/**
+ * Phase times and counters of a single time step
+ *
+ * @member phase_time Wall time spent in each phase, seconds
+ * @member counters Value of each counter
+ */
+struct odem_profile_step
+{
+    double phase_time[ODEM_NUM_PHASES];
+    long counters[ODEM_NUM_COUNTERS];
+};
+
+/**
+ * Wall clock profile of an analysis
+ *
+ * @member begin Wall time the profile was started at
+ * @member elapsed Wall time between start and the last call to finish
+ * @member total Phase times and counters summed over every step
+ * @member current Phase times and counters of the step in progress
+ * @member steps Profile of each finished step, NULL unless kept
+ * @member num_steps Number of finished steps
+ * @member capacity Number of steps there is room for
+ */
+struct odem_profile
+{
+    double begin;
+    double elapsed;
+    struct odem_profile_step total;
+    struct odem_profile_step current;
+    struct odem_profile_step* steps;
+    int num_steps;
+    int capacity;
+};
+
+
+// function interfaces
+double odem_wall_time(void);
+
+struct odem_profile* odem_alloc_profile(const int);
+void odem_dealloc_profile(struct odem_profile*);
+double odem_mprofile_lap(struct odem_profile*, const enum odem_profile_phase,
+    const double);
+void odem_mprofile_count(struct odem_profile*,
+    const enum odem_profile_counter, const long);
+void odem_mprofile_end_step(struct odem_profile*);
+void odem_mprofile_finish(struct odem_profile*);
+void odem_print_profile(const struct odem_profile*);
+
+extern const char* const odem_profile_phase_name[ODEM_NUM_PHASES];
+extern const char* const odem_profile_counter_name[ODEM_NUM_COUNTERS];
+
+#endif  /* __PROFILE_H */
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <sqlite3.h>
 #include "debug.h"
 #include "record.h"
@@ -37,130 +38,581 @@ int odem_exec_noselect_db(sqlite3 *db, const char* sql)
     return rc;
 }
 
+/* column name prefix of each recorded field */
+static const char* const odem_field_prefix[ODEM_NUM_FIELDS] =
+    { "", "v_", "a_", "f_" };
+
+/* column name suffix of each dof */
+static const char* const odem_dof_name[3] = { "x", "y", "z" };
+
+/**
+ * Prepare a statement, exiting on failure
+ *
+ * @param db Database connection
+ * @param sql Statement to prepare
+ * @return Prepared statement
+ */
+static sqlite3_stmt* odem_prepare_db(sqlite3 *db, const char* sql)
+{
+    char msg[256];
+    sqlite3_stmt* stmt;
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK)
+    {
+        snprintf(msg, sizeof(msg), "ERROR: %s\n", sqlite3_errmsg(db));
+        die(msg);
+    }
+
+    return stmt;
+}
+
+/**
+ * Step a prepared insert and reset it for the next set of bindings
+ *
+ * @param db Database connection
+ * @param stmt Prepared statement
+ */
+static void odem_step_insert_db(sqlite3 *db, sqlite3_stmt* stmt)
+{
+    char msg[256];
+
+    if (sqlite3_step(stmt) != SQLITE_DONE)
+    {
+        snprintf(msg, sizeof(msg), "ERROR: %s\n", sqlite3_errmsg(db));
+        die(msg);
+    }
+    sqlite3_reset(stmt);
+}
+
+/**
+ * Apply journal and synchronous pragmas to a database
+ *
+ * Pragmas that report their new value return a row, so they are run through
+ * sqlite3_exec rather than odem_exec_noselect_db.
+ *
+ * @param db Database connection
+ * @param preset Pragma preset
+ */
+void odem_set_db_preset(sqlite3 *db, const enum odem_db_preset preset)
+{
+    char msg[256];
+    const char* sql;
+
+    switch (preset)
+    {
+        case ODEM_DB_FAST:
+            sql = "PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL";
+            break;
+        case ODEM_DB_SCRATCH:
+            sql = "PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF";
+            break;
+        default:
+            return;
+    }
+
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK)
+    {
+        snprintf(msg, sizeof(msg), "ERROR: %s\n", sqlite3_errmsg(db));
+        die(msg);
+    }
+}
+
 /**
  * Initialize a odem results database
  *
+ * The motion table only gets columns for the recorded fields. When bulk
+ * loading, the motion index is left to odem_index_results_db so inserts only
+ * append to the table.
+ *
  * @param db Database connection
- * @return sqlite3 code
+ * @param dof Number of dofs
+ * @param fields Bit mask of recorded fields, see ODEM_FIELD_MASK
+ * @param bulk Whether or not to defer the motion index
  */
-void odem_init_results_db(sqlite3 *db)
+void odem_init_results_db(sqlite3 *db, const int dof,
+    const unsigned int fields, const int bulk)
 {
+    char sql[1024];
+    int i, j, len;
+
     odem_exec_noselect_db(db, "PRAGMA foreign_keys = ON");
 
     odem_exec_noselect_db(db, "CREATE TABLE particle"
         "(particle_id INTEGER PRIMARY KEY AUTOINCREMENT, mass REAL,"
         " radius REAL)");
 
-    #if ODEM_DOF == 3
-        odem_exec_noselect_db(db, "CREATE TABLE model"
-            "(iters INTEGER, delta_time REAL, x_min REAL, x_max REAL,"
-            " y_min REAL, y_max REAL, z_min REAL, z_max REAL)");
-    #elif ODEM_DOF == 2
-        odem_exec_noselect_db(db, "CREATE TABLE model"
-            "(iters INTEGER, delta_time REAL, x_min REAL, x_max REAL,"
-            " y_min REAL, y_max REAL)");
-    #endif
-
-    #if ODEM_DOF == 3
-        odem_exec_noselect_db(db,
-            "CREATE TABLE motion (time REAL, particle_id INTEGER, x REAL,"
-            " y REAL, z REAL, v_x REAL, v_y REAL, v_z REAL, a_x REAL, a_y REAL,"
-            " a_z REAL, f_x REAL, f_y REAL, f_z REAL,"
-            " FOREIGN KEY(particle_id) REFERENCES particle(particle_id))");
-    #elif ODEM_DOF == 2
-        odem_exec_noselect_db(db,
-            "CREATE TABLE motion (time REAL, particle_id INTEGER, x REAL,"
-            " y REAL, v_x REAL, v_y REAL, a_x REAL, a_y REAL, f_x REAL,"
-            " f_y REAL, FOREIGN KEY(particle_id) REFERENCES"
-            " particle(particle_id))");
-    #endif
-    odem_exec_noselect_db(db,
-        "CREATE INDEX time_particle_id_idx ON motion (time, particle_id)");
+    len = snprintf(sql, sizeof(sql),
+        "CREATE TABLE model(iters INTEGER, delta_time REAL");
+    for (j = 0; j < dof; j++)
+        len += snprintf(sql + len, sizeof(sql) - len,
+            ", %s_min REAL, %s_max REAL", odem_dof_name[j], odem_dof_name[j]);
+    snprintf(sql + len, sizeof(sql) - len, ")");
+    odem_exec_noselect_db(db, sql);
+
+    len = snprintf(sql, sizeof(sql),
+        "CREATE TABLE motion (time REAL, particle_id INTEGER");
+    for (i = 0; i < ODEM_NUM_FIELDS; i++)
+    {
+        if (!(fields & ODEM_FIELD_MASK(i))) continue;
+        for (j = 0; j < dof; j++)
+            len += snprintf(sql + len, sizeof(sql) - len, ", %s%s REAL",
+                odem_field_prefix[i], odem_dof_name[j]);
+    }
+    snprintf(sql + len, sizeof(sql) - len, ", FOREIGN KEY(particle_id)"
+        " REFERENCES particle(particle_id))");
+    odem_exec_noselect_db(db, sql);
+
+    if (!bulk) odem_index_results_db(db);
 }
 
 /**
- * Record particle attributes
+ * Create the motion index of a results database unless it exists
+ *
+ * Building it in one pass over a finished table is much cheaper than
+ * maintaining it on every insert.
  *
  * @param db Database connection
- * @param ppart_list Particle linked list
  */
-void odem_record_particle_data(sqlite3 *db, struct odem_particle_node*
-    const ppart_list)
+void odem_index_results_db(sqlite3 *db)
 {
-    char sql[512];
-
-    struct odem_particle_node* curr_node;
+    odem_exec_noselect_db(db, "CREATE INDEX IF NOT EXISTS time_particle_id_idx"
+        " ON motion (time, particle_id)");
+}
 
-    size_t sql_size = sizeof(sql);
+/**
+ * Record particle attributes
+ *
+ * @param db Database connection
+ * @param parts Particle set
+ */
+void odem_record_particle_data(sqlite3 *db, const struct odem_particles* parts)
+{
+    int i;
+    sqlite3_stmt* stmt;
 
-    for (curr_node = ppart_list; curr_node != NULL; curr_node = curr_node->next)
+    odem_exec_noselect_db(db, "BEGIN TRANSACTION");
+    stmt = odem_prepare_db(db, "INSERT INTO particle VALUES (NULL, ?, ?)");
+    for (i = 0; i < parts->num_particles; i++)
     {
-        snprintf(sql, sql_size, "INSERT INTO particle VALUES (NULL, %lf, %lf)",
-            curr_node->ppart->mass, curr_node->ppart->radius);
-        odem_exec_noselect_db(db, sql);
+        sqlite3_bind_double(stmt, 1, parts->mass[i]);
+        sqlite3_bind_double(stmt, 2, parts->radius[i]);
+        odem_step_insert_db(db, stmt);
     }
+    sqlite3_finalize(stmt);
+    odem_exec_noselect_db(db, "COMMIT");
 }
 
 /**
  * Record model constants
  *
  * @param db Database connection
+ * @param dof Number of dofs
  * @param iters Number of iterations
  * @param delta_time Size of time step
  * @param bounds Array of boundary values
  */
-void odem_record_model_data(sqlite3 *db, const int iters, const double
-    delta_time, const double bounds[])
+void odem_record_model_data(sqlite3 *db, const int dof, const int iters,
+    const double delta_time, const double bounds[])
 {
     char sql[512];
+    int i, len;
 
-    #if ODEM_DOF == 3
-        snprintf(sql, sizeof(sql), "INSERT INTO model"
-            " VALUES (%d, %lf, %lf, %lf, %lf, %lf, %lf, %lf)",
-            iters, delta_time, bounds[2*X], bounds[2*X+1], bounds[2*Y],
-            bounds[2*Y+1], bounds[2*Z], bounds[2*Z+1]);
-    #elif ODEM_DOF == 2
-        snprintf(sql, sizeof(sql), "INSERT INTO model"
-            " VALUES (%d, %lf, %lf, %lf, %lf, %lf)",
-            iters, delta_time, bounds[2*X], bounds[2*X+1], bounds[2*Y],
-            bounds[2*Y+1]);
-    #endif
+    len = snprintf(sql, sizeof(sql), "INSERT INTO model VALUES (%d, %lf",
+        iters, delta_time);
+    for (i = 0; i < 2*dof; i++)
+        len += snprintf(sql + len, sizeof(sql) - len, ", %lf", bounds[i]);
+    snprintf(sql + len, sizeof(sql) - len, ")");
 
     odem_exec_noselect_db(db, sql);
 }
 
+/**
+ * Allocate a motion writer on the heap
+ *
+ * The motion insert is prepared once and rows are grouped into transactions
+ * spanning steps_per_txn time steps.
+ *
+ * @param db Database connection
+ * @param dof Number of dofs of each field
+ * @param fields Bit mask of fields in the motion table
+ * @param steps_per_txn Number of time steps per transaction
+ * @return Pointer to a new motion writer
+ */
+struct odem_motion_writer* odem_alloc_motion_writer(sqlite3 *db,
+    const int dof, const unsigned int fields, const int steps_per_txn)
+{
+    char sql[512];
+    int i, j, len;
+
+    struct odem_motion_writer* new_writer = (struct odem_motion_writer*)malloc(
+        sizeof(struct odem_motion_writer));
+    if (new_writer == NULL) die("Memory allocation error");
+
+    new_writer->db = db;
+    new_writer->dof = dof;
+    new_writer->fields = fields;
+    new_writer->steps_per_txn = steps_per_txn > 0 ? steps_per_txn : 1;
+    new_writer->steps_in_txn = 0;
+    new_writer->in_txn = 0;
+    new_writer->insert_sleep = NULL;
+
+    len = snprintf(sql, sizeof(sql), "INSERT INTO motion VALUES (?, ?");
+    for (i = 0; i < ODEM_NUM_FIELDS; i++)
+    {
+        if (!(fields & ODEM_FIELD_MASK(i))) continue;
+        for (j = 0; j < dof; j++)
+            len += snprintf(sql + len, sizeof(sql) - len, ", ?");
+    }
+    snprintf(sql + len, sizeof(sql) - len, ")");
+    new_writer->insert = odem_prepare_db(db, sql);
+
+    return new_writer;
+}
+
+/**
+ * Commit any open transaction and free memory from a motion writer
+ *
+ * @param writer Pointer to motion writer
+ */
+void odem_dealloc_motion_writer(struct odem_motion_writer* writer)
+{
+    if (writer->in_txn) odem_exec_noselect_db(writer->db, "COMMIT");
+    sqlite3_finalize(writer->insert);
+    sqlite3_finalize(writer->insert_sleep);
+    free(writer);
+}
+
+/**
+ * Create the sleep table of a results database unless it exists
+ *
+ * Each row records a particle falling asleep or waking up, see odem_sleep;
+ * the motion table has no rows of a particle while it sleeps.
+ *
+ * @param db Database connection
+ */
+static void odem_create_sleep_table(sqlite3 *db)
+{
+    odem_exec_noselect_db(db, "CREATE TABLE IF NOT EXISTS sleep (time REAL,"
+        " particle_id INTEGER, asleep INTEGER, FOREIGN KEY(particle_id)"
+        " REFERENCES particle(particle_id))");
+}
+
 /**
  * Record particle motion for a single time step
  *
+ * Commits once the writer has seen steps_per_txn time steps. The particles
+ * that fell asleep or woke up go to the sleep table, created on the first.
+ *
+ * @param writer Motion writer
+ * @param snap Snapshot of the time step, holding at least the writer fields
+ */
+void odem_record_motion(struct odem_motion_writer* writer,
+    const struct odem_snapshot* snap)
+{
+    int i, j, f, col;
+    sqlite3_stmt* stmt = writer->insert;
+
+    if (!writer->in_txn)
+    {
+        odem_exec_noselect_db(writer->db, "BEGIN TRANSACTION");
+        writer->in_txn = 1;
+    }
+
+    for (i = 0; i < snap->num_particles; i++)
+    {
+        col = 1;
+        sqlite3_bind_double(stmt, col++, snap->time);
+        sqlite3_bind_int(stmt, col++, snap->particle_id[i]);
+        for (f = 0; f < ODEM_NUM_FIELDS; f++)
+        {
+            if (!(writer->fields & ODEM_FIELD_MASK(f))) continue;
+            for (j = 0; j < writer->dof; j++)
+                sqlite3_bind_double(stmt, col++, snap->data[f][j][i]);
+        }
+
+        odem_step_insert_db(writer->db, stmt);
+    }
+
+    if (snap->num_sleep_changes > 0 && writer->insert_sleep == NULL)
+    {
+        odem_create_sleep_table(writer->db);
+        writer->insert_sleep = odem_prepare_db(writer->db,
+            "INSERT INTO sleep VALUES (?, ?, ?)");
+    }
+    for (i = 0; i < snap->num_sleep_changes; i++)
+    {
+        stmt = writer->insert_sleep;
+        sqlite3_bind_double(stmt, 1, snap->time);
+        sqlite3_bind_int(stmt, 2, snap->sleep_change[i] > 0 ?
+            snap->sleep_change[i] : ~snap->sleep_change[i]);
+        sqlite3_bind_int(stmt, 3, snap->sleep_change[i] > 0);
+        odem_step_insert_db(writer->db, stmt);
+    }
+
+    if (++writer->steps_in_txn < writer->steps_per_txn) return;
+
+    odem_exec_noselect_db(writer->db, "COMMIT");
+    writer->in_txn = 0;
+    writer->steps_in_txn = 0;
+}
+
+/**
+ * Size of the values bound to one motion row
+ *
+ * @param dof Number of dofs of each field
+ * @param fields Bit mask of fields in the motion table
+ * @return Number of bytes of time, particle id and field components
+ */
+size_t odem_motion_row_bytes(const int dof, const unsigned int fields)
+{
+    int i;
+    size_t bytes = sizeof(double) + sizeof(int);
+
+    for (i = 0; i < ODEM_NUM_FIELDS; i++)
+        if (fields & ODEM_FIELD_MASK(i)) bytes += dof * sizeof(double);
+
+    return bytes;
+}
+
+/**
+ * Record the profile of every step in a profile table
+ *
+ * Does nothing unless the profile kept its steps. Steps of a resumed run
+ * replace those recorded before.
+ *
  * @param db Database connection
- * @param time Time of step
- * @param particle_id Id of particle
- * @param ppart Pointer to particle
- * @param accel_vec Acceleration vector of particle for time step
- * @param force_vec Force vector of particle for time step
+ * @param prof Finished profile
+ * @param first_step Number of steps completed before the profile started
+ * @param delta_time Size of time step
  */
-void odem_record_motion(sqlite3 *db, const double time,
-    const int particle_id, const struct odem_particle* ppart,
-    const double accel_vec[], const double force_vec[])
+void odem_record_profile(sqlite3 *db, const struct odem_profile* prof,
+    const int first_step, const double delta_time)
 {
     char sql[512];
+    int i, j, col, len;
+    sqlite3_stmt* stmt;
+
+    if (prof->steps == NULL) return;
+
+    len = snprintf(sql, sizeof(sql), "CREATE TABLE IF NOT EXISTS profile"
+        " (step INTEGER PRIMARY KEY, time REAL");
+    for (i = 0; i < ODEM_NUM_PHASES; i++)
+        len += snprintf(sql + len, sizeof(sql) - len, ", %s REAL",
+            odem_profile_phase_name[i]);
+    for (i = 0; i < ODEM_NUM_COUNTERS; i++)
+        len += snprintf(sql + len, sizeof(sql) - len, ", %s INTEGER",
+            odem_profile_counter_name[i]);
+    snprintf(sql + len, sizeof(sql) - len, ")");
+    odem_exec_noselect_db(db, sql);
+
+    len = snprintf(sql, sizeof(sql), "INSERT OR REPLACE INTO profile"
+        " VALUES (?, ?");
+    for (i = 0; i < ODEM_NUM_PHASES + ODEM_NUM_COUNTERS; i++)
+        len += snprintf(sql + len, sizeof(sql) - len, ", ?");
+    snprintf(sql + len, sizeof(sql) - len, ")");
+
+    odem_exec_noselect_db(db, "BEGIN TRANSACTION");
+    stmt = odem_prepare_db(db, sql);
+    for (i = 0; i < prof->num_steps; i++)
+    {
+        col = 1;
+        sqlite3_bind_int(stmt, col++, first_step + i + 1);
+        sqlite3_bind_double(stmt, col++, (first_step + i + 1) * delta_time);
+        for (j = 0; j < ODEM_NUM_PHASES; j++)
+            sqlite3_bind_double(stmt, col++, prof->steps[i].phase_time[j]);
+        for (j = 0; j < ODEM_NUM_COUNTERS; j++)
+            sqlite3_bind_int64(stmt, col++, prof->steps[i].counters[j]);
+        odem_step_insert_db(db, stmt);
+    }
+    sqlite3_finalize(stmt);
+    odem_exec_noselect_db(db, "COMMIT");
+}
 
-    #if ODEM_DOF == 3
-        snprintf(sql, sizeof(sql), "INSERT INTO motion"
-            " VALUES (%lf, %d, %lf, %lf, %lf, %lf, %lf, %lf, %lf, %lf, %lf,"
-            " %lf, %lf)",
-            time, particle_id, ppart->centroid[X], ppart->centroid[Y],
-            ppart->centroid[Z], ppart->velocity[X], ppart->velocity[Y],
-            accel_vec[X], accel_vec[Y], accel_vec[Z], force_vec[X],
-            force_vec[Y], force_vec[Z]);
-    #elif ODEM_DOF == 2
-        snprintf(sql, sizeof(sql), "INSERT INTO motion"
-            " VALUES (%lf, %d, %lf, %lf, %lf, %lf, %lf, %lf, %lf, %lf)",
-            time, particle_id, ppart->centroid[X], ppart->centroid[Y],
-            ppart->velocity[X], ppart->velocity[Y], accel_vec[X], accel_vec[Y],
-            force_vec[X], force_vec[Y]);
-    #endif
+/**
+ * Create the stats and density tables of a results database unless they
+ * exist
+ *
+ * The stats table holds a row of scalars and a speed histogram per reduced
+ * time step, the density table the packing fraction of each cell, see
+ * odem_stats.
+ *
+ * @param db Database connection
+ */
+static void odem_create_stats_tables(sqlite3 *db)
+{
+    char sql[1024];
+    int i, len;
 
+    len = snprintf(sql, sizeof(sql), "CREATE TABLE IF NOT EXISTS stats"
+        " (time REAL PRIMARY KEY");
+    for (i = 0; i < ODEM_NUM_STATS; i++)
+        len += snprintf(sql + len, sizeof(sql) - len, ", %s %s",
+            odem_stat_name[i], i < ODEM_NUM_STAT_COUNTS ? "INTEGER" : "REAL");
+    for (i = 0; i < ODEM_STATS_SPEED_BINS; i++)
+        len += snprintf(sql + len, sizeof(sql) - len, ", speed_%d INTEGER",
+            i);
+    snprintf(sql + len, sizeof(sql) - len, ")");
     odem_exec_noselect_db(db, sql);
+
+    odem_exec_noselect_db(db, "CREATE TABLE IF NOT EXISTS density"
+        " (time REAL, cell INTEGER, packing REAL, PRIMARY KEY(time, cell))");
 }
 
+/**
+ * Record the finished rows of run statistics in the stats and density
+ * tables, created on the first call
+ *
+ * @param db Database connection
+ * @param stats Statistics
+ */
+void odem_record_stats(sqlite3 *db, const struct odem_stats* stats)
+{
+    char sql[512];
+    int i, j, col, len;
+    const double* row;
+    sqlite3_stmt* stmt;
+    sqlite3_stmt* insert_density;
+
+    odem_create_stats_tables(db);
+
+    len = snprintf(sql, sizeof(sql), "INSERT INTO stats VALUES (?");
+    for (i = 0; i < ODEM_NUM_STATS + ODEM_STATS_SPEED_BINS; i++)
+        len += snprintf(sql + len, sizeof(sql) - len, ", ?");
+    snprintf(sql + len, sizeof(sql) - len, ")");
+
+    odem_exec_noselect_db(db, "BEGIN TRANSACTION");
+    stmt = odem_prepare_db(db, sql);
+    insert_density = odem_prepare_db(db,
+        "INSERT INTO density VALUES (?, ?, ?)");
+    for (i = 0; i < stats->num_rows; i++)
+    {
+        row = odem_stats_row(stats, i);
+        col = 1;
+        sqlite3_bind_double(stmt, col++, stats->time[i]);
+        for (j = 0; j < ODEM_NUM_STATS; j++)
+            if (j < ODEM_NUM_STAT_COUNTS)
+                sqlite3_bind_int64(stmt, col++, (sqlite3_int64)row[j]);
+            else
+                sqlite3_bind_double(stmt, col++, row[j]);
+        for (j = 0; j < ODEM_STATS_SPEED_BINS; j++)
+            sqlite3_bind_int64(stmt, col++,
+                (sqlite3_int64)row[ODEM_NUM_STATS + j]);
+        odem_step_insert_db(db, stmt);
+
+        row += ODEM_NUM_STATS + ODEM_STATS_SPEED_BINS;
+        for (j = 0; j < stats->num_cells; j++)
+        {
+            sqlite3_bind_double(insert_density, 1, stats->time[i]);
+            sqlite3_bind_int(insert_density, 2, j);
+            sqlite3_bind_double(insert_density, 3, row[j]);
+            odem_step_insert_db(db, insert_density);
+        }
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(insert_density);
+    odem_exec_noselect_db(db, "COMMIT");
+}
+
+/**
+ * Commit the open transaction of a motion writer, if any
+ *
+ * @param writer Motion writer, not in use by any other thread
+ */
+void odem_commit_motion(struct odem_motion_writer* writer)
+{
+    if (!writer->in_txn) return;
+
+    odem_exec_noselect_db(writer->db, "COMMIT");
+    writer->in_txn = 0;
+    writer->steps_in_txn = 0;
+}
+
+/**
+ * Delete motion, sleep changes and statistics recorded after a given time,
+ * e.g. past a checkpoint
+ *
+ * @param db Database connection
+ * @param time Time of the last step to keep
+ */
+void odem_truncate_motion(sqlite3 *db, const double time)
+{
+    sqlite3_stmt* stmt = odem_prepare_db(db,
+        "DELETE FROM motion WHERE time > ?");
+
+    sqlite3_bind_double(stmt, 1, time);
+    odem_step_insert_db(db, stmt);
+    sqlite3_finalize(stmt);
+
+    odem_create_sleep_table(db);
+    stmt = odem_prepare_db(db, "DELETE FROM sleep WHERE time > ?");
+    sqlite3_bind_double(stmt, 1, time);
+    odem_step_insert_db(db, stmt);
+    sqlite3_finalize(stmt);
+
+    odem_create_stats_tables(db);
+    stmt = odem_prepare_db(db, "DELETE FROM stats WHERE time > ?");
+    sqlite3_bind_double(stmt, 1, time);
+    odem_step_insert_db(db, stmt);
+    sqlite3_finalize(stmt);
+    stmt = odem_prepare_db(db, "DELETE FROM density WHERE time > ?");
+    sqlite3_bind_double(stmt, 1, time);
+    odem_step_insert_db(db, stmt);
+    sqlite3_finalize(stmt);
+}
+
+/**
+ * Allocate a snapshot on the heap
+ *
+ * @param dof Number of dofs of each field
+ * @param capacity Number of particles to make room for
+ * @param fields Bit mask of fields to make room for
+ * @return Pointer to a new snapshot
+ */
+struct odem_snapshot* odem_alloc_snapshot(const int dof, const int capacity,
+    const unsigned int fields)
+{
+    int i, j, num_fields = 0;
+    double* data;
+    const size_t n = capacity > 0 ? (size_t)capacity : 1;
+
+    for (i = 0; i < ODEM_NUM_FIELDS; i++)
+        if (fields & ODEM_FIELD_MASK(i)) num_fields++;
+
+    struct odem_snapshot* new_snap = (struct odem_snapshot*)malloc(
+        sizeof(struct odem_snapshot) + num_fields * dof * n *
+        sizeof(double) + 2 * n * sizeof(int));
+    if (new_snap == NULL) die("Memory allocation error");
+
+    data = (double*)(new_snap + 1);
+    new_snap->time = 0.0;
+    new_snap->dof = dof;
+    new_snap->num_particles = 0;
+    new_snap->capacity = capacity;
+    new_snap->fields = fields;
+    for (i = 0; i < ODEM_NUM_FIELDS; i++)
+        for (j = 0; j < ODEM_MAX_DOF; j++)
+        {
+            if (fields & ODEM_FIELD_MASK(i) && j < dof)
+            {
+                new_snap->data[i][j] = data;
+                data += n;
+            }
+            else
+                new_snap->data[i][j] = NULL;
+        }
+    new_snap->particle_id = (int*)data;
+    new_snap->num_sleep_changes = 0;
+    new_snap->sleep_change = new_snap->particle_id + n;
+
+    return new_snap;
+}
+
+/**
+ * Free memory from a snapshot
+ *
+ * @param snap Pointer to snapshot
+ */
+void odem_dealloc_snapshot(struct odem_snapshot* snap)
+{
+    free(snap);
+}
@@ -4,14 +4,131 @@
 
 #include <sqlite3.h>
 #include "particle.h"
+#include "profile.h"
+#include "stats.h"
 
-void odem_init_results_db(sqlite3 *);
+/**
+ * Journal and synchronous pragma presets for the results database
+ *
+ * ODEM_DB_SAFE keeps the sqlite defaults, a rollback journal synced on commit.
+ * ODEM_DB_FAST uses a write-ahead log that is only synced at checkpoints.
+ * ODEM_DB_SCRATCH turns off the journal and syncing, a crash loses the file.
+ */
+enum odem_db_preset { ODEM_DB_SAFE, ODEM_DB_FAST, ODEM_DB_SCRATCH };
+
+/**
+ * Vector fields that can be recorded in the motion table
+ */
+enum odem_field
+{
+    ODEM_FIELD_POSITION,
+    ODEM_FIELD_VELOCITY,
+    ODEM_FIELD_ACCELERATION,
+    ODEM_FIELD_FORCE,
+    ODEM_NUM_FIELDS
+};
+
+#define ODEM_FIELD_MASK(field) (1u << (field))
+#define ODEM_ALL_FIELDS (ODEM_FIELD_MASK(ODEM_NUM_FIELDS) - 1)
+
+/**
+ * Trajectory output controls
+ *
+ * @member stride Record every stride-th time step
+ * @member fields Bit mask of recorded fields, see ODEM_FIELD_MASK
+ * @member particle_ids Ascending ids of recorded particles, NULL for all
+ * @member num_particle_ids Number of ids in particle_ids
+ */
+struct odem_record_opts
+{
+    int stride;
+    unsigned int fields;
+    int* particle_ids;
+    int num_particle_ids;
+};
+
+/**
+ * Copy of the recorded state of a set of particles at one time step
+ *
+ * Only the arrays of recorded fields are allocated, all of them carved out of
+ * the same allocation as the snapshot itself.
+ *
+ * @member time Time of step
+ * @member dof Number of dofs of each field
+ * @member num_particles Number of particles in the snapshot
+ * @member capacity Number of particles the snapshot has room for
+ * @member fields Bit mask of fields held by the snapshot
+ * @member particle_id Id of the particle in each row
+ * @member data Components of each field, one array per dof, NULL if the field
+ *              is not recorded
+ * @member num_sleep_changes Number of particles that fell asleep or woke up
+ *                           since the previous snapshot, see odem_sleep
+ * @member sleep_change Id of each particle that fell asleep, ~id of each
+ *                      particle that woke up
+ */
+struct odem_snapshot
+{
+    double time;
+    int dof;
+    int num_particles;
+    int capacity;
+    unsigned int fields;
+    int* particle_id;
+    double* data[ODEM_NUM_FIELDS][ODEM_MAX_DOF];
+    int num_sleep_changes;
+    int* sleep_change;
+};
+
+/**
+ * Bulk writer for the motion table
+ *
+ * @member db Database connection
+ * @member insert Prepared motion insert statement
+ * @member insert_sleep Prepared sleep insert statement, NULL until a particle
+ *                      fell asleep or woke up
+ * @member steps_per_txn Number of time steps grouped into one transaction
+ * @member steps_in_txn Number of time steps written in the open transaction
+ * @member in_txn Whether or not a transaction is open
+ * @member dof Number of dofs of each field
+ * @member fields Bit mask of fields in the motion table
+ */
+struct odem_motion_writer
+{
+    sqlite3 *db;
+    sqlite3_stmt* insert;
+    sqlite3_stmt* insert_sleep;
+    int dof;
+    unsigned int fields;
+    int steps_per_txn;
+    int steps_in_txn;
+    int in_txn;
+};
+
+void odem_set_db_preset(sqlite3 *, const enum odem_db_preset);
+void odem_init_results_db(sqlite3 *, const int, const unsigned int,
+    const int);
+void odem_index_results_db(sqlite3 *);
 int odem_exec_noselect_db(sqlite3 *, const char*);
-void odem_record_particle_data(sqlite3 *, struct odem_particle_node* const);
-void odem_record_model_data(sqlite3 *, const int iters, const double, const
-    double[]);
-void odem_record_motion(sqlite3 *, const double, const int,
-    const struct odem_particle*, const double[], const double[]);
+void odem_record_particle_data(sqlite3 *, const struct odem_particles*);
+void odem_record_model_data(sqlite3 *, const int, const int iters,
+    const double, const double[]);
+
+struct odem_motion_writer* odem_alloc_motion_writer(sqlite3 *, const int,
+    const unsigned int, const int);
+void odem_dealloc_motion_writer(struct odem_motion_writer*);
+void odem_record_motion(struct odem_motion_writer*,
+    const struct odem_snapshot*);
+void odem_commit_motion(struct odem_motion_writer*);
+void odem_truncate_motion(sqlite3 *, const double);
+
+size_t odem_motion_row_bytes(const int, const unsigned int);
+void odem_record_profile(sqlite3 *, const struct odem_profile*, const int,
+    const double);
+void odem_record_stats(sqlite3 *, const struct odem_stats*);
+
+struct odem_snapshot* odem_alloc_snapshot(const int, const int,
+    const unsigned int);
+void odem_dealloc_snapshot(struct odem_snapshot*);
 
 #endif  /* __RECORD_H */
 
@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sqlite3.h>
+
+#include "debug.h"
+#include "recorder.h"
+
+/* sqlite backend */
+
+/**
+ * State of a sqlite recorder
+ *
+ * @member db Database connection
+ * @member writer Motion writer, prepared once the motion table exists
+ * @member dof Number of dofs
+ * @member fields Bit mask of recorded fields
+ * @member steps_per_txn Number of time steps per transaction
+ * @member bulk Whether or not the motion index is built on close
+ */
+struct odem_db_recorder
+{
+    sqlite3 *db;
+    struct odem_motion_writer* writer;
+    int dof;
+    unsigned int fields;
+    int steps_per_txn;
+    int bulk;
+};
+
+static void odem_db_recorder_init(void* impl)
+{
+    struct odem_db_recorder* rec = (struct odem_db_recorder*)impl;
+    odem_init_results_db(rec->db, rec->dof, rec->fields, rec->bulk);
+}
+
+static void odem_db_recorder_particle_data(void* impl,
+    const struct odem_particles* parts)
+{
+    struct odem_db_recorder* rec = (struct odem_db_recorder*)impl;
+    odem_record_particle_data(rec->db, parts);
+}
+
+static void odem_db_recorder_model_data(void* impl, const int iters,
+    const double delta_time, const double bounds[])
+{
+    struct odem_db_recorder* rec = (struct odem_db_recorder*)impl;
+    odem_record_model_data(rec->db, rec->dof, iters, delta_time, bounds);
+}
+
+static void odem_db_recorder_motion(void* impl,
+    const struct odem_snapshot* snap)
+{
+    struct odem_db_recorder* rec = (struct odem_db_recorder*)impl;
+
+    if (rec->writer == NULL)
+        rec->writer = odem_alloc_motion_writer(rec->db, rec->dof,
+            rec->fields, rec->steps_per_txn);
+    odem_record_motion(rec->writer, snap);
+}
+
+static void odem_db_recorder_commit(void* impl)
+{
+    struct odem_db_recorder* rec = (struct odem_db_recorder*)impl;
+    if (rec->writer != NULL) odem_commit_motion(rec->writer);
+}
+
+static void odem_db_recorder_truncate(void* impl, const double time)
+{
+    struct odem_db_recorder* rec = (struct odem_db_recorder*)impl;
+
+    odem_db_recorder_commit(impl);
+    odem_truncate_motion(rec->db, time);
+}
+
+static void odem_db_recorder_profile(void* impl,
+    const struct odem_profile* prof, const int first_step,
+    const double delta_time)
+{
+    struct odem_db_recorder* rec = (struct odem_db_recorder*)impl;
+
+    /* the profile is written in a transaction of its own */
+    odem_db_recorder_commit(impl);
+    odem_record_profile(rec->db, prof, first_step, delta_time);
+}
+
+static void odem_db_recorder_stats(void* impl,
+    const struct odem_stats* stats)
+{
+    struct odem_db_recorder* rec = (struct odem_db_recorder*)impl;
+
+    /* the rows are written in a transaction of their own */
+    odem_db_recorder_commit(impl);
+    odem_record_stats(rec->db, stats);
+}
+
+static void odem_db_recorder_close(void* impl)
+{
+    struct odem_db_recorder* rec = (struct odem_db_recorder*)impl;
+
+    if (rec->writer != NULL) odem_dealloc_motion_writer(rec->writer);
+    if (rec->bulk) odem_index_results_db(rec->db);
+    sqlite3_close(rec->db);
+    free(rec);
+}
+
+/**
+ * Allocate a recorder writing a sqlite results database on the heap
+ *
+ * @param path Path of the results database
+ * @param preset Database journal/sync preset
+ * @param dof Number of dofs
+ * @param fields Bit mask of recorded fields
+ * @param steps_per_txn Number of time steps per transaction
+ * @param bulk Whether or not to index motion once, when the recorder closes
+ * @return Pointer to a new recorder
+ */
+struct odem_recorder* odem_alloc_db_recorder(const char* path,
+    const enum odem_db_preset preset, const int dof,
+    const unsigned int fields, const int steps_per_txn, const int bulk)
+{
+    char msg[256];
+
+    struct odem_db_recorder* impl = (struct odem_db_recorder*)malloc(
+        sizeof(struct odem_db_recorder));
+    struct odem_recorder* new_rec = (struct odem_recorder*)malloc(
+        sizeof(struct odem_recorder));
+    if (impl == NULL || new_rec == NULL) die("Memory allocation error");
+
+    if (sqlite3_open(path, &impl->db) != SQLITE_OK)
+    {
+        snprintf(msg, sizeof(msg), "ERROR opening database: %s\n",
+            sqlite3_errmsg(impl->db));
+        die(msg);
+    }
+    odem_set_db_preset(impl->db, preset);
+    impl->writer = NULL;
+    impl->dof = dof;
+    impl->fields = fields;
+    impl->steps_per_txn = steps_per_txn;
+    impl->bulk = bulk;
+
+    new_rec->impl = impl;
+    new_rec->init = odem_db_recorder_init;
+    new_rec->particle_data = odem_db_recorder_particle_data;
+    new_rec->model_data = odem_db_recorder_model_data;
+    new_rec->motion = odem_db_recorder_motion;
+    new_rec->commit = odem_db_recorder_commit;
+    new_rec->truncate = odem_db_recorder_truncate;
+    new_rec->profile = odem_db_recorder_profile;
+    new_rec->stats = odem_db_recorder_stats;
+    new_rec->close = odem_db_recorder_close;
+
+    return new_rec;
+}
+
+/* recorder interface */
+
+/**
+ * Flush a recorder and free memory from it
+ *
+ * @param rec Pointer to recorder
+ */
+void odem_dealloc_recorder(struct odem_recorder* rec)
+{
+    if (rec->close != NULL) rec->close(rec->impl);
+    free(rec);
+}
+
+/**
+ * Create an empty results store
+ *
+ * @param rec Recorder
+ */
+void odem_recorder_init(struct odem_recorder* rec)
+{
+    if (rec->init != NULL) rec->init(rec->impl);
+}
+
+/**
+ * Record particle attributes
+ *
+ * @param rec Recorder
+ * @param parts Particle set
+ */
+void odem_recorder_particle_data(struct odem_recorder* rec,
+    const struct odem_particles* parts)
+{
+    if (rec->particle_data != NULL) rec->particle_data(rec->impl, parts);
+}
+
+/**
+ * Record model constants
+ *
+ * @param rec Recorder
+ * @param iters Number of iterations
+ * @param delta_time Size of time step
+ * @param bounds Array of boundary values
+ */
+void odem_recorder_model_data(struct odem_recorder* rec, const int iters,
+    const double delta_time, const double bounds[])
+{
+    if (rec->model_data != NULL)
+        rec->model_data(rec->impl, iters, delta_time, bounds);
+}
+
+/**
+ * Record particle motion for a single time step
+ *
+ * @param rec Recorder
+ * @param snap Snapshot of the time step
+ */
+void odem_recorder_motion(struct odem_recorder* rec,
+    const struct odem_snapshot* snap)
+{
+    if (rec->motion != NULL) rec->motion(rec->impl, snap);
+}
+
+/**
+ * Make every recorded snapshot durable
+ *
+ * @param rec Recorder
+ */
+void odem_recorder_commit(struct odem_recorder* rec)
+{
+    if (rec->commit != NULL) rec->commit(rec->impl);
+}
+
+/**
+ * Drop snapshots recorded after a given time, e.g. past a checkpoint
+ *
+ * @param rec Recorder
+ * @param time Time of the last step to keep
+ */
+void odem_recorder_truncate(struct odem_recorder* rec, const double time)
+{
+    if (rec->truncate != NULL) rec->truncate(rec->impl, time);
+}
+
+/**
+ * Record the per-step profile of a run
+ *
+ * @param rec Recorder
+ * @param prof Finished profile
+ * @param first_step Number of steps completed before the profile started
+ * @param delta_time Size of time step
+ */
+void odem_recorder_profile(struct odem_recorder* rec,
+    const struct odem_profile* prof, const int first_step,
+    const double delta_time)
+{
+    if (rec->profile != NULL)
+        rec->profile(rec->impl, prof, first_step, delta_time);
+}
+
+/**
+ * Record the finished rows of run statistics
+ *
+ * @param rec Recorder
+ * @param stats Statistics
+ */
+void odem_recorder_stats(struct odem_recorder* rec,
+    const struct odem_stats* stats)
+{
+    if (rec->stats != NULL) rec->stats(rec->impl, stats);
+}
@@ -0,0 +1,74 @@
+#ifndef __RECORDER_H
+
+#define __RECORDER_H 1
+
+#include "particle.h"
+#include "record.h"
+#include "profile.h"
+#include "stats.h"
+
+/**
+ * Formats results can be recorded in
+ *
+ * ODEM_RECORDER_SQLITE writes the particle, model and motion tables of a
+ * sqlite results database, and the stats tables of runs reducing them.
+ * ODEM_RECORDER_FRAMES appends columnar frames to a binary frame file, see
+ * frames.h, which odem-export converts into a results database.
+ */
+enum odem_recorder_format { ODEM_RECORDER_SQLITE, ODEM_RECORDER_FRAMES };
+
+// data structures
+
+/**
+ * Recorder interface, a results backend and its operations
+ *
+ * Operations a backend does not support are NULL and skipped.
+ *
+ * @member impl Backend state, passed to every operation
+ * @member init Create an empty results store
+ * @member particle_data Record particle attributes
+ * @member model_data Record model constants
+ * @member motion Record one snapshot
+ * @member commit Make every recorded snapshot durable
+ * @member truncate Drop snapshots recorded after a given time
+ * @member profile Record the per-step profile of a run
+ * @member stats Record the finished rows of run statistics
+ * @member close Flush and free the backend state
+ */
+struct odem_recorder
+{
+    void* impl;
+    void (*init)(void*);
+    void (*particle_data)(void*, const struct odem_particles*);
+    void (*model_data)(void*, const int, const double, const double[]);
+    void (*motion)(void*, const struct odem_snapshot*);
+    void (*commit)(void*);
+    void (*truncate)(void*, const double);
+    void (*profile)(void*, const struct odem_profile*, const int,
+        const double);
+    void (*stats)(void*, const struct odem_stats*);
+    void (*close)(void*);
+};
+
+
+// function interfaces
+struct odem_recorder* odem_alloc_db_recorder(const char*,
+    const enum odem_db_preset, const int, const unsigned int, const int,
+    const int);
+struct odem_recorder* odem_alloc_frame_recorder(const char*, const int,
+    const unsigned int, const int);
+void odem_dealloc_recorder(struct odem_recorder*);
+
+void odem_recorder_init(struct odem_recorder*);
+void odem_recorder_particle_data(struct odem_recorder*,
+    const struct odem_particles*);
+void odem_recorder_model_data(struct odem_recorder*, const int, const double,
+    const double[]);
+void odem_recorder_motion(struct odem_recorder*, const struct odem_snapshot*);
+void odem_recorder_commit(struct odem_recorder*);
+void odem_recorder_truncate(struct odem_recorder*, const double);
+void odem_recorder_profile(struct odem_recorder*, const struct odem_profile*,
+    const int, const double);
+void odem_recorder_stats(struct odem_recorder*, const struct odem_stats*);
+
+#endif  /* __RECORDER_H */
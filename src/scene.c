@@ -0,0 +1,839 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <ctype.h>
+
+#include "debug.h"
+#include "scene.h"
+
+/* longest line of a text scene */
+#define ODEM_SCENE_LINE 4096
+
+/* first bytes of a binary scene */
+static const char odem_scene_magic[8] = { 'O', 'D', 'E', 'M', 'S', 'C', 'N',
+    '\0' };
+
+/* written as is so that a file from a machine of other byte order is caught */
+#define ODEM_SCENE_BYTE_ORDER 0x01020304u
+#define ODEM_SCENE_VERSION 1u
+
+/**
+ * Header of a binary scene
+ *
+ * Every member is naturally aligned, so the struct has no padding and is
+ * read and written as is. bounds always has room for three dofs.
+ */
+struct odem_scene_header
+{
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    int32_t dof;
+    int32_t iters;
+    int64_t num_particles;
+    double delta_time;
+    double spring_constant;
+    double bounds[6];
+    uint32_t output_len;
+    uint32_t num_walls;
+};
+
+/**
+ * Contact model of a binary scene, follows the header
+ *
+ * The spring constant is kept in the header.
+ */
+struct odem_scene_contact
+{
+    int32_t law;
+    int32_t num_outlets;
+    double restitution;
+    double tangential_constant;
+    double mu_stick;
+    double mu_glide;
+    double mu_limit;
+    double v_glide;
+    double v_limit;
+    double slope_limit;
+};
+
+/**
+ * Wall of a binary scene, num_walls of them follow the contact model, then
+ * num_outlets boxes of six bounds each
+ *
+ * Vectors always have room for three dofs.
+ */
+struct odem_scene_wall
+{
+    double normal[3];
+    double origin[3];
+    double velocity[3];
+    double extent;
+};
+
+/**
+ * Set a scene to its defaults, no particles and no model parameters
+ *
+ * @param scene Scene to initialize
+ */
+static void odem_init_scene(struct odem_scene* scene)
+{
+    int i;
+
+    scene->parts = NULL;
+    scene->iters = 0;
+    scene->delta_time = 0.0;
+    odem_init_contact_model(&scene->contact);
+    scene->walls = NULL;
+    scene->outlets = NULL;
+    scene->num_outlets = 0;
+    scene->output = NULL;
+    for (i = 0; i < 2*ODEM_MAX_DOF; i++)
+        scene->bounds[i] = 0.0;
+}
+
+/**
+ * Copy a scene into a new heap allocation
+ *
+ * @param model Scene to copy
+ * @return Pointer to a new scene
+ */
+static struct odem_scene* odem_copy_scene(const struct odem_scene* model)
+{
+    struct odem_scene* new_scene = (struct odem_scene*)malloc(
+        sizeof(struct odem_scene));
+    if (new_scene == NULL) die("Memory allocation error");
+    *new_scene = *model;
+    return new_scene;
+}
+
+/**
+ * Allocate an empty scene on the heap
+ *
+ * @param dof Number of dofs, 2 or 3
+ * @param capacity Number of particles to make room for
+ * @return Pointer to a new scene
+ */
+struct odem_scene* odem_alloc_scene(const int dof, const int capacity)
+{
+    struct odem_scene model;
+
+    odem_init_scene(&model);
+    model.parts = odem_alloc_particles(dof, capacity);
+    return odem_copy_scene(&model);
+}
+
+/**
+ * Free memory from a scene, including its particle set
+ *
+ * @param scene Pointer to scene
+ */
+void odem_dealloc_scene(struct odem_scene* scene)
+{
+    if (scene->parts != NULL) odem_dealloc_particles(scene->parts);
+    if (scene->walls != NULL) odem_dealloc_walls(scene->walls);
+    free(scene->outlets);
+    free(scene->output);
+    free(scene);
+}
+
+/**
+ * Exit with an error message pointing at a line of a text scene
+ *
+ * @param path Path of the scene
+ * @param line_no Line number
+ * @param what Description of the error
+ */
+static void odem_scene_error(const char* path, const int line_no,
+    const char* what)
+{
+    char msg[512];
+
+    snprintf(msg, sizeof(msg), "%s:%d: %s", path, line_no, what);
+    errno = 0;
+    die(msg);
+}
+
+/**
+ * Parse a fixed number of numbers from a string
+ *
+ * @param str String to parse
+ * @param values Array to store the numbers in
+ * @param count Number of numbers expected
+ * @return Whether or not exactly count numbers were found
+ */
+static int odem_parse_doubles(const char* str, double values[],
+    const int count)
+{
+    int i;
+    char* end;
+
+    for (i = 0; i < count; i++)
+    {
+        values[i] = strtod(str, &end);
+        if (end == str) return 0;
+        str = end;
+    }
+    while (isspace((unsigned char)*str)) str++;
+
+    return *str == '\0';
+}
+
+/* positive contact model parameters of a text scene, by keyword */
+static const struct
+{
+    const char* keyword;
+    size_t offset;
+} odem_contact_params[] =
+{
+    { "spring_constant", offsetof(struct odem_contact_model,
+        spring_constant) },
+    { "tangential_constant", offsetof(struct odem_contact_model,
+        tangential_constant) },
+    { "mu_stick", offsetof(struct odem_contact_model, mu_stick) },
+    { "mu_glide", offsetof(struct odem_contact_model, mu_glide) },
+    { "mu_limit", offsetof(struct odem_contact_model, mu_limit) },
+    { "v_glide", offsetof(struct odem_contact_model, v_glide) },
+    { "v_limit", offsetof(struct odem_contact_model, v_limit) },
+    { "slope_limit", offsetof(struct odem_contact_model, slope_limit) }
+};
+
+#define ODEM_NUM_CONTACT_PARAMS \
+    (sizeof(odem_contact_params) / sizeof(odem_contact_params[0]))
+
+/**
+ * Contact model parameter named by a text scene keyword
+ *
+ * @param contact Contact model
+ * @param keyword Keyword
+ * @return Pointer to the parameter, NULL if the keyword names none
+ */
+static double* odem_contact_param(struct odem_contact_model* contact,
+    const char* keyword)
+{
+    size_t i;
+
+    for (i = 0; i < ODEM_NUM_CONTACT_PARAMS; i++)
+        if (strcmp(keyword, odem_contact_params[i].keyword) == 0)
+            return (double*)((char*)contact + odem_contact_params[i].offset);
+
+    return NULL;
+}
+
+/**
+ * Whether or not a particle of a scene is valid
+ *
+ * @param mass Particle mass
+ * @param radius Particle radius
+ * @return Whether or not both are positive
+ */
+static int odem_scene_valid_particle(const double mass, const double radius)
+{
+    return mass > 0 && radius > 0;
+}
+
+/**
+ * Whether or not the bounds or an outlet of a scene enclose a box
+ *
+ * @param box Min and max bound per dof
+ * @param dof Number of dofs
+ * @return Whether or not every min bound is below its max bound
+ */
+static int odem_scene_valid_box(const double box[], const int dof)
+{
+    int i;
+
+    for (i = 0; i < dof; i++)
+        if (!(box[2*i] < box[2*i+1])) return 0;
+    return 1;
+}
+
+/**
+ * Whether or not a positive contact model parameter of a scene is valid
+ *
+ * @param value Parameter value
+ * @return Whether or not it is positive
+ */
+static int odem_scene_valid_param(const double value)
+{
+    return value > 0;
+}
+
+/**
+ * Whether or not a coefficient of restitution of a scene is valid
+ *
+ * @param restitution Coefficient of restitution, eta
+ * @return Whether or not it lies in (0, 1], so that ln(eta) is finite
+ */
+static int odem_scene_valid_restitution(const double restitution)
+{
+    return restitution > 0 && restitution <= 1;
+}
+
+/**
+ * Whether or not a wall of a scene is valid
+ *
+ * @param normal Wall normal
+ * @param dof Number of dofs
+ * @param extent Extent of the wall, 0 for an infinite plane
+ * @return Whether or not the normal is nonzero and the extent not negative
+ */
+static int odem_scene_valid_wall(const double normal[], const int dof,
+    const double extent)
+{
+    int i;
+    double length2 = 0.0;
+
+    for (i = 0; i < dof; i++)
+        length2 += normal[i] * normal[i];
+    return length2 > 0 && extent >= 0;
+}
+
+/**
+ * Parse a wall of a text scene: normal and point, then optionally the
+ * extent, then optionally the velocity
+ *
+ * @param str String to parse
+ * @param dof Number of dofs
+ * @param walls Set of walls to add the wall to
+ * @return Whether or not a wall was found
+ */
+static int odem_parse_wall(const char* str, const int dof,
+    struct odem_walls* walls)
+{
+    int i;
+    double values[3*ODEM_MAX_DOF + 1];
+
+    /* values past the end of a shorter wall stay 0 */
+    for (i = 0; i < 3*ODEM_MAX_DOF + 1; i++)
+        values[i] = 0.0;
+    if (!odem_parse_doubles(str, values, 3*dof + 1) &&
+        !odem_parse_doubles(str, values, 2*dof + 1) &&
+        !odem_parse_doubles(str, values, 2*dof))
+        return 0;
+
+    if (!odem_scene_valid_wall(values, dof, values[2*dof])) return 0;
+
+    odem_mwalls_push(walls, values, values + dof, values + 2*dof + 1,
+        values[2*dof]);
+    return 1;
+}
+
+/**
+ * Add an outlet box to a scene, growing its outlets by one; mutator
+ *
+ * @param scene Scene
+ * @return Bounds of the new outlet, zeroed
+ */
+static double* odem_scene_push_outlet(struct odem_scene* scene)
+{
+    int i;
+    double* box;
+
+    scene->outlets = (double*)realloc(scene->outlets,
+        (scene->num_outlets + 1) * 2*ODEM_MAX_DOF * sizeof(double));
+    if (scene->outlets == NULL) die("Memory allocation error");
+
+    box = scene->outlets + 2*ODEM_MAX_DOF*scene->num_outlets++;
+    for (i = 0; i < 2*ODEM_MAX_DOF; i++)
+        box[i] = 0.0;
+    return box;
+}
+
+/**
+ * Load a text scene, streaming it one line at a time
+ *
+ * @param file Scene file, positioned at the start
+ * @param path Path of the scene, for error messages
+ * @return Pointer to a new scene
+ */
+static struct odem_scene* odem_load_scene_text(FILE* file, const char* path)
+{
+    char line[ODEM_SCENE_LINE], keyword[64];
+    char *rest, *end;
+    int line_no = 0, has_bounds = 0, offset, dof = 2;
+    long num_particles = -1;
+    double values[2 + 2*ODEM_MAX_DOF];
+    double* param;
+    struct odem_scene model;
+    struct odem_particles* parts = NULL;
+
+    odem_init_scene(&model);
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        line_no++;
+        if (strchr(line, '\n') == NULL && !feof(file))
+            odem_scene_error(path, line_no, "Line too long.");
+
+        /* strip comments and trailing white space */
+        if ((end = strchr(line, '#')) != NULL) *end = '\0';
+        end = line + strlen(line);
+        while (end > line && isspace((unsigned char)end[-1])) *--end = '\0';
+        for (rest = line; isspace((unsigned char)*rest); rest++);
+        if (*rest == '\0') continue;
+
+        /* particle records */
+        if (parts != NULL && parts->num_particles < num_particles)
+        {
+            if (!odem_parse_doubles(rest, values, 2 + 2*dof))
+                odem_scene_error(path, line_no, "Expected mass, radius,"
+                    " centroid and velocity of a particle.");
+            if (!odem_scene_valid_particle(values[0], values[1]))
+                odem_scene_error(path, line_no, "Particle mass and radius"
+                    " must be positive.");
+            odem_mparticles_push(parts, values[0], values[1], values + 2,
+                values + 2 + dof);
+            continue;
+        }
+
+        /* model parameters */
+        if (sscanf(rest, "%63s%n", keyword, &offset) != 1)
+            odem_scene_error(path, line_no, "Expected a keyword.");
+        rest += offset;
+        while (isspace((unsigned char)*rest)) rest++;
+
+        if (strcmp(keyword, "dof") == 0)
+        {
+            if (!odem_parse_doubles(rest, values, 1) ||
+                (values[0] != 2 && values[0] != 3))
+                odem_scene_error(path, line_no, "Scenes are 2D or 3D.");
+            if (has_bounds || model.walls != NULL || model.num_outlets > 0 ||
+                parts != NULL)
+                odem_scene_error(path, line_no, "dof must come before the"
+                    " bounds, walls, outlets and particles.");
+            dof = (int)values[0];
+        }
+        else if (strcmp(keyword, "iters") == 0)
+        {
+            if (!odem_parse_doubles(rest, values, 1) || values[0] < 1)
+                odem_scene_error(path, line_no, "Invalid iters.");
+            model.iters = (int)values[0];
+        }
+        else if (strcmp(keyword, "delta_time") == 0)
+        {
+            if (!odem_parse_doubles(rest, values, 1) || values[0] <= 0)
+                odem_scene_error(path, line_no, "Invalid delta_time.");
+            model.delta_time = values[0];
+        }
+        else if (strcmp(keyword, "contact_law") == 0)
+        {
+            if (!odem_parse_contact_law(rest, &model.contact.law))
+                odem_scene_error(path, line_no, "Expected a spring, dashpot"
+                    " or friction contact law.");
+        }
+        else if (strcmp(keyword, "restitution") == 0)
+        {
+            if (!odem_parse_doubles(rest, values, 1) ||
+                !odem_scene_valid_restitution(values[0]))
+                odem_scene_error(path, line_no, "Invalid restitution.");
+            model.contact.restitution = values[0];
+        }
+        else if ((param = odem_contact_param(&model.contact, keyword)) !=
+            NULL)
+        {
+            if (!odem_parse_doubles(rest, values, 1) ||
+                !odem_scene_valid_param(values[0]))
+            {
+                snprintf(line, sizeof(line), "Invalid %s.", keyword);
+                odem_scene_error(path, line_no, line);
+            }
+            *param = values[0];
+        }
+        else if (strcmp(keyword, "bounds") == 0)
+        {
+            if (!odem_parse_doubles(rest, model.bounds, 2*dof))
+                odem_scene_error(path, line_no, "Expected a min and max"
+                    " bound per dof.");
+            if (!odem_scene_valid_box(model.bounds, dof))
+                odem_scene_error(path, line_no, "Empty bounds.");
+            has_bounds = 1;
+        }
+        else if (strcmp(keyword, "wall") == 0)
+        {
+            if (model.walls == NULL) model.walls = odem_alloc_walls(dof, 4);
+            if (!odem_parse_wall(rest, dof, model.walls))
+                odem_scene_error(path, line_no, "Expected a wall normal and"
+                    " point, then optionally an extent and a velocity.");
+        }
+        else if (strcmp(keyword, "outlet") == 0)
+        {
+            param = odem_scene_push_outlet(&model);
+            if (!odem_parse_doubles(rest, param, 2*dof))
+                odem_scene_error(path, line_no, "Expected a min and max"
+                    " outlet bound per dof.");
+            if (!odem_scene_valid_box(param, dof))
+                odem_scene_error(path, line_no, "Empty outlet.");
+        }
+        else if (strcmp(keyword, "output") == 0)
+        {
+            if (*rest == '\0')
+                odem_scene_error(path, line_no, "Expected an output path.");
+            free(model.output);
+            model.output = (char*)malloc(strlen(rest) + 1);
+            if (model.output == NULL) die("Memory allocation error");
+            strcpy(model.output, rest);
+        }
+        else if (strcmp(keyword, "particles") == 0)
+        {
+            if (parts != NULL)
+                odem_scene_error(path, line_no, "Particles given twice.");
+            num_particles = strtol(rest, &end, 10);
+            if (end == rest || *end != '\0' || num_particles < 0 ||
+                num_particles > 0x7fffffffL)
+                odem_scene_error(path, line_no, "Invalid particle count.");
+            /* every particle goes into one allocation sized up front */
+            parts = odem_alloc_particles(dof, (int)num_particles);
+        }
+        else
+            odem_scene_error(path, line_no, "Unknown keyword.");
+    }
+
+    if (parts == NULL)
+        odem_scene_error(path, line_no, "Scene has no particles.");
+    if (parts->num_particles < num_particles)
+        odem_scene_error(path, line_no, "Fewer particle records than the"
+            " particle count.");
+    if (!has_bounds)
+        odem_scene_error(path, line_no, "Scene has no bounds.");
+
+    model.parts = parts;
+    return odem_copy_scene(&model);
+}
+
+/**
+ * Read a block of a binary scene, exiting on a short read
+ *
+ * @param file Scene file
+ * @param data Buffer to read into
+ * @param size Number of bytes to read
+ */
+static void odem_scene_read(FILE* file, void* data, const size_t size)
+{
+    if (size > 0 && fread(data, 1, size, file) != size)
+    {
+        errno = 0;
+        die("Truncated scene file.");
+    }
+}
+
+/**
+ * Load a binary scene
+ *
+ * Particle columns are read straight into the particle storage.
+ *
+ * @param file Scene file, positioned after the magic
+ * @return Pointer to a new scene
+ */
+static struct odem_scene* odem_load_scene_binary(FILE* file)
+{
+    int i;
+    size_t n;
+    struct odem_scene_header header;
+    struct odem_scene_contact contact;
+    struct odem_scene_wall wall;
+    struct odem_scene model;
+    struct odem_particles* parts;
+    double *box, *param;
+    size_t k;
+
+    memcpy(header.magic, odem_scene_magic, sizeof(odem_scene_magic));
+    odem_scene_read(file, (char*)&header + sizeof(header.magic),
+        sizeof(header) - sizeof(header.magic));
+
+    errno = 0;
+    if (header.byte_order != ODEM_SCENE_BYTE_ORDER)
+        die("Scene file was written with another byte order.");
+    if (header.version != ODEM_SCENE_VERSION)
+        die("Unsupported scene file version.");
+    if (header.dof != 2 && header.dof != 3)
+        die("Scenes are 2D or 3D.");
+    if (header.num_particles < 0 || header.num_particles > 0x7fffffffL)
+        die("Invalid particle count.");
+    /* 0 leaves iters and delta_time to the run */
+    if (header.iters < 0 || !(header.delta_time >= 0))
+        die("Invalid scene iters or delta_time.");
+
+    odem_init_scene(&model);
+    model.iters = header.iters;
+    model.delta_time = header.delta_time;
+    model.contact.spring_constant = header.spring_constant;
+    for (i = 0; i < 2*header.dof; i++)
+        model.bounds[i] = header.bounds[i];
+    if (!odem_scene_valid_box(model.bounds, header.dof))
+        die("Empty scene bounds.");
+
+    odem_scene_read(file, &contact, sizeof(contact));
+    errno = 0;
+    if (contact.law < ODEM_CONTACT_SPRING ||
+        contact.law > ODEM_CONTACT_FRICTION)
+        die("Invalid scene contact law.");
+    model.contact.law = (enum odem_contact_law)contact.law;
+    model.contact.restitution = contact.restitution;
+    model.contact.tangential_constant = contact.tangential_constant;
+    model.contact.mu_stick = contact.mu_stick;
+    model.contact.mu_glide = contact.mu_glide;
+    model.contact.mu_limit = contact.mu_limit;
+    model.contact.v_glide = contact.v_glide;
+    model.contact.v_limit = contact.v_limit;
+    model.contact.slope_limit = contact.slope_limit;
+    if (!odem_scene_valid_restitution(model.contact.restitution))
+        die("Invalid scene restitution.");
+    for (k = 0; k < ODEM_NUM_CONTACT_PARAMS; k++)
+    {
+        param = odem_contact_param(&model.contact,
+            odem_contact_params[k].keyword);
+        /* a tangential constant of 0 follows the spring constant */
+        if (!odem_scene_valid_param(*param) && !(*param == 0 &&
+            param == &model.contact.tangential_constant))
+            die("Invalid scene contact model parameter.");
+    }
+    if (contact.num_outlets < 0)
+        die("Invalid scene outlet count.");
+    if (header.num_walls > 0)
+    {
+        model.walls = odem_alloc_walls(header.dof, (int)header.num_walls);
+        for (n = 0; n < header.num_walls; n++)
+        {
+            odem_scene_read(file, &wall, sizeof(wall));
+            errno = 0;
+            if (!odem_scene_valid_wall(wall.normal, header.dof, wall.extent))
+                die("Invalid scene wall.");
+            odem_mwalls_push(model.walls, wall.normal, wall.origin,
+                wall.velocity, wall.extent);
+        }
+    }
+    for (i = 0; i < contact.num_outlets; i++)
+    {
+        box = odem_scene_push_outlet(&model);
+        odem_scene_read(file, box, 6 * sizeof(double));
+        errno = 0;
+        if (!odem_scene_valid_box(box, header.dof))
+            die("Empty scene outlet.");
+    }
+    if (header.output_len > 0)
+    {
+        model.output = (char*)malloc(header.output_len + 1);
+        if (model.output == NULL) die("Memory allocation error");
+        odem_scene_read(file, model.output, header.output_len);
+        model.output[header.output_len] = '\0';
+    }
+
+    n = (size_t)header.num_particles;
+    parts = odem_alloc_particles(header.dof, (int)n);
+    odem_scene_read(file, parts->mass, n * sizeof(double));
+    odem_scene_read(file, parts->radius, n * sizeof(double));
+    errno = 0;
+    for (i = 0; i < (int)n; i++)
+        if (!odem_scene_valid_particle(parts->mass[i], parts->radius[i]))
+            die("Particle mass and radius must be positive.");
+    for (i = 0; i < parts->dof; i++)
+        odem_scene_read(file, parts->centroid[i], n * sizeof(double));
+    for (i = 0; i < parts->dof; i++)
+        odem_scene_read(file, parts->velocity[i], n * sizeof(double));
+    for (i = 0; i < parts->dof; i++)
+    {
+        memset(parts->force[i], 0, n * sizeof(double));
+        memcpy(parts->ref_centroid[i], parts->centroid[i], n * sizeof(double));
+    }
+    parts->num_particles = (int)n;
+    odem_mparticles_reset_ids(parts);
+
+    model.parts = parts;
+    return odem_copy_scene(&model);
+}
+
+/**
+ * Load a scene from a file, text or binary
+ *
+ * The format is told apart by the magic at the start of binary scenes.
+ *
+ * @param path Path of the scene
+ * @return Pointer to a new scene
+ */
+struct odem_scene* odem_load_scene(const char* path)
+{
+    char magic[sizeof(odem_scene_magic)];
+    struct odem_scene* scene;
+
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) die("Could not open scene file");
+
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        memcmp(magic, odem_scene_magic, sizeof(magic)) == 0)
+        scene = odem_load_scene_binary(file);
+    else
+    {
+        rewind(file);
+        scene = odem_load_scene_text(file, path);
+    }
+
+    fclose(file);
+    return scene;
+}
+
+/**
+ * Write a binary scene
+ *
+ * @param file File to write to
+ * @param scene Scene
+ */
+static void odem_save_scene_binary(FILE* file, const struct odem_scene* scene)
+{
+    int i, ok;
+    struct odem_scene_header header;
+    struct odem_scene_contact contact;
+    struct odem_scene_wall wall;
+    const struct odem_wall* w;
+    const struct odem_particles* parts = scene->parts;
+    const size_t n = (size_t)parts->num_particles;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, odem_scene_magic, sizeof(odem_scene_magic));
+    header.byte_order = ODEM_SCENE_BYTE_ORDER;
+    header.version = ODEM_SCENE_VERSION;
+    header.dof = parts->dof;
+    header.iters = scene->iters;
+    header.num_particles = parts->num_particles;
+    header.delta_time = scene->delta_time;
+    header.spring_constant = scene->contact.spring_constant;
+    for (i = 0; i < 2*parts->dof; i++)
+        header.bounds[i] = scene->bounds[i];
+    header.output_len = scene->output != NULL ?
+        (uint32_t)strlen(scene->output) : 0;
+    header.num_walls = scene->walls != NULL ?
+        (uint32_t)scene->walls->num_walls : 0;
+
+    memset(&contact, 0, sizeof(contact));
+    contact.law = scene->contact.law;
+    contact.num_outlets = scene->num_outlets;
+    contact.restitution = scene->contact.restitution;
+    contact.tangential_constant = scene->contact.tangential_constant;
+    contact.mu_stick = scene->contact.mu_stick;
+    contact.mu_glide = scene->contact.mu_glide;
+    contact.mu_limit = scene->contact.mu_limit;
+    contact.v_glide = scene->contact.v_glide;
+    contact.v_limit = scene->contact.v_limit;
+    contact.slope_limit = scene->contact.slope_limit;
+
+    ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(&contact, sizeof(contact), 1, file) == 1;
+    for (i = 0; i < (int)header.num_walls; i++)
+    {
+        w = scene->walls->walls + i;
+        memcpy(wall.normal, w->normal, sizeof(wall.normal));
+        memcpy(wall.origin, w->origin, sizeof(wall.origin));
+        memcpy(wall.velocity, w->velocity, sizeof(wall.velocity));
+        wall.extent = w->extent;
+        ok = ok && fwrite(&wall, sizeof(wall), 1, file) == 1;
+    }
+    for (i = 0; i < scene->num_outlets; i++)
+        ok = ok && fwrite(scene->outlets + 2*ODEM_MAX_DOF*i, sizeof(double),
+            6, file) == 6;
+    if (header.output_len > 0)
+        ok = ok && fwrite(scene->output, header.output_len, 1, file) == 1;
+    ok = ok && fwrite(parts->mass, sizeof(double), n, file) == n;
+    ok = ok && fwrite(parts->radius, sizeof(double), n, file) == n;
+    for (i = 0; i < parts->dof; i++)
+        ok = ok && fwrite(parts->centroid[i], sizeof(double), n, file) == n;
+    for (i = 0; i < parts->dof; i++)
+        ok = ok && fwrite(parts->velocity[i], sizeof(double), n, file) == n;
+
+    if (!ok) die("Could not write scene file");
+}
+
+/**
+ * Write a text scene, with enough digits to read back the same values
+ *
+ * @param file File to write to
+ * @param scene Scene
+ */
+static void odem_save_scene_text(FILE* file, const struct odem_scene* scene)
+{
+    int i, j;
+    double value;
+    const struct odem_wall* w;
+    struct odem_contact_model contact = scene->contact;
+    const struct odem_particles* parts = scene->parts;
+
+    fprintf(file, "# openDEM scene\ndof %d\n", parts->dof);
+    if (scene->iters > 0) fprintf(file, "iters %d\n", scene->iters);
+    if (scene->delta_time > 0)
+        fprintf(file, "delta_time %.17g\n", scene->delta_time);
+    fprintf(file, "contact_law %s\n",
+        odem_contact_law_name(scene->contact.law));
+    if (scene->contact.law != ODEM_CONTACT_SPRING)
+        fprintf(file, "restitution %.17g\n", scene->contact.restitution);
+    for (i = 0; i < (int)ODEM_NUM_CONTACT_PARAMS; i++)
+    {
+        /* friction parameters only matter to the friction law, parameters
+         * left at 0 take their derived default */
+        if (i > 0 && contact.law != ODEM_CONTACT_FRICTION) break;
+        value = *odem_contact_param(&contact, odem_contact_params[i].keyword);
+        if (value > 0)
+            fprintf(file, "%s %.17g\n", odem_contact_params[i].keyword, value);
+    }
+    fprintf(file, "bounds");
+    for (i = 0; i < 2*parts->dof; i++)
+        fprintf(file, " %.17g", scene->bounds[i]);
+    fprintf(file, "\n");
+    for (i = 0; scene->walls != NULL && i < scene->walls->num_walls; i++)
+    {
+        w = scene->walls->walls + i;
+        fprintf(file, "wall");
+        for (j = 0; j < parts->dof; j++)
+            fprintf(file, " %.17g", w->normal[j]);
+        for (j = 0; j < parts->dof; j++)
+            fprintf(file, " %.17g", w->origin[j]);
+        if (w->extent > 0 || w->moving)
+            fprintf(file, " %.17g", w->extent);
+        for (j = 0; w->moving && j < parts->dof; j++)
+            fprintf(file, " %.17g", w->velocity[j]);
+        fprintf(file, "\n");
+    }
+    for (i = 0; i < scene->num_outlets; i++)
+    {
+        fprintf(file, "outlet");
+        for (j = 0; j < 2*parts->dof; j++)
+            fprintf(file, " %.17g", scene->outlets[2*ODEM_MAX_DOF*i + j]);
+        fprintf(file, "\n");
+    }
+    if (scene->output != NULL) fprintf(file, "output %s\n", scene->output);
+
+    fprintf(file, "# mass radius centroid velocity\nparticles %d\n",
+        parts->num_particles);
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        fprintf(file, "%.17g %.17g", parts->mass[i], parts->radius[i]);
+        for (j = 0; j < parts->dof; j++)
+            fprintf(file, " %.17g", parts->centroid[j][i]);
+        for (j = 0; j < parts->dof; j++)
+            fprintf(file, " %.17g", parts->velocity[j][i]);
+        fprintf(file, "\n");
+    }
+
+    if (ferror(file)) die("Could not write scene file");
+}
+
+/**
+ * Write a scene to a file
+ *
+ * @param path Path of the scene
+ * @param scene Scene
+ * @param format Scene file format
+ */
+void odem_save_scene(const char* path, const struct odem_scene* scene,
+    const enum odem_scene_format format)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) die("Could not open scene file");
+
+    if (format == ODEM_SCENE_BINARY)
+        odem_save_scene_binary(file, scene);
+    else
+        odem_save_scene_text(file, scene);
+
+    if (fclose(file) != 0) die("Could not write scene file");
+}
@@ -0,0 +1,59 @@
+#ifndef __SCENE_H
+
+#define __SCENE_H 1
+
+#include "particle.h"
+#include "contact.h"
+#include "wall.h"
+
+/**
+ * Scene file formats
+ *
+ * ODEM_SCENE_TEXT is line oriented: "keyword values" lines for the model
+ * parameters and a "particles N" line followed by N records of mass, radius,
+ * centroid and velocity components. Scenes are 2D unless a "dof 3" line
+ * comes before the bounds, walls, outlets and particles.
+ * ODEM_SCENE_BINARY is a fixed header followed by the output path and the
+ * particle columns in the layout of the particle storage, native byte order.
+ */
+enum odem_scene_format { ODEM_SCENE_TEXT, ODEM_SCENE_BINARY };
+
+// data structures
+
+/**
+ * Initial state and model parameters of a simulation
+ *
+ * @member parts Particle set, its dof is the dof of the scene
+ * @member iters Number of iterations, 0 if not given
+ * @member delta_time Size of time step, 0 if not given
+ * @member bounds Array containing boundaries
+ * @member contact Contact model, the defaults of odem_init_contact_model
+ *                 where not given
+ * @member walls Walls besides those of the boundaries, NULL for none
+ * @member outlets Boxes removing the particles that enter them, laid out like
+ *                 bounds, 2*ODEM_MAX_DOF values per box, NULL for none
+ * @member num_outlets Number of outlets
+ * @member output Path of the results database, NULL if not given
+ */
+struct odem_scene
+{
+    struct odem_particles* parts;
+    int iters;
+    double delta_time;
+    double bounds[2*ODEM_MAX_DOF];
+    struct odem_contact_model contact;
+    struct odem_walls* walls;
+    double* outlets;
+    int num_outlets;
+    char* output;
+};
+
+
+// function interfaces
+struct odem_scene* odem_alloc_scene(const int, const int);
+void odem_dealloc_scene(struct odem_scene*);
+struct odem_scene* odem_load_scene(const char*);
+void odem_save_scene(const char*, const struct odem_scene*,
+    const enum odem_scene_format);
+
+#endif  /* __SCENE_H */
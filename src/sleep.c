@@ -0,0 +1,338 @@
+#include <stdlib.h>
+
+#include "debug.h"
+#include "sleep.h"
+
+/**
+ * Allocate the sleep state of a particle set on the heap
+ *
+ * @param parts Particle set
+ * @param steps Number of quiet steps before a particle falls asleep
+ * @param speed Sleep speed, 0 for the default of the run
+ * @return Pointer to a new sleep state, every particle awake
+ */
+struct odem_sleep* odem_alloc_sleep(const struct odem_particles* parts,
+    const int steps, const double speed)
+{
+    int i;
+
+    struct odem_sleep* new_sleep = (struct odem_sleep*)malloc(
+        sizeof(struct odem_sleep));
+    if (new_sleep == NULL) die("Memory allocation error");
+
+    /* particles are never added, every id and index is below next_id */
+    new_sleep->steps = steps;
+    new_sleep->speed = speed;
+    new_sleep->dof = parts->dof;
+    new_sleep->capacity = parts->next_id > 0 ? parts->next_id : 1;
+    new_sleep->quiet = (int*)calloc(new_sleep->capacity, sizeof(int));
+    new_sleep->asleep = (char*)calloc(new_sleep->capacity, 1);
+    new_sleep->recorded = (char*)calloc(new_sleep->capacity, 1);
+    new_sleep->wake = (char*)calloc(new_sleep->capacity, 1);
+    new_sleep->island = (int*)malloc(new_sleep->capacity * sizeof(int));
+    if (new_sleep->quiet == NULL || new_sleep->asleep == NULL ||
+        new_sleep->recorded == NULL || new_sleep->wake == NULL ||
+        new_sleep->island == NULL)
+        die("Memory allocation error");
+    for (i = 0; i < parts->dof; i++)
+    {
+        new_sleep->hold[i] = (double*)calloc(new_sleep->capacity,
+            sizeof(double));
+        new_sleep->rest[i] = (double*)calloc(new_sleep->capacity,
+            sizeof(double));
+        if (new_sleep->hold[i] == NULL || new_sleep->rest[i] == NULL)
+            die("Memory allocation error");
+    }
+    new_sleep->num_asleep = 0;
+    new_sleep->changed = 0;
+    new_sleep->pairs = odem_alloc_pair_list(parts->num_particles);
+
+    return new_sleep;
+}
+
+/**
+ * Free memory from a sleep state
+ *
+ * @param sleep Pointer to sleep state
+ */
+void odem_dealloc_sleep(struct odem_sleep* sleep)
+{
+    int i;
+
+    free(sleep->quiet);
+    free(sleep->asleep);
+    free(sleep->recorded);
+    free(sleep->wake);
+    free(sleep->island);
+    for (i = 0; i < sleep->dof; i++)
+    {
+        free(sleep->hold[i]);
+        free(sleep->rest[i]);
+    }
+    odem_dealloc_pair_list(sleep->pairs);
+    free(sleep);
+}
+
+/**
+ * Keep the pairs of a pair list with at least one awake particle, mutator
+ *
+ * The kept pairs stay in order. Must be called whenever the pair list
+ * changes or a particle fell asleep or woke up.
+ *
+ * @param sleep Sleep state
+ * @param parts Particle set
+ * @param pairs Pair list
+ */
+void odem_msleep_filter_pairs(struct odem_sleep* sleep,
+    const struct odem_particles* parts, const struct odem_pair_list* pairs)
+{
+    int p;
+
+    sleep->pairs->num_pairs = 0;
+    for (p = 0; p < pairs->num_pairs; p++)
+    {
+        if (sleep->asleep[parts->id[pairs->first[p]]] &&
+            sleep->asleep[parts->id[pairs->second[p]]])
+            continue;
+        odem_mpair_list_push(sleep->pairs, pairs->first[p], pairs->second[p]);
+    }
+    sleep->changed = 0;
+}
+
+/**
+ * Add the forces held by the sleeping particles to their net force, mutator
+ *
+ * Must follow the pair forces, so a sleeping particle feels the pairs that
+ * were dropped as well as those still evaluated.
+ *
+ * @param sleep Sleep state
+ * @param parts Particle set
+ */
+void odem_msleep_hold_forces(const struct odem_sleep* sleep,
+    struct odem_particles* parts)
+{
+    int i;
+
+    if (sleep->num_asleep == 0) return;
+
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        int j;
+        const int id = parts->id[i];
+
+        if (!sleep->asleep[id]) continue;
+        for (j = 0; j < parts->dof; j++)
+            parts->force[j][i] += sleep->hold[j][id];
+    }
+}
+
+/**
+ * Root of a particle index in the islands being woken, halving the path
+ *
+ * @param island Parent of each particle index
+ * @param i Particle index
+ * @return Root of the island of the particle
+ */
+static int odem_sleep_island_root(int* island, int i)
+{
+    while (island[i] != i)
+    {
+        island[i] = island[island[i]];
+        i = island[i];
+    }
+
+    return i;
+}
+
+/**
+ * Wake the islands of the sleeping particles marked to wake, mutator
+ *
+ * Sleeping particles are joined by the candidate pairs between them, which
+ * hold every dropped pair, so a woken island takes all the forces its
+ * particles held with it and they are evaluated again.
+ *
+ * @param sleep Sleep state, the particles to wake marked
+ * @param parts Particle set
+ * @param candidates Candidate pairs of the step, sleeping or not
+ * @return Number of particles woken
+ */
+static int odem_msleep_wake_islands(struct odem_sleep* sleep,
+    const struct odem_particles* parts,
+    const struct odem_pair_list* candidates)
+{
+    int i, j, p, a, b, woke = 0;
+    int* island = sleep->island;
+
+    for (i = 0; i < parts->num_particles; i++)
+        island[i] = i;
+    for (p = 0; p < candidates->num_pairs; p++)
+    {
+        a = candidates->first[p];
+        b = candidates->second[p];
+        if (!sleep->asleep[parts->id[a]] || !sleep->asleep[parts->id[b]])
+            continue;
+        a = odem_sleep_island_root(island, a);
+        b = odem_sleep_island_root(island, b);
+        if (a == b) continue;
+        /* an island to wake keeps a root marked to wake */
+        if (sleep->wake[b])
+            island[a] = b;
+        else
+            island[b] = a;
+    }
+
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        const int id = parts->id[i];
+
+        if (!sleep->asleep[id] ||
+            !sleep->wake[odem_sleep_island_root(island, i)])
+            continue;
+        sleep->asleep[id] = 0;
+        sleep->quiet[id] = 0;
+        for (j = 0; j < parts->dof; j++)
+            sleep->hold[j][id] = 0.0;
+        woke++;
+    }
+
+    return woke;
+}
+
+/**
+ * Put the particles that stayed quiet long enough to sleep and wake up the
+ * islands of the sleeping particles pushed hard enough, once they were
+ * accelerated; mutator
+ *
+ * Woken particles keep the velocity their net force gave them, as they felt
+ * the pairs they held. The pairs between a particle that fell asleep and a
+ * sleeping particle are dropped from the next step on, their forces of this
+ * step are held by both particles. Sleeping particles that stay asleep are
+ * stopped again, so they do not move at the next step.
+ *
+ * @param sleep Sleep state
+ * @param parts Particle set, accelerated by the net force of the step
+ * @param forces Pair forces of the step, indexed for the pairs of the sleep
+ *               state
+ * @param candidates Candidate pairs of the step
+ * @param delta_time Time of step
+ */
+void odem_msleep_settle(struct odem_sleep* sleep,
+    struct odem_particles* parts, const struct odem_pair_forces* forces,
+    const struct odem_pair_list* candidates, const double delta_time)
+{
+    int i, j, p, fell = 0, woke = 0;
+    const double speed2 = sleep->speed * sleep->speed;
+
+    #pragma omp parallel for schedule(static) reduction(+:fell,woke)
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        int k;
+        double v2 = 0.0, dv2 = 0.0, d;
+        const int id = parts->id[i];
+        const double scale = delta_time / parts->mass[i];
+
+        sleep->wake[i] = 0;
+        if (sleep->asleep[id])
+        {
+            /* pushed away from rest, accelerated from rest */
+            for (k = 0; k < parts->dof; k++)
+            {
+                d = parts->force[k][i] - sleep->rest[k][id];
+                dv2 += d * d;
+            }
+            if (dv2 * scale * scale >= speed2)
+            {
+                sleep->wake[i] = 1;
+                woke++;
+            }
+            continue;
+        }
+
+        for (k = 0; k < parts->dof; k++)
+        {
+            v2 += parts->velocity[k][i] * parts->velocity[k][i];
+            dv2 += parts->force[k][i] * parts->force[k][i];
+        }
+        dv2 *= scale * scale;
+
+        if (v2 >= speed2 || dv2 >= speed2)
+            sleep->quiet[id] = 0;
+        else if (++sleep->quiet[id] >= sleep->steps)
+        {
+            sleep->wake[i] = 2;
+            fell++;
+        }
+    }
+
+    if (woke > 0) woke = odem_msleep_wake_islands(sleep, parts, candidates);
+
+    /* pairs newly between sleeping particles, from the pairs evaluated */
+    if (fell > 0)
+    {
+        for (i = 0; i < parts->num_particles; i++)
+        {
+            const int id = parts->id[i];
+
+            if (sleep->wake[i] != 2) continue;
+            sleep->asleep[id] = 1;
+            for (j = 0; j < parts->dof; j++)
+            {
+                sleep->rest[j][id] = parts->force[j][i];
+                sleep->hold[j][id] = 0.0;
+            }
+        }
+        for (p = 0; p < sleep->pairs->num_pairs; p++)
+        {
+            const int a = sleep->pairs->first[p];
+            const int b = sleep->pairs->second[p];
+
+            if (!sleep->asleep[parts->id[a]] || !sleep->asleep[parts->id[b]])
+                continue;
+            for (j = 0; j < parts->dof; j++)
+            {
+                sleep->hold[j][parts->id[a]] += forces->force[j][p];
+                sleep->hold[j][parts->id[b]] -= forces->force[j][p];
+            }
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        int k;
+
+        if (!sleep->asleep[parts->id[i]]) continue;
+        for (k = 0; k < parts->dof; k++)
+            parts->velocity[k][i] = 0.0;
+    }
+
+    sleep->num_asleep += fell - woke;
+    if (fell > 0 || woke > 0) sleep->changed = 1;
+}
+
+/**
+ * Note whether a particle fell asleep or woke up since the last snapshot in
+ * a snapshot, mutator
+ *
+ * Sleeping particles are left out of snapshots, except for the snapshot
+ * after they fell asleep, which holds their state at rest.
+ *
+ * @param sleep Sleep state
+ * @param snap Snapshot being filled
+ * @param id Particle id
+ * @return Whether or not the snapshot records the particle
+ */
+int odem_msleep_record(struct odem_sleep* sleep, struct odem_snapshot* snap,
+    const int id)
+{
+    const int asleep = sleep->asleep[id];
+
+    if (asleep == sleep->recorded[id]) return !asleep;
+
+    /* recorded ids count from 1 */
+    snap->sleep_change[snap->num_sleep_changes++] = asleep ? id + 1 :
+        ~(id + 1);
+    sleep->recorded[id] = (char)asleep;
+    return 1;
+}
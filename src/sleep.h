@@ -0,0 +1,79 @@
+#ifndef __SLEEP_H
+
+#define __SLEEP_H 1
+
+#include "particle.h"
+#include "grid.h"
+#include "record.h"
+#include "force.h"
+
+// data structures
+
+/**
+ * Sleeping particles of a run
+ *
+ * A particle is quiet over a step when both its speed and the speed its net
+ * force would give it from rest stay below the sleep speed. After a number
+ * of quiet steps in a row it falls asleep: it is stopped, its net force is
+ * kept as its rest force and its pairs with other sleeping particles are no
+ * longer evaluated. Each sleeping particle holds the forces of those pairs
+ * as they were when they were dropped, so a settled bed stays balanced. A
+ * sleeping particle wakes up once its net force has moved away from its
+ * rest force by enough to push it past the sleep speed in one step, and
+ * wakes its island, the sleeping particles it reaches through pairs of
+ * sleeping particles, along with it.
+ *
+ * The state is kept by particle id, so it does not move with the particles
+ * when they are reordered or removed.
+ *
+ * @member steps Number of quiet steps before a particle falls asleep
+ * @member speed Sleep speed, 0 for the default of the run
+ * @member dof Number of dofs
+ * @member capacity Number of particle ids the arrays have room for
+ * @member quiet Number of quiet steps in a row of each particle id
+ * @member asleep Whether or not each particle id is asleep
+ * @member recorded Whether or not each particle id was asleep at the last
+ *                  snapshot
+ * @member hold Force of the dropped pairs on each particle id
+ * @member rest Net force on each particle id when it fell asleep
+ * @member num_asleep Number of sleeping particles
+ * @member changed Whether or not a particle fell asleep or woke up since the
+ *                 pairs were last filtered
+ * @member pairs Pairs with at least one awake particle
+ * @member wake Whether or not each particle index wakes up this step
+ * @member island Parent of each particle index in the islands being woken
+ */
+struct odem_sleep
+{
+    int steps;
+    double speed;
+    int dof;
+    int capacity;
+    int* quiet;
+    char* asleep;
+    char* recorded;
+    double* hold[ODEM_MAX_DOF];
+    double* rest[ODEM_MAX_DOF];
+    int num_asleep;
+    int changed;
+    struct odem_pair_list* pairs;
+    char* wake;
+    int* island;
+};
+
+
+// function interfaces
+struct odem_sleep* odem_alloc_sleep(const struct odem_particles*, const int,
+    const double);
+void odem_dealloc_sleep(struct odem_sleep*);
+void odem_msleep_filter_pairs(struct odem_sleep*,
+    const struct odem_particles*, const struct odem_pair_list*);
+void odem_msleep_hold_forces(const struct odem_sleep*,
+    struct odem_particles*);
+void odem_msleep_settle(struct odem_sleep*, struct odem_particles*,
+    const struct odem_pair_forces*, const struct odem_pair_list*,
+    const double);
+int odem_msleep_record(struct odem_sleep*, struct odem_snapshot*,
+    const int);
+
+#endif  /* __SLEEP_H */
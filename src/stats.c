@@ -0,0 +1,307 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "debug.h"
+#include "stats.h"
+
+#define ODEM_PI 3.14159265358979323846
+
+/* name of each scalar, also used as stats table column names */
+const char* const odem_stat_name[ODEM_NUM_STATS] =
+    { "contacts", "wall_contacts", "kinetic_energy", "elastic_energy",
+      "mean_overlap", "max_overlap", "max_speed" };
+
+/**
+ * Allocate the statistics of a run on the heap
+ *
+ * @param dof Number of dofs
+ * @param stride Reduce every stride-th time step
+ * @param cells Number of density cells along each dof
+ * @param bounds Array containing boundaries, the extent of the density grid
+ * @param spring_constant Normal spring constant, k
+ * @return Pointer to new statistics without rows
+ */
+struct odem_stats* odem_alloc_stats(const int dof, const int stride,
+    const int cells, const double bounds[], const double spring_constant)
+{
+    int i;
+
+    struct odem_stats* new_stats = (struct odem_stats*)malloc(
+        sizeof(struct odem_stats));
+    if (new_stats == NULL) die("Memory allocation error");
+
+    new_stats->stride = stride;
+    new_stats->dof = dof;
+    new_stats->cells = cells;
+    new_stats->num_cells = 1;
+    for (i = 0; i < dof; i++)
+    {
+        new_stats->num_cells *= cells;
+        new_stats->lower[i] = bounds[2*i];
+        new_stats->cell_size[i] = (bounds[2*i+1] - bounds[2*i]) / cells;
+    }
+    new_stats->spring_constant = spring_constant;
+    new_stats->row_size = ODEM_NUM_STATS + ODEM_STATS_SPEED_BINS +
+        new_stats->num_cells;
+    new_stats->num_rows = 0;
+    new_stats->capacity = ODEM_STATS_ROWS;
+    new_stats->time = (double*)malloc(new_stats->capacity * sizeof(double));
+    new_stats->values = (double*)malloc(new_stats->capacity *
+        new_stats->row_size * sizeof(double));
+    if (new_stats->time == NULL || new_stats->values == NULL)
+        die("Memory allocation error");
+
+    return new_stats;
+}
+
+/**
+ * Free memory from statistics
+ *
+ * @param stats Pointer to statistics
+ */
+void odem_dealloc_stats(struct odem_stats* stats)
+{
+    free(stats->time);
+    free(stats->values);
+    free(stats);
+}
+
+/**
+ * Values of a row
+ *
+ * @param stats Statistics
+ * @param row Row, num_rows for the row being reduced
+ * @return Scalars of the row, followed by its speed histogram and its
+ *         packing fractions
+ */
+double* odem_stats_row(const struct odem_stats* stats, const int row)
+{
+    return stats->values + (size_t)row * stats->row_size;
+}
+
+/**
+ * Start reducing a row, mutator
+ *
+ * The contacts and the motion of the row are then reduced in either order,
+ * a distributed run sums the partial rows of the ranks, and the row is
+ * finished by odem_mstats_end.
+ *
+ * @param stats Statistics, with room for a row
+ * @param time Time of step
+ */
+void odem_mstats_begin(struct odem_stats* stats, const double time)
+{
+    stats->time[stats->num_rows] = time;
+    memset(odem_stats_row(stats, stats->num_rows), 0,
+        stats->row_size * sizeof(double));
+}
+
+/**
+ * Overlap of a particle pair, -delta of the pair contact
+ *
+ * @param parts Particle set
+ * @param a Index of the first particle
+ * @param b Index of the second particle
+ * @return Overlap, 0 when the particles do not touch
+ */
+static double odem_pair_overlap(const struct odem_particles* parts,
+    const int a, const int b)
+{
+    int j;
+    double dx, dist2 = 0.0;
+    const double reach = parts->radius[a] + parts->radius[b];
+
+    for (j = 0; j < parts->dof; j++)
+    {
+        dx = parts->centroid[j][b] - parts->centroid[j][a];
+        dist2 += dx * dx;
+    }
+
+    return dist2 < reach * reach ? reach - sqrt(dist2) : 0.0;
+}
+
+/**
+ * Reduce the contacts of a row, mutator
+ *
+ * Until the row is finished the mean overlap holds the sum of the overlaps.
+ * In a distributed run the particle set holds ghosts after the owned
+ * particles; a pair with a ghost is counted by the rank owning its particle
+ * of lower id, so the ranks count every pair once.
+ *
+ * @param stats Statistics
+ * @param parts Particle set, at the positions of the force evaluation
+ * @param pairs Candidate pairs, NULL to test every pair
+ * @param walls Walls at the time of the force evaluation
+ * @param num_owned Number of particles owned by this rank, the number of
+ *                  particles in a serial run
+ */
+void odem_mstats_contacts(struct odem_stats* stats,
+    const struct odem_particles* parts, const struct odem_pair_list* pairs,
+    const struct odem_walls* walls, const int num_owned)
+{
+    int a, i, p, w;
+    long contacts = 0, wall_contacts = 0;
+    double elastic = 0.0, overlap = 0.0, max_overlap = 0.0, d;
+    double* row = odem_stats_row(stats, stats->num_rows);
+
+    if (pairs != NULL)
+    {
+        #pragma omp parallel for schedule(static) \
+            reduction(+:contacts,elastic,overlap) reduction(max:max_overlap)
+        for (p = 0; p < pairs->num_pairs; p++)
+        {
+            const int first = pairs->first[p], second = pairs->second[p];
+            double depth;
+
+            if (first >= num_owned && second >= num_owned) continue;
+            if (first >= num_owned &&
+                parts->id[second] > parts->id[first])
+                continue;
+            if (second >= num_owned &&
+                parts->id[first] > parts->id[second])
+                continue;
+
+            depth = odem_pair_overlap(parts, first, second);
+            if (depth <= 0) continue;
+            contacts++;
+            overlap += depth;
+            elastic += depth * depth;
+            if (depth > max_overlap) max_overlap = depth;
+        }
+    }
+    else
+    {
+        #pragma omp parallel for schedule(dynamic, 64) \
+            reduction(+:contacts,elastic,overlap) reduction(max:max_overlap)
+        for (a = 0; a < num_owned; a++)
+        {
+            int b;
+            double depth;
+
+            for (b = a + 1; b < num_owned; b++)
+            {
+                depth = odem_pair_overlap(parts, a, b);
+                if (depth <= 0) continue;
+                contacts++;
+                overlap += depth;
+                elastic += depth * depth;
+                if (depth > max_overlap) max_overlap = depth;
+            }
+        }
+    }
+
+    for (i = 0; i < num_owned; i++)
+        for (w = 0; w < walls->num_walls; w++)
+        {
+            d = odem_wall_overlap(walls->walls + w, parts, i);
+            if (d <= 0) continue;
+            wall_contacts++;
+            elastic += d * d;
+        }
+
+    row[ODEM_STAT_CONTACTS] += contacts;
+    row[ODEM_STAT_WALL_CONTACTS] += wall_contacts;
+    row[ODEM_STAT_ELASTIC_ENERGY] += 0.5 * stats->spring_constant * elastic;
+    row[ODEM_STAT_MEAN_OVERLAP] += overlap;
+    if (max_overlap > row[ODEM_STAT_MAX_OVERLAP])
+        row[ODEM_STAT_MAX_OVERLAP] = max_overlap;
+}
+
+/**
+ * Largest speed of a particle set
+ *
+ * @param parts Particle set
+ * @return Largest particle speed, 0 without particles
+ */
+double odem_max_speed(const struct odem_particles* parts)
+{
+    int i, j;
+    double v2, max_v2 = 0.0;
+
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        v2 = 0.0;
+        for (j = 0; j < parts->dof; j++)
+            v2 += parts->velocity[j][i] * parts->velocity[j][i];
+        if (v2 > max_v2) max_v2 = v2;
+    }
+
+    return sqrt(max_v2);
+}
+
+/**
+ * Reduce the kinetic energy, speed histogram and density of a row, mutator
+ *
+ * Until the row is finished the packing fractions hold the volume of the
+ * particles in each cell. Particles outside of the bounds count for the
+ * nearest cell.
+ *
+ * @param stats Statistics
+ * @param parts Particle set, only the particles owned by this rank
+ * @param max_speed Largest particle speed, over every rank
+ */
+void odem_mstats_motion(struct odem_stats* stats,
+    const struct odem_particles* parts, const double max_speed)
+{
+    int i, j, bin, cell, stride, c;
+    double v2, speed, volume;
+    double* row = odem_stats_row(stats, stats->num_rows);
+    double* speeds = row + ODEM_NUM_STATS;
+    double* packing = speeds + ODEM_STATS_SPEED_BINS;
+
+    row[ODEM_STAT_MAX_SPEED] = max_speed;
+    for (i = 0; i < parts->num_particles; i++)
+    {
+        v2 = 0.0;
+        for (j = 0; j < parts->dof; j++)
+            v2 += parts->velocity[j][i] * parts->velocity[j][i];
+        row[ODEM_STAT_KINETIC_ENERGY] += 0.5 * parts->mass[i] * v2;
+
+        speed = sqrt(v2);
+        bin = max_speed > 0 ? (int)(speed / max_speed *
+            ODEM_STATS_SPEED_BINS) : 0;
+        speeds[bin < ODEM_STATS_SPEED_BINS ? bin :
+            ODEM_STATS_SPEED_BINS - 1] += 1.0;
+
+        cell = 0;
+        stride = 1;
+        for (j = 0; j < parts->dof; j++)
+        {
+            c = (int)floor((parts->centroid[j][i] - stats->lower[j]) /
+                stats->cell_size[j]);
+            if (c < 0) c = 0;
+            if (c >= stats->cells) c = stats->cells - 1;
+            cell += c * stride;
+            stride *= stats->cells;
+        }
+        volume = parts->dof == 3 ?
+            4.0 / 3.0 * ODEM_PI * pow(parts->radius[i], 3) :
+            ODEM_PI * parts->radius[i] * parts->radius[i];
+        packing[cell] += volume;
+    }
+}
+
+/**
+ * Finish the row being reduced, mutator
+ *
+ * @param stats Statistics
+ * @return Whether or not the rows are full and must be recorded and cleared
+ *         before the next row begins
+ */
+int odem_mstats_end(struct odem_stats* stats)
+{
+    int i;
+    double cell_volume = 1.0;
+    double* row = odem_stats_row(stats, stats->num_rows);
+    double* packing = row + ODEM_NUM_STATS + ODEM_STATS_SPEED_BINS;
+
+    if (row[ODEM_STAT_CONTACTS] > 0)
+        row[ODEM_STAT_MEAN_OVERLAP] /= row[ODEM_STAT_CONTACTS];
+    for (i = 0; i < stats->dof; i++)
+        cell_volume *= stats->cell_size[i];
+    for (i = 0; i < stats->num_cells; i++)
+        packing[i] /= cell_volume;
+
+    return ++stats->num_rows == stats->capacity;
+}
@@ -0,0 +1,106 @@
+#ifndef __STATS_H
+
+#define __STATS_H 1
+
+#include "particle.h"
+#include "grid.h"
+#include "wall.h"
+
+/**
+ * Scalars reduced over the particles at a time step
+ *
+ * ODEM_STAT_CONTACTS counts the particle pairs in contact, each pair once.
+ * ODEM_STAT_WALL_CONTACTS counts the particles in contact with a wall, once
+ * per wall.
+ * ODEM_STAT_KINETIC_ENERGY sums 1/2*m*v^2 over the particles.
+ * ODEM_STAT_ELASTIC_ENERGY sums 1/2*k*delta^2 over the particle and wall
+ * contacts, the energy held by the normal springs.
+ * ODEM_STAT_MEAN_OVERLAP averages the overlap, -delta, of the particle pairs
+ * in contact.
+ * ODEM_STAT_MAX_OVERLAP is the largest overlap of a particle pair.
+ * ODEM_STAT_MAX_SPEED is the largest particle speed, the speed histogram
+ * spans 0 to it.
+ */
+enum odem_stat
+{
+    ODEM_STAT_CONTACTS,
+    ODEM_STAT_WALL_CONTACTS,
+    ODEM_STAT_KINETIC_ENERGY,
+    ODEM_STAT_ELASTIC_ENERGY,
+    ODEM_STAT_MEAN_OVERLAP,
+    ODEM_STAT_MAX_OVERLAP,
+    ODEM_STAT_MAX_SPEED,
+    ODEM_NUM_STATS
+};
+
+/* the counts lead the scalars, they are recorded as integers */
+#define ODEM_NUM_STAT_COUNTS 2
+
+/* number of bins of the speed histogram */
+#define ODEM_STATS_SPEED_BINS 8
+
+/* number of rows kept before they are handed to the recorder */
+#define ODEM_STATS_ROWS 1024
+
+// data structures
+
+/**
+ * Statistics of a run, reduced in the step loop every stride-th time step
+ *
+ * Each row holds the scalars of enum odem_stat, the number of particles in
+ * each of ODEM_STATS_SPEED_BINS equal bins of speed between 0 and the
+ * largest speed, and the packing fraction of each cell of a coarse grid
+ * over the bounds: the volume of the particles whose centroid lies in the
+ * cell over the volume of the cell. Cells are numbered along the first dof
+ * first.
+ *
+ * A row is reduced in parts, see odem_mstats_begin, and finished rows are
+ * kept until they are recorded and cleared.
+ *
+ * @member stride Reduce every stride-th time step
+ * @member dof Number of dofs
+ * @member cells Number of density cells along each dof
+ * @member num_cells Number of density cells
+ * @member lower Lower bound of the density grid along each dof
+ * @member cell_size Edge length of a density cell along each dof
+ * @member spring_constant Normal spring constant, k
+ * @member row_size Number of values per row
+ * @member num_rows Number of finished rows
+ * @member capacity Number of rows there is room for
+ * @member time Time of each row
+ * @member values Values of each row, row_size per row; the row being
+ *                reduced follows the finished rows
+ */
+struct odem_stats
+{
+    int stride;
+    int dof;
+    int cells;
+    int num_cells;
+    double lower[ODEM_MAX_DOF];
+    double cell_size[ODEM_MAX_DOF];
+    double spring_constant;
+    int row_size;
+    int num_rows;
+    int capacity;
+    double* time;
+    double* values;
+};
+
+
+// function interfaces
+struct odem_stats* odem_alloc_stats(const int, const int, const int,
+    const double[], const double);
+void odem_dealloc_stats(struct odem_stats*);
+double* odem_stats_row(const struct odem_stats*, const int);
+void odem_mstats_begin(struct odem_stats*, const double);
+void odem_mstats_contacts(struct odem_stats*, const struct odem_particles*,
+    const struct odem_pair_list*, const struct odem_walls*, const int);
+double odem_max_speed(const struct odem_particles*);
+void odem_mstats_motion(struct odem_stats*, const struct odem_particles*,
+    const double);
+int odem_mstats_end(struct odem_stats*);
+
+extern const char* const odem_stat_name[ODEM_NUM_STATS];
+
+#endif  /* __STATS_H */
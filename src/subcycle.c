@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "debug.h"
+#include "subcycle.h"
+
+/**
+ * Lightest mass of class 0
+ *
+ * The classes are anchored on the lightest particle, which lands in the
+ * finest class, and as few classes are used as keep the heaviest particle
+ * out of the classes below class 0.
+ *
+ * @param parts Particle set
+ * @param max_classes Largest number of classes
+ * @return Reference mass, 0 for an empty set
+ */
+static double odem_subcycle_reference_mass(const struct odem_particles* parts,
+    const int max_classes)
+{
+    int i, num_classes = 1;
+    double min_mass, max_mass;
+
+    if (parts->num_particles == 0) return 0.0;
+
+    min_mass = max_mass = parts->mass[0];
+    for (i = 1; i < parts->num_particles; i++)
+    {
+        if (parts->mass[i] < min_mass) min_mass = parts->mass[i];
+        if (parts->mass[i] > max_mass) max_mass = parts->mass[i];
+    }
+    while (num_classes < max_classes &&
+        ldexp(min_mass, 2 * num_classes) <= max_mass)
+        num_classes++;
+
+    return ldexp(min_mass, 2 * (num_classes - 1));
+}
+
+/**
+ * Class of a particle mass
+ *
+ * @param sub Time step classes
+ * @param mass Particle mass, no lighter than 4^(1-num_classes) times the
+ *             reference mass
+ * @return Class, the first whose step is short enough for the mass
+ */
+static int odem_subcycle_class(const struct odem_subcycle* sub,
+    const double mass)
+{
+    int c = 0;
+
+    /* powers of two scale exactly */
+    while (c < ODEM_MAX_STEP_CLASSES - 1 &&
+        ldexp(mass, 2 * c) < sub->reference_mass)
+        c++;
+
+    return c;
+}
+
+/**
+ * Critical time step of class 0 for the spring contact model, the time step
+ * that steps every particle at a safety fraction of its critical time step
+ * is that safety fraction of this value
+ *
+ * @param parts Particle set
+ * @param spring_constant Spring constant, k
+ * @param max_classes Largest number of classes
+ * @return Critical time step, 0 for an empty set
+ */
+double odem_subcycle_time_step(const struct odem_particles* parts,
+    const double spring_constant, const int max_classes)
+{
+    return sqrt(odem_subcycle_reference_mass(parts, max_classes) /
+        spring_constant);
+}
+
+/**
+ * Allocate the time step classes of a particle set on the heap
+ *
+ * @param parts Particle set
+ * @param max_classes Largest number of classes, at most
+ *                    ODEM_MAX_STEP_CLASSES
+ * @return Pointer to new time step classes, every particle classified
+ */
+struct odem_subcycle* odem_alloc_subcycle(const struct odem_particles* parts,
+    const int max_classes)
+{
+    int i, c;
+
+    if (max_classes < 1 || max_classes > ODEM_MAX_STEP_CLASSES)
+        die("Unsupported number of time step classes.");
+
+    struct odem_subcycle* new_sub = (struct odem_subcycle*)malloc(
+        sizeof(struct odem_subcycle));
+    if (new_sub == NULL) die("Memory allocation error");
+
+    new_sub->reference_mass = odem_subcycle_reference_mass(parts,
+        max_classes);
+    new_sub->level = NULL;
+    new_sub->capacity = 0;
+    new_sub->pair_stride = NULL;
+    new_sub->first = NULL;
+    new_sub->second = NULL;
+    new_sub->pair_capacity = 0;
+    odem_msubcycle_classify(new_sub, parts);
+
+    /* particles are never added, so no class finer than these is needed */
+    new_sub->num_classes = 1;
+    for (i = 0; i < parts->num_particles; i++)
+        if (new_sub->level[i] >= new_sub->num_classes)
+            new_sub->num_classes = new_sub->level[i] + 1;
+    new_sub->num_substeps = 1 << (new_sub->num_classes - 1);
+    for (c = 0; c < ODEM_MAX_STEP_CLASSES; c++)
+    {
+        new_sub->num_pairs_from[c] = 0;
+        new_sub->keep[c] = c < new_sub->num_classes ?
+            ldexp(1.0, c + 1 - new_sub->num_classes) : 0.0;
+    }
+
+    return new_sub;
+}
+
+/**
+ * Free memory from time step classes
+ *
+ * @param sub Pointer to time step classes
+ */
+void odem_dealloc_subcycle(struct odem_subcycle* sub)
+{
+    free(sub->level);
+    free(sub->pair_stride);
+    free(sub->first);
+    free(sub->second);
+    free(sub);
+}
+
+/**
+ * Classify every particle, mutator
+ *
+ * Must be called whenever particles move to other indices.
+ *
+ * @param sub Time step classes
+ * @param parts Particle set
+ */
+void odem_msubcycle_classify(struct odem_subcycle* sub,
+    const struct odem_particles* parts)
+{
+    int i;
+
+    if (parts->num_particles > sub->capacity)
+    {
+        sub->capacity = parts->num_particles;
+        free(sub->level);
+        sub->level = (int*)malloc(sub->capacity * sizeof(int));
+        if (sub->level == NULL) die("Memory allocation error");
+    }
+
+    #pragma omp parallel for schedule(static)
+    for (i = 0; i < parts->num_particles; i++)
+        sub->level[i] = odem_subcycle_class(sub, parts->mass[i]);
+}
+
+/**
+ * Sort a pair list by the class of its finer particle, finest class first,
+ * and set the stride of every pair, mutator
+ *
+ * The sort is stable, so pairs keep their order within a class. Must be
+ * called whenever the pair list changes.
+ *
+ * @param sub Time step classes, every particle classified
+ * @param pairs Pair list
+ */
+void odem_msubcycle_sort_pairs(struct odem_subcycle* sub,
+    struct odem_pair_list* pairs)
+{
+    int p, c, k;
+    int start[ODEM_MAX_STEP_CLASSES] = { 0 };
+    const int finest = sub->num_classes - 1;
+
+    if (pairs->num_pairs > sub->pair_capacity)
+    {
+        if (sub->pair_capacity < 1) sub->pair_capacity = 1;
+        while (sub->pair_capacity < pairs->num_pairs)
+            sub->pair_capacity *= 2;
+        sub->pair_stride = (int*)realloc(sub->pair_stride,
+            sub->pair_capacity * sizeof(int));
+        sub->first = (int*)realloc(sub->first,
+            sub->pair_capacity * sizeof(int));
+        sub->second = (int*)realloc(sub->second,
+            sub->pair_capacity * sizeof(int));
+        if (sub->pair_stride == NULL || sub->first == NULL ||
+            sub->second == NULL)
+            die("Memory allocation error");
+    }
+
+    for (p = 0; p < pairs->num_pairs; p++)
+    {
+        c = sub->level[pairs->first[p]];
+        if (sub->level[pairs->second[p]] > c)
+            c = sub->level[pairs->second[p]];
+        start[c]++;
+    }
+    for (c = finest, k = 0; c >= 0; c--)
+    {
+        k += start[c];
+        start[c] = k - start[c];
+        sub->num_pairs_from[c] = k;
+    }
+
+    for (p = 0; p < pairs->num_pairs; p++)
+    {
+        c = sub->level[pairs->first[p]];
+        if (sub->level[pairs->second[p]] > c)
+            c = sub->level[pairs->second[p]];
+        k = start[c]++;
+        sub->first[k] = pairs->first[p];
+        sub->second[k] = pairs->second[p];
+        sub->pair_stride[k] = 1 << (finest - c);
+    }
+    memcpy(pairs->first, sub->first, pairs->num_pairs * sizeof(int));
+    memcpy(pairs->second, sub->second, pairs->num_pairs * sizeof(int));
+}
+
+/**
+ * Coarsest class whose step ends with a substep
+ *
+ * @param sub Time step classes
+ * @param substep Substep of the time step, from 1 to num_substeps
+ * @return Class, every finer class is due as well
+ */
+int odem_subcycle_due(const struct odem_subcycle* sub, const int substep)
+{
+    int c = sub->num_classes - 1, s = substep;
+
+    while (c > 0 && s % 2 == 0)
+    {
+        s /= 2;
+        c--;
+    }
+
+    return c;
+}
+
+/**
+ * Keep the contacts restored into a store, e.g. from a checkpoint, alive
+ * until their pair is next evaluated, mutator
+ *
+ * Restored contacts are contacts of the current step; the pairs of coarse
+ * classes are only evaluated again once their stride has passed.
+ *
+ * @param sub Time step classes, every particle classified
+ * @param parts Particle set
+ * @param store Contact store
+ */
+void odem_msubcycle_renew_contacts(const struct odem_subcycle* sub,
+    const struct odem_particles* parts, struct odem_contact_store* store)
+{
+    int i, c, lo, hi;
+    struct odem_contact* contact;
+
+    /* class of every particle id, -1 for removed particles */
+    int* id_level = (int*)malloc((parts->next_id + 1) * sizeof(int));
+    if (id_level == NULL) die("Memory allocation error");
+    for (i = 0; i < parts->next_id; i++)
+        id_level[i] = -1;
+    for (i = 0; i < parts->num_particles; i++)
+        id_level[parts->id[i]] = sub->level[i];
+
+    for (i = 0; i < store->capacity; i++)
+    {
+        contact = store->slots + i;
+        if (contact->key == ODEM_CONTACT_EMPTY ||
+            contact->step < store->step)
+            continue;
+
+        lo = (int)(contact->key >> 32);
+        hi = (int)(contact->key & 0xffffffffu);
+        if (lo >= parts->next_id || hi >= parts->next_id ||
+            id_level[lo] < 0 || id_level[hi] < 0)
+            continue;
+        c = id_level[lo] > id_level[hi] ? id_level[lo] : id_level[hi];
+        contact->step = store->step + (1 << (sub->num_classes - 1 - c)) - 1;
+    }
+
+    free(id_level);
+}
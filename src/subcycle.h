@@ -0,0 +1,73 @@
+#ifndef __SUBCYCLE_H
+
+#define __SUBCYCLE_H 1
+
+#include "particle.h"
+#include "grid.h"
+#include "contact.h"
+
+/* largest number of time step classes, the finest takes 2^7 substeps */
+#define ODEM_MAX_STEP_CLASSES 8
+
+// data structures
+
+/**
+ * Time step classes of a sub-cycled run
+ *
+ * Particles are put into classes by their critical time step sqrt(m/k):
+ * class c takes 2^c steps of delta_time / 2^c per time step, and holds the
+ * particles at most 4^c times lighter than the reference mass, so each
+ * steps at the same fraction of its critical time step as the reference or
+ * less. A time step is split into substeps of the finest class.
+ *
+ * Every particle moves every substep. A pair is evaluated at the rate of its
+ * finer particle, and its force counts for the substeps until its next
+ * evaluation on both particles. Particles are accelerated at the end of
+ * their own step by the forces they gathered over it, so the impulses
+ * exchanged between classes stay equal and opposite.
+ *
+ * @member num_classes Number of classes in use
+ * @member num_substeps Number of substeps per time step, 2^(num_classes-1)
+ * @member reference_mass Lightest mass of class 0
+ * @member level Class of each particle
+ * @member capacity Number of particles level has room for
+ * @member num_pairs_from Number of pairs of each class or finer, the pairs
+ *                        are sorted finest class first
+ * @member pair_stride Number of substeps between evaluations of each pair
+ * @member first Scratch first particles for sorting pairs
+ * @member second Scratch second particles for sorting pairs
+ * @member pair_capacity Number of pairs the pair arrays have room for
+ * @member keep Factor each class keeps its gathered force with at the end
+ *              of a time step, the mean force over its last step
+ */
+struct odem_subcycle
+{
+    int num_classes;
+    int num_substeps;
+    double reference_mass;
+    int* level;
+    int capacity;
+    int num_pairs_from[ODEM_MAX_STEP_CLASSES];
+    int* pair_stride;
+    int* first;
+    int* second;
+    int pair_capacity;
+    double keep[ODEM_MAX_STEP_CLASSES];
+};
+
+
+// function interfaces
+double odem_subcycle_time_step(const struct odem_particles*, const double,
+    const int);
+struct odem_subcycle* odem_alloc_subcycle(const struct odem_particles*,
+    const int);
+void odem_dealloc_subcycle(struct odem_subcycle*);
+void odem_msubcycle_classify(struct odem_subcycle*,
+    const struct odem_particles*);
+void odem_msubcycle_sort_pairs(struct odem_subcycle*,
+    struct odem_pair_list*);
+int odem_subcycle_due(const struct odem_subcycle*, const int);
+void odem_msubcycle_renew_contacts(const struct odem_subcycle*,
+    const struct odem_particles*, struct odem_contact_store*);
+
+#endif  /* __SUBCYCLE_H */
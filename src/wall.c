@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include "debug.h"
+#include "wall.h"
+
+/**
+ * Allocate an empty set of walls on the heap
+ *
+ * @param dof Number of dofs
+ * @param capacity Number of walls to make room for
+ * @return Pointer to a new set of walls
+ */
+struct odem_walls* odem_alloc_walls(const int dof, const int capacity)
+{
+    struct odem_walls* new_walls = (struct odem_walls*)malloc(
+        sizeof(struct odem_walls));
+    if (new_walls == NULL) die("Memory allocation error");
+
+    new_walls->dof = dof;
+    new_walls->num_walls = 0;
+    new_walls->capacity = capacity > 0 ? capacity : 1;
+    new_walls->walls = (struct odem_wall*)malloc(new_walls->capacity *
+        sizeof(struct odem_wall));
+    if (new_walls->walls == NULL) die("Memory allocation error");
+    new_walls->num_moving = 0;
+    new_walls->grid = NULL;
+    new_walls->cells = NULL;
+    new_walls->num_cells = 0;
+
+    return new_walls;
+}
+
+/**
+ * Free memory from a set of walls
+ *
+ * @param walls Pointer to set of walls
+ */
+void odem_dealloc_walls(struct odem_walls* walls)
+{
+    free(walls->walls);
+    free(walls->cells);
+    free(walls);
+}
+
+/**
+ * Add a wall to a set, growing it as needed; mutator
+ *
+ * @param walls Set of walls
+ * @param normal Normal pointing into the domain, normalized here
+ * @param origin Point on the wall at time 0
+ * @param velocity Velocity of the wall, NULL for a static wall
+ * @param extent Largest distance of a contact from the point of the wall in
+ *               the plane of the wall, 0 for an infinite plane
+ */
+void odem_mwalls_push(struct odem_walls* walls, const double normal[],
+    const double origin[], const double velocity[], const double extent)
+{
+    int i;
+    double length = 0.0;
+    struct odem_wall* wall;
+
+    for (i = 0; i < walls->dof; i++)
+        length += normal[i] * normal[i];
+    if (length == 0.0) die("Wall normal must be nonzero.");
+    length = sqrt(length);
+
+    if (walls->num_walls == walls->capacity)
+    {
+        walls->capacity *= 2;
+        walls->walls = (struct odem_wall*)realloc(walls->walls,
+            walls->capacity * sizeof(struct odem_wall));
+        if (walls->walls == NULL) die("Memory allocation error");
+    }
+    wall = walls->walls + walls->num_walls;
+
+    wall->moving = 0;
+    for (i = 0; i < ODEM_MAX_DOF; i++)
+    {
+        wall->normal[i] = i < walls->dof ? normal[i] / length : 0.0;
+        wall->origin[i] = i < walls->dof ? origin[i] : 0.0;
+        wall->velocity[i] = i < walls->dof && velocity != NULL ?
+            velocity[i] : 0.0;
+        wall->point[i] = wall->origin[i];
+        if (wall->velocity[i] != 0.0) wall->moving = 1;
+    }
+    wall->extent = extent;
+
+    walls->num_moving += wall->moving;
+    walls->num_walls++;
+}
+
+/**
+ * Add the min and max wall of every dof of an axis aligned box; mutator
+ *
+ * @param walls Set of walls
+ * @param bounds Array containing boundaries
+ */
+void odem_mwalls_push_bounds(struct odem_walls* walls, const double bounds[])
+{
+    int i, j;
+    double normal[ODEM_MAX_DOF], origin[ODEM_MAX_DOF];
+
+    for (i = 0; i < walls->dof; i++)
+    {
+        for (j = 0; j < walls->dof; j++)
+        {
+            normal[j] = 0.0;
+            origin[j] = bounds[2*j];
+        }
+
+        normal[i] = 1.0;
+        odem_mwalls_push(walls, normal, origin, NULL, 0.0);
+
+        normal[i] = -1.0;
+        origin[i] = bounds[2*i+1];
+        odem_mwalls_push(walls, normal, origin, NULL, 0.0);
+    }
+}
+
+/**
+ * Add copies of the walls of another set; mutator
+ *
+ * @param walls Set of walls
+ * @param other Set of walls to copy, of the same dof
+ */
+void odem_mwalls_append(struct odem_walls* walls,
+    const struct odem_walls* other)
+{
+    int i;
+    const struct odem_wall* wall;
+
+    if (other->dof != walls->dof) die("Wall dofs differ.");
+    for (i = 0; i < other->num_walls; i++)
+    {
+        wall = other->walls + i;
+        odem_mwalls_push(walls, wall->normal, wall->origin, wall->velocity,
+            wall->extent);
+    }
+}
+
+/**
+ * Move the walls to where they are at a point in time; mutator
+ *
+ * Positions are computed from time 0 rather than stepped, so a run resumed
+ * from a checkpoint sees the same walls.
+ *
+ * @param walls Set of walls
+ * @param time Time
+ */
+void odem_mwalls_at(struct odem_walls* walls, const double time)
+{
+    int i, j;
+    struct odem_wall* wall;
+
+    for (i = 0; i < walls->num_walls; i++)
+    {
+        wall = walls->walls + i;
+        if (!wall->moving) continue;
+        for (j = 0; j < walls->dof; j++)
+            wall->point[j] = wall->origin[j] + wall->velocity[j] * time;
+    }
+}
+
+/**
+ * Depth a particle overlaps a wall by, -delta of the wall contact
+ *
+ * Follows the wall contact of the force kernels, a finite wall touches
+ * particles from either side.
+ *
+ * @param wall Wall at the current time
+ * @param parts Particle set
+ * @param index Index of particle
+ * @return Overlap, 0 when the particle does not touch the wall
+ */
+double odem_wall_overlap(const struct odem_wall* wall,
+    const struct odem_particles* parts, const int index)
+{
+    int i;
+    double offset[ODEM_MAX_DOF];
+    double dist = 0.0, tangent2 = 0.0, d;
+
+    for (i = 0; i < parts->dof; i++)
+    {
+        offset[i] = parts->centroid[i][index] - wall->point[i];
+        dist += wall->normal[i] * offset[i];
+    }
+
+    if (wall->extent > 0)
+    {
+        for (i = 0; i < parts->dof; i++)
+        {
+            d = offset[i] - dist * wall->normal[i];
+            tangent2 += d * d;
+        }
+        if (tangent2 > wall->extent * wall->extent) return 0.0;
+        dist = fabs(dist);
+    }
+
+    return dist < parts->radius[index] ? parts->radius[index] - dist : 0.0;
+}
+
+/**
+ * Whether or not a box may hold the centroid of a particle touching a wall
+ *
+ * @param wall Static wall
+ * @param dof Number of dofs
+ * @param centre Centre of the box
+ * @param half Half the edge lengths of the box
+ * @param reach Largest distance of a touching centroid from the wall
+ * @return Whether or not the box is within reach of the wall
+ */
+static int odem_wall_reaches(const struct odem_wall* wall, const int dof,
+    const double centre[], const double half[], const double reach)
+{
+    int i;
+    double dist = 0.0, spread = 0.0, diag2 = 0.0, centre2 = 0.0, d;
+
+    for (i = 0; i < dof; i++)
+    {
+        d = centre[i] - wall->point[i];
+        dist += wall->normal[i] * d;
+        spread += fabs(wall->normal[i]) * half[i];
+        centre2 += d * d;
+        diag2 += half[i] * half[i];
+    }
+
+    /* infinite walls hold back every particle behind them */
+    if (wall->extent <= 0) return dist - spread < reach;
+
+    return fabs(dist) - spread < reach &&
+        sqrt(centre2) - sqrt(diag2) < wall->extent + reach;
+}
+
+/**
+ * Collect the grid cells within reach of a static wall; mutator
+ *
+ * The grid keeps its geometry for the whole run, so this is done once.
+ * Particles must then be binned by the grid before each use of the cells and
+ * the static walls must not change. Particles outside of the grid are binned
+ * into its edge cells, which are only collected near the walls of the
+ * domain.
+ *
+ * @param walls Set of walls
+ * @param grid Grid, NULL to check every particle
+ * @param reach Largest distance of a centroid from a wall it touches at
+ *              binning time, at least the largest radius
+ */
+void odem_mwalls_cull(struct odem_walls* walls, const struct odem_grid* grid,
+    const double reach)
+{
+    int c, i, w, cell;
+    double centre[ODEM_MAX_DOF], half[ODEM_MAX_DOF];
+
+    free(walls->cells);
+    walls->cells = NULL;
+    walls->num_cells = 0;
+    walls->grid = grid;
+    if (grid == NULL) return;
+    if (grid->dof != walls->dof) die("Grid and wall dofs differ.");
+
+    walls->cells = (int*)malloc(grid->num_cells * sizeof(int));
+    if (walls->cells == NULL) die("Memory allocation error");
+
+    for (i = 0; i < grid->dof; i++)
+        half[i] = 0.5 * grid->cell_size[i];
+    for (c = 0; c < grid->num_cells; c++)
+    {
+        /* the first dof varies fastest, see odem_mgrid_bin */
+        cell = c;
+        for (i = 0; i < grid->dof; i++)
+        {
+            centre[i] = grid->origin[i] + ((cell % grid->dims[i]) +
+                grid->first[i] + 0.5) * grid->cell_size[i];
+            cell /= grid->dims[i];
+        }
+
+        for (w = 0; w < walls->num_walls; w++)
+        {
+            if (walls->walls[w].moving) continue;
+            if (odem_wall_reaches(walls->walls + w, grid->dof, centre, half,
+                reach))
+            {
+                walls->cells[walls->num_cells++] = c;
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef __WALL_H
+
+#define __WALL_H 1
+
+#include "particle.h"
+#include "grid.h"
+
+// data structures
+
+/**
+ * Plane wall
+ *
+ * Particles are kept on the side the normal points to. A wall of positive
+ * extent only touches particles whose centroid projects within extent of its
+ * point, so walls with an opening, e.g. those of a hopper, are made of
+ * several finite walls.
+ *
+ * @member normal Unit normal, pointing into the domain
+ * @member origin Point on the wall at time 0
+ * @member velocity Velocity of the wall, the normal never changes
+ * @member extent Largest distance of a contact from the point of the wall in
+ *                the plane of the wall, 0 for an infinite plane
+ * @member moving Whether or not the velocity is nonzero
+ * @member point Point on the wall at the current time
+ */
+struct odem_wall
+{
+    double normal[ODEM_MAX_DOF];
+    double origin[ODEM_MAX_DOF];
+    double velocity[ODEM_MAX_DOF];
+    double extent;
+    int moving;
+    double point[ODEM_MAX_DOF];
+};
+
+/**
+ * Set of walls with the grid cells particles touching its static walls are
+ * binned into
+ *
+ * Static walls only need checking against the particles of a few cells near
+ * them, moving walls are checked against every particle.
+ *
+ * @member dof Number of dofs
+ * @member num_walls Number of walls
+ * @member capacity Number of walls the set has room for
+ * @member walls Walls
+ * @member num_moving Number of moving walls
+ * @member grid Grid the cells refer to, NULL to check every particle
+ * @member cells Cells within reach of a static wall
+ * @member num_cells Number of cells
+ */
+struct odem_walls
+{
+    int dof;
+    int num_walls;
+    int capacity;
+    struct odem_wall* walls;
+    int num_moving;
+    const struct odem_grid* grid;
+    int* cells;
+    int num_cells;
+};
+
+
+// function interfaces
+struct odem_walls* odem_alloc_walls(const int, const int);
+void odem_dealloc_walls(struct odem_walls*);
+void odem_mwalls_push(struct odem_walls*, const double[], const double[],
+    const double[], const double);
+void odem_mwalls_push_bounds(struct odem_walls*, const double[]);
+void odem_mwalls_append(struct odem_walls*, const struct odem_walls*);
+void odem_mwalls_at(struct odem_walls*, const double);
+double odem_wall_overlap(const struct odem_wall*,
+    const struct odem_particles*, const int);
+void odem_mwalls_cull(struct odem_walls*, const struct odem_grid*,
+    const double);
+
+#endif  /* __WALL_H */